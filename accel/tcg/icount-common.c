@@ -85,6 +85,7 @@ static void icount_update_locked(CPUState *cpu)
 {
     int64_t executed = icount_get_executed(cpu);
     cpu->icount_budget -= executed;
+    qatomic_set_i64(&cpu->icount_retired, cpu->icount_retired + executed);
 
     qatomic_set_i64(&timers_state.qemu_icount,
                     timers_state.qemu_icount + executed);
@@ -140,6 +141,19 @@ int64_t icount_get_raw(void)
     return icount;
 }
 
+int64_t icount_get_cpu(CPUState *cpu)
+{
+    if (cpu == current_cpu && cpu->running) {
+        if (!cpu->neg.can_do_io) {
+            error_report("Bad icount read");
+            exit(1);
+        }
+        /* Take into account what has run */
+        icount_update(cpu);
+    }
+    return qatomic_read_i64(&cpu->icount_retired);
+}
+
 /* Return the virtual CPU time, based on the instruction counter.  */
 int64_t icount_get(void)
 {
@@ -242,6 +242,30 @@ SRST
     Show memory tree.
 ERST
 
+    {
+        .name       = "mtree-profile",
+        .args_type  = "folded:-f,max:i?",
+        .params     = "[-f] [max]",
+        .help       = "show MMIO access profiling info, up to max entries "
+                      "(default: 20, 0: all), sorted by total host time "
+                      "(-f: dump folded stacks for flamegraph.pl)",
+        .cmd        = hmp_info_mtree_profile,
+    },
+
+SRST
+  ``info mtree-profile [-f]`` [*max*]
+    Show MMIO access profiling info, up to *max* entries (default: 20, 0
+    for all), sorted by total host time. Accesses are counted per memory
+    region and offset bucket; buckets cover at least 4 bytes and are
+    widened for large regions so that each region has at most 1024 of
+    them. The time spent in a region includes any nested accesses its
+    handlers make to other regions.
+
+    ``-f``
+      dump every bucket in the folded stacks format, weighted by host
+      nanoseconds, e.g. for ``flamegraph.pl``
+ERST
+
 #if defined(CONFIG_TCG)
     {
         .name       = "jit",
@@ -347,6 +371,21 @@ SRST
     Show host USB devices.
 ERST
 
+#if defined(TARGET_AARCH64)
+    {
+        .name       = "pmgr",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show Apple PMGR power domain residency",
+    },
+#endif
+
+SRST
+  ``info pmgr``
+    Show the state of each Apple PMGR power domain, how long it has been
+    on and off since the last reset, and how often it was gated.
+ERST
+
     {
         .name       = "capture",
         .args_type  = "",
@@ -897,6 +936,23 @@ SRST
     Show guest Apple DART IOMMUs.
 ERST
 
+#if defined(TARGET_AARCH64)
+    {
+        .name         = "apple-memmap",
+        .args_type    = "",
+        .params       = "",
+        .help         = "show the memory layout of Apple machines",
+        .cmd          = hmp_info_apple_memmap,
+    },
+#endif
+
+SRST
+  ``info apple-memmap``
+    Show the RAM regions of Apple machines and the host memory backend,
+    page size and NUMA binding of each, followed by the DRAM carveouts of
+    the current boot with their reserved and host-resident sizes.
+ERST
+
     {
         .name       = "stats",
         .args_type  = "target:s,names:s?,provider:s?",
@@ -19,6 +19,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "accel/tcg/cpu-ops.h"
 #include "exec/address-spaces.h"
 #include "hw/arm/apple-silicon/a13.h"
 #include "hw/arm/apple-silicon/a13_gxf.h"
@@ -30,11 +31,14 @@
 #include "migration/vmstate.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
+#include "qemu/lockable.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/memalign.h"
 #include "qemu/queue.h"
 #include "qemu/timer.h"
 #include "arm-powerctl.h"
+#include "system/cpu-timers.h"
 #include "system/reset.h"
 #include "target/arm/cpregs.h"
 
@@ -60,6 +64,24 @@
       .fieldoffset = offsetof(AppleA13State, A13_CPREG_VAR_NAME(p_name)) - \
                      offsetof(ARMCPU, env) }
 
+#define A13_CPREG_DEF_IO(p_name, p_op0, p_op1, p_crn, p_crm, p_op2,          \
+                         p_access, p_readfn, p_writefn)                     \
+    { .cp = CP_REG_ARM64_SYSREG_CP,                                        \
+      .name = #p_name,                                                     \
+      .opc0 = p_op0,                                                       \
+      .crn = p_crn,                                                        \
+      .crm = p_crm,                                                        \
+      .opc1 = p_op1,                                                       \
+      .opc2 = p_op2,                                                       \
+      .access = p_access,                                                  \
+      .state = ARM_CP_STATE_AA64,                                          \
+      .type = ARM_CP_OVERRIDE | ARM_CP_IO,                                 \
+      .readfn = p_readfn,                                                  \
+      .writefn = p_writefn,                                                \
+      .raw_writefn = raw_write,                                            \
+      .fieldoffset = offsetof(AppleA13State, A13_CPREG_VAR_NAME(p_name)) - \
+                     offsetof(ARMCPU, env) }
+
 #define A13_CLUSTER_CPREG_DEF(p_name, p_op0, p_op1, p_crn, p_crm, p_op2, \
                               p_access)                                  \
     { .cp = CP_REG_ARM64_SYSREG_CP,                                      \
@@ -96,6 +118,19 @@
 #define NSEC_PER_MSEC 1000000ull /* nanoseconds per millisecond */
 #define RTCLOCK_SEC_DIVISOR 24000000ull
 
+/* Apple PMU */
+#define A13_PMU_FREQ 24000000u /* matches the clock-frequency given to XNU */
+#define A13_PMU_NUM_PMC 2 /* PMC0 (cycles) and PMC1 (retired instructions) */
+#define A13_PMC_WIDTH 47
+#define A13_PMC_MASK ((1ULL << A13_PMC_WIDTH) - 1)
+#define PMCR0_PMC_EN(ctr) (1ULL << (ctr))
+#define PMCR0_IMODE_SHIFT 8
+#define PMCR0_IMODE_MASK (7ULL << PMCR0_IMODE_SHIFT)
+#define PMCR0_IMODE_FIQ (4ULL << PMCR0_IMODE_SHIFT)
+#define PMCR0_PMAI (1ULL << 11)
+#define PMCR0_PMI_EN(ctr) (1ULL << (12 + (ctr)))
+#define PMSR_OVF(ctr) (1ULL << (ctr))
+
 static void absolutetime_to_nanoseconds(uint64_t abstime, uint64_t *result)
 {
     uint64_t t64;
@@ -118,6 +153,7 @@ static void nanoseconds_to_absolutetime(uint64_t nanosecs, uint64_t *result)
 static QTAILQ_HEAD(, AppleA13Cluster) clusters =
     QTAILQ_HEAD_INITIALIZER(clusters);
 
+/* Shared by all clusters and accessed without the BQL, so use atomics. */
 static uint64_t ipi_cr = kDeferredIPITimerDefault;
 static QEMUTimer *ipicr_timer = NULL;
 
@@ -208,28 +244,77 @@ static void apple_a13_cluster_cpreg_write(CPUARMState *env,
     *(uint64_t *)((char *)(c) + (ri)->fieldoffset) = value;
 }
 
+/*
+ * The IPI cpregs are accessed without the BQL.  A cpu's ipi_sr only changes
+ * with the BQL held, together with its fast IPI line, so an IPI to a cpu
+ * that already has one pending coalesces without taking the BQL.  The
+ * deferred and no-wake matrices are protected by the cluster's ipi_lock.
+ *
+ * Lock order is BQL, then ipi_lock.
+ */
+
 /* Deliver IPI */
 static void apple_a13_cluster_deliver_ipi(AppleA13Cluster *c, uint64_t cpu_id,
                                           uint64_t src_cpu, uint64_t flag)
 {
-    if (c->cpus[cpu_id]->ipi_sr)
+    AppleA13State *acpu = c->cpus[cpu_id];
+
+    if (qatomic_read(&acpu->ipi_sr)) {
+        return;
+    }
+
+    BQL_LOCK_GUARD();
+
+    if (acpu->ipi_sr) {
         return;
+    }
+
+    qatomic_set(&acpu->ipi_sr,
+                1LL | (src_cpu << IPI_SR_SRC_CPU_SHIFT) | flag);
+    qemu_irq_raise(acpu->fast_ipi);
+}
+
+static bool apple_a13_cluster_has_deferred(AppleA13Cluster *c)
+{
+    int i, j;
 
-    c->cpus[cpu_id]->ipi_sr = 1LL | (src_cpu << IPI_SR_SRC_CPU_SHIFT) | flag;
-    qemu_irq_raise(c->cpus[cpu_id]->fast_ipi);
+    for (i = 0; i < A13_MAX_CPU; i++) {
+        for (j = 0; j < A13_MAX_CPU; j++) {
+            if (c->deferredIPI[i][j]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/*
+ * The IPI_CR timer only runs while deferred IPIs are outstanding, so idle
+ * CPUs are not woken up periodically.  No-wake IPIs to a sleeping CPU are
+ * delivered from its EL change hook once something else wakes it up.
+ */
+static void apple_a13_cluster_arm_ipicr(void)
+{
+    if (ipicr_timer != NULL && !timer_pending(ipicr_timer)) {
+        timer_mod_ns(ipicr_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                                      qatomic_read(&ipi_cr));
+    }
 }
 
 static int apple_a13_cluster_pre_save(void *opaque)
 {
     AppleA13Cluster *cluster = APPLE_A13_CLUSTER(opaque);
-    cluster->ipi_cr = ipi_cr;
+    cluster->ipi_cr = qatomic_read(&ipi_cr);
     return 0;
 }
 
 static int apple_a13_cluster_post_load(void *opaque, int version_id)
 {
     AppleA13Cluster *cluster = APPLE_A13_CLUSTER(opaque);
-    ipi_cr = cluster->ipi_cr;
+    qatomic_set(&ipi_cr, cluster->ipi_cr);
+    if (apple_a13_cluster_has_deferred(cluster)) {
+        apple_a13_cluster_arm_ipicr();
+    }
     return 0;
 }
 
@@ -264,6 +349,10 @@ static void apple_a13_cluster_realize(DeviceState *dev, Error **errp)
     object_child_foreach_recursive(OBJECT(cluster), add_cpu_to_cluster, dev);
 }
 
+/*
+ * Deliver expired deferred and no-wake IPIs, call with BQL and ipi_lock
+ * held
+ */
 static void apple_a13_cluster_tick(AppleA13Cluster *c)
 {
     int i, j;
@@ -272,6 +361,7 @@ static void apple_a13_cluster_tick(AppleA13Cluster *c)
         for (j = 0; j < A13_MAX_CPU; j++) { /* target */
             if (c->cpus[j] && c->deferredIPI[i][j] &&
                 !apple_a13_cpu_is_powered_off(c->cpus[j])) {
+                c->deferredIPI[i][j] = 0;
                 apple_a13_cluster_deliver_ipi(c, j, i, IPI_RR_TYPE_DEFERRED);
                 break;
             }
@@ -283,6 +373,7 @@ static void apple_a13_cluster_tick(AppleA13Cluster *c)
             if (c->cpus[j] && c->noWakeIPI[i][j] &&
                 !apple_a13_cpu_is_sleep(c->cpus[j]) &&
                 !apple_a13_cpu_is_powered_off(c->cpus[j])) {
+                c->noWakeIPI[i][j] = 0;
                 apple_a13_cluster_deliver_ipi(c, j, i, IPI_RR_TYPE_NOWAKE);
                 break;
             }
@@ -293,13 +384,59 @@ static void apple_a13_cluster_tick(AppleA13Cluster *c)
 static void apple_a13_cluster_ipicr_tick(void *opaque)
 {
     AppleA13Cluster *cluster;
+    bool pending = false;
+
     QTAILQ_FOREACH (cluster, &clusters, next) {
+        QEMU_LOCK_GUARD(&cluster->ipi_lock);
+
         apple_a13_cluster_tick(cluster);
+        pending |= apple_a13_cluster_has_deferred(cluster);
     }
 
-    timer_mod_ns(ipicr_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + ipi_cr);
+    if (pending) {
+        apple_a13_cluster_arm_ipicr();
+    }
 }
 
+/*
+ * Called with the BQL held on every exception taken by the CPU, which
+ * includes the interrupt that wakes it up.  Hand it a no-wake IPI that
+ * was stored while it was asleep.
+ */
+static void apple_a13_cpu_el_change(ARMCPU *cpu, void *opaque)
+{
+    AppleA13State *acpu = APPLE_A13(cpu);
+    AppleA13Cluster *c;
+    int i;
+
+    if (qatomic_read(&acpu->ipi_sr)) {
+        return;
+    }
+
+    c = apple_a13_find_cluster(acpu->cluster_id);
+    if (unlikely(!c)) {
+        return;
+    }
+
+    for (i = 0; i < A13_MAX_CPU; i++) {
+        if (qatomic_read(&c->noWakeIPI[i][acpu->cpu_id])) {
+            break;
+        }
+    }
+    if (i == A13_MAX_CPU) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&c->ipi_lock);
+    for (i = 0; i < A13_MAX_CPU; i++) {
+        if (c->noWakeIPI[i][acpu->cpu_id]) {
+            c->noWakeIPI[i][acpu->cpu_id] = 0;
+            apple_a13_cluster_deliver_ipi(c, acpu->cpu_id, i,
+                                          IPI_RR_TYPE_NOWAKE);
+            break;
+        }
+    }
+}
 
 static void apple_a13_cluster_reset_handler(void *opaque)
 {
@@ -309,20 +446,55 @@ static void apple_a13_cluster_reset_handler(void *opaque)
     }
     ipicr_timer =
         timer_new_ns(QEMU_CLOCK_VIRTUAL, apple_a13_cluster_ipicr_tick, NULL);
-    timer_mod_ns(ipicr_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
-                                  kDeferredIPITimerDefault);
 }
 
 static void apple_a13_cluster_instance_init(Object *obj)
 {
     AppleA13Cluster *cluster = APPLE_A13_CLUSTER(obj);
     QTAILQ_INSERT_TAIL(&clusters, cluster, next);
+    qemu_mutex_init(&cluster->ipi_lock);
 
     if (ipicr_timer == NULL) {
         qemu_register_reset(apple_a13_cluster_reset_handler, NULL);
     }
 }
 
+static void apple_a13_cluster_send_ipi(AppleA13Cluster *c, AppleA13State *acpu,
+                                       uint32_t cpu_id, uint64_t value)
+{
+    switch (value & IPI_RR_TYPE_MASK) {
+    case IPI_RR_TYPE_NOWAKE:
+        if (apple_a13_cpu_is_sleep(c->cpus[cpu_id])) {
+            WITH_QEMU_LOCK_GUARD(&c->ipi_lock) {
+                c->noWakeIPI[acpu->cpu_id][cpu_id] = 1;
+            }
+        } else {
+            apple_a13_cluster_deliver_ipi(c, cpu_id, acpu->cpu_id,
+                                          IPI_RR_TYPE_IMMEDIATE);
+        }
+        break;
+    case IPI_RR_TYPE_DEFERRED:
+        WITH_QEMU_LOCK_GUARD(&c->ipi_lock) {
+            c->deferredIPI[acpu->cpu_id][cpu_id] = 1;
+        }
+        apple_a13_cluster_arm_ipicr();
+        break;
+    case IPI_RR_TYPE_RETRACT:
+        WITH_QEMU_LOCK_GUARD(&c->ipi_lock) {
+            c->deferredIPI[acpu->cpu_id][cpu_id] = 0;
+            c->noWakeIPI[acpu->cpu_id][cpu_id] = 0;
+        }
+        break;
+    case IPI_RR_TYPE_IMMEDIATE:
+        apple_a13_cluster_deliver_ipi(c, cpu_id, acpu->cpu_id,
+                                      IPI_RR_TYPE_IMMEDIATE);
+        break;
+    default:
+        g_assert_not_reached();
+        break;
+    }
+}
+
 /* Deliver local IPI */
 static void apple_a13_ipi_rr_local(CPUARMState *env, const ARMCPRegInfo *ri,
                                    uint64_t value)
@@ -351,30 +523,7 @@ static void apple_a13_ipi_rr_local(CPUARMState *env, const ARMCPRegInfo *ri,
         return;
     }
 
-    switch (value & IPI_RR_TYPE_MASK) {
-    case IPI_RR_TYPE_NOWAKE:
-        if (apple_a13_cpu_is_sleep(c->cpus[cpu_id])) {
-            c->noWakeIPI[acpu->cpu_id][cpu_id] = 1;
-        } else {
-            apple_a13_cluster_deliver_ipi(c, cpu_id, acpu->cpu_id,
-                                          IPI_RR_TYPE_IMMEDIATE);
-        }
-        break;
-    case IPI_RR_TYPE_DEFERRED:
-        c->deferredIPI[acpu->cpu_id][cpu_id] = 1;
-        break;
-    case IPI_RR_TYPE_RETRACT:
-        c->deferredIPI[acpu->cpu_id][cpu_id] = 0;
-        c->noWakeIPI[acpu->cpu_id][cpu_id] = 0;
-        break;
-    case IPI_RR_TYPE_IMMEDIATE:
-        apple_a13_cluster_deliver_ipi(c, cpu_id, acpu->cpu_id,
-                                      IPI_RR_TYPE_IMMEDIATE);
-        break;
-    default:
-        g_assert_not_reached();
-        break;
-    }
+    apple_a13_cluster_send_ipi(c, acpu, cpu_id, value);
 }
 
 /* Deliver global IPI */
@@ -411,30 +560,7 @@ static void apple_a13_ipi_rr_global(CPUARMState *env, const ARMCPRegInfo *ri,
         return;
     }
 
-    switch (value & IPI_RR_TYPE_MASK) {
-    case IPI_RR_TYPE_NOWAKE:
-        if (apple_a13_cpu_is_sleep(c->cpus[cpu_id])) {
-            c->noWakeIPI[acpu->cpu_id][cpu_id] = 1;
-        } else {
-            apple_a13_cluster_deliver_ipi(c, cpu_id, acpu->cpu_id,
-                                          IPI_RR_TYPE_IMMEDIATE);
-        }
-        break;
-    case IPI_RR_TYPE_DEFERRED:
-        c->deferredIPI[acpu->cpu_id][cpu_id] = 1;
-        break;
-    case IPI_RR_TYPE_RETRACT:
-        c->deferredIPI[acpu->cpu_id][cpu_id] = 0;
-        c->noWakeIPI[acpu->cpu_id][cpu_id] = 0;
-        break;
-    case IPI_RR_TYPE_IMMEDIATE:
-        apple_a13_cluster_deliver_ipi(c, cpu_id, acpu->cpu_id,
-                                      IPI_RR_TYPE_IMMEDIATE);
-        break;
-    default:
-        g_assert_not_reached();
-        break;
-    }
+    apple_a13_cluster_send_ipi(c, acpu, cpu_id, value);
 }
 
 /* Receiving IPI */
@@ -443,7 +569,7 @@ static uint64_t apple_a13_ipi_read_sr(CPUARMState *env, const ARMCPRegInfo *ri)
     AppleA13State *acpu = APPLE_A13(env_archcpu(env));
 
     g_assert_cmphex(env_archcpu(env)->mp_affinity, ==, acpu->mpidr);
-    return acpu->ipi_sr;
+    return qatomic_read(&acpu->ipi_sr);
 }
 
 /* Acknowledge received IPI */
@@ -454,8 +580,14 @@ static void apple_a13_ipi_write_sr(CPUARMState *env, const ARMCPRegInfo *ri,
     AppleA13Cluster *c = apple_a13_find_cluster(acpu->cluster_id);
     uint64_t src_cpu = IPI_SR_SRC_CPU(value);
 
-    acpu->ipi_sr = 0;
-    qemu_irq_lower(acpu->fast_ipi);
+    if (qatomic_read(&acpu->ipi_sr)) {
+        BQL_LOCK_GUARD();
+
+        qatomic_set(&acpu->ipi_sr, 0);
+        qemu_irq_lower(acpu->fast_ipi);
+    }
+
+    QEMU_LOCK_GUARD(&c->ipi_lock);
 
     switch (value & IPI_RR_TYPE_MASK) {
     case IPI_RR_TYPE_NOWAKE:
@@ -474,7 +606,7 @@ static uint64_t apple_a13_ipi_read_cr(CPUARMState *env, const ARMCPRegInfo *ri)
 {
     uint64_t abstime;
 
-    nanoseconds_to_absolutetime(ipi_cr, &abstime);
+    nanoseconds_to_absolutetime(qatomic_read(&ipi_cr), &abstime);
     return abstime;
 }
 
@@ -486,14 +618,202 @@ static void apple_a13_ipi_write_cr(CPUARMState *env, const ARMCPRegInfo *ri,
 
     absolutetime_to_nanoseconds(value, &nanosec);
 
-    uint64_t ct;
+    uint64_t ct, old_cr;
 
-    if (value == 0)
-        value = kDeferredIPITimerDefault;
+    if (nanosec == 0) {
+        nanosec = kDeferredIPITimerDefault;
+    }
 
+    old_cr = qatomic_xchg(&ipi_cr, nanosec);
     ct = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
-    timer_mod_ns(ipicr_timer, (ct / ipi_cr) * ipi_cr + nanosec);
-    ipi_cr = nanosec;
+    if (timer_pending(ipicr_timer)) {
+        timer_mod_ns(ipicr_timer, (ct / old_cr) * old_cr + nanosec);
+    }
+}
+
+/*
+ * Virtual time this vCPU spent executing, so that time spent halted in
+ * WFI or powered off is not counted. With icount it follows the vCPU's own
+ * instruction count, otherwise the time it spent in cpu_exec().
+ */
+static int64_t apple_a13_pmu_run_ns(AppleA13State *acpu)
+{
+    if (icount_enabled()) {
+        int64_t insns = icount_get_cpu(CPU(acpu));
+
+        acpu->pmu_run_ns += icount_to_ns(insns - acpu->pmu_insns);
+        acpu->pmu_insns = insns;
+        return acpu->pmu_run_ns;
+    }
+    if (acpu->pmu_executing) {
+        return acpu->pmu_run_ns + qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) -
+               acpu->pmu_exec_start;
+    }
+    return acpu->pmu_run_ns;
+}
+
+static uint64_t apple_a13_pmu_event_count(AppleA13State *acpu, int ctr)
+{
+    if (ctr == 0) {
+        return muldiv64(apple_a13_pmu_run_ns(acpu), A13_PMU_FREQ,
+                        NANOSECONDS_PER_SECOND);
+    }
+
+    /* Retired instructions are only known with icount. */
+    return icount_enabled() ? icount_get_cpu(CPU(acpu)) : 0;
+}
+
+/* A lower bound of the virtual time it takes to count @count events. */
+static int64_t apple_a13_pmu_ns_per(int ctr, uint64_t count)
+{
+    if (ctr == 1) {
+        return icount_enabled() ? icount_to_ns(count) : INT64_MAX;
+    }
+
+    return muldiv64(count, NANOSECONDS_PER_SECOND, A13_PMU_FREQ);
+}
+
+static uint64_t *apple_a13_pmc(AppleA13State *acpu, int ctr)
+{
+    return ctr == 0 ? &acpu->A13_CPREG_VAR_NAME(PMC0) :
+                      &acpu->A13_CPREG_VAR_NAME(PMC1);
+}
+
+static bool apple_a13_pmc_enabled(AppleA13State *acpu, int ctr)
+{
+    return (acpu->A13_CPREG_VAR_NAME(PMCR0) & PMCR0_PMC_EN(ctr)) != 0;
+}
+
+/* Fold the events counted since the last sync into PMC0/PMC1. */
+static void apple_a13_pmu_sync(AppleA13State *acpu)
+{
+    int ctr;
+
+    for (ctr = 0; ctr < A13_PMU_NUM_PMC; ctr++) {
+        uint64_t now, val;
+
+        if (!apple_a13_pmc_enabled(acpu, ctr)) {
+            continue;
+        }
+
+        now = apple_a13_pmu_event_count(acpu, ctr);
+        val = *apple_a13_pmc(acpu, ctr) + (now - acpu->pmc_ref[ctr]);
+        if (val & ~A13_PMC_MASK) {
+            acpu->A13_CPREG_VAR_NAME(PMSR) |= PMSR_OVF(ctr);
+            if (acpu->A13_CPREG_VAR_NAME(PMCR0) & PMCR0_PMI_EN(ctr)) {
+                acpu->A13_CPREG_VAR_NAME(PMCR0) |= PMCR0_PMAI;
+            }
+        }
+        *apple_a13_pmc(acpu, ctr) = val & A13_PMC_MASK;
+        acpu->pmc_ref[ctr] = now;
+    }
+}
+
+/* Restart the event references, e.g. after enabling a counter. */
+static void apple_a13_pmu_rebase(AppleA13State *acpu)
+{
+    int ctr;
+
+    for (ctr = 0; ctr < A13_PMU_NUM_PMC; ctr++) {
+        acpu->pmc_ref[ctr] = apple_a13_pmu_event_count(acpu, ctr);
+    }
+}
+
+/* Update the PMI line and arm the timer for the next overflow. */
+static void apple_a13_pmu_update(AppleA13State *acpu)
+{
+    uint64_t pmcr0 = acpu->A13_CPREG_VAR_NAME(PMCR0);
+    int64_t next = INT64_MAX;
+    int ctr;
+
+    qemu_set_irq(acpu->pmi, (pmcr0 & PMCR0_PMAI) &&
+                                (pmcr0 & PMCR0_IMODE_MASK) == PMCR0_IMODE_FIQ);
+
+    for (ctr = 0; ctr < A13_PMU_NUM_PMC; ctr++) {
+        uint64_t remaining;
+
+        if (!apple_a13_pmc_enabled(acpu, ctr) ||
+            !(pmcr0 & PMCR0_PMI_EN(ctr))) {
+            continue;
+        }
+
+        remaining = A13_PMC_MASK - *apple_a13_pmc(acpu, ctr) + 1;
+        next = MIN(next, apple_a13_pmu_ns_per(ctr, remaining));
+    }
+
+    if (next == INT64_MAX) {
+        timer_del(acpu->pmu_timer);
+    } else {
+        timer_mod_anticipate_ns(acpu->pmu_timer,
+                                qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + next);
+    }
+}
+
+static void apple_a13_pmu_overflow_work(CPUState *cs, run_on_cpu_data data)
+{
+    AppleA13State *acpu = APPLE_A13(cs);
+
+    apple_a13_pmu_sync(acpu);
+    apple_a13_pmu_update(acpu);
+}
+
+static void apple_a13_pmu_timer_cb(void *opaque)
+{
+    /* The counters advance on the vCPU thread, so sync them there. */
+    async_run_on_cpu(CPU(opaque), apple_a13_pmu_overflow_work,
+                     RUN_ON_CPU_NULL);
+}
+
+static void apple_a13_cpu_exec_enter(CPUState *cs)
+{
+    AppleA13State *acpu = APPLE_A13(cs);
+
+    if (!icount_enabled()) {
+        acpu->pmu_exec_start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+        acpu->pmu_executing = true;
+    }
+}
+
+static void apple_a13_cpu_exec_exit(CPUState *cs)
+{
+    AppleA13State *acpu = APPLE_A13(cs);
+
+    if (acpu->pmu_executing) {
+        acpu->pmu_run_ns +=
+            qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - acpu->pmu_exec_start;
+        acpu->pmu_executing = false;
+    }
+}
+
+static uint64_t apple_a13_pmu_read(CPUARMState *env, const ARMCPRegInfo *ri)
+{
+    AppleA13State *acpu = APPLE_A13(env_archcpu(env));
+
+    apple_a13_pmu_sync(acpu);
+    apple_a13_pmu_update(acpu);
+    return CPREG_FIELD64(env, ri);
+}
+
+static void apple_a13_pmc_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                uint64_t value)
+{
+    AppleA13State *acpu = APPLE_A13(env_archcpu(env));
+
+    apple_a13_pmu_sync(acpu);
+    CPREG_FIELD64(env, ri) = value & A13_PMC_MASK;
+    apple_a13_pmu_rebase(acpu);
+    apple_a13_pmu_update(acpu);
+}
+
+static void apple_a13_pmu_ctl_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                    uint64_t value)
+{
+    AppleA13State *acpu = APPLE_A13(env_archcpu(env));
+
+    apple_a13_pmu_sync(acpu);
+    CPREG_FIELD64(env, ri) = value;
+    apple_a13_pmu_rebase(acpu);
+    apple_a13_pmu_update(acpu);
 }
 
 static const ARMCPRegInfo apple_a13_cp_reginfo_tcg[] = {
@@ -524,11 +844,15 @@ static const ARMCPRegInfo apple_a13_cp_reginfo_tcg[] = {
     A13_CPREG_DEF(IMP_BARRIER_LBSY_BST_SYNC_W1_EL0, 3, 3, 15, 15, 1, PL1_RW, 0),
     A13_CPREG_DEF(ARM64_REG_3_3_15_7, 3, 3, 15, 7, 0, PL1_RW,
                   0x8000000000332211ULL),
-    A13_CPREG_DEF(PMC0, 3, 2, 15, 0, 0, PL1_RW, 0),
-    A13_CPREG_DEF(PMC1, 3, 2, 15, 1, 0, PL1_RW, 0),
-    A13_CPREG_DEF(PMCR0, 3, 1, 15, 0, 0, PL1_RW, 0),
+    A13_CPREG_DEF_IO(PMC0, 3, 2, 15, 0, 0, PL1_RW, apple_a13_pmu_read,
+                     apple_a13_pmc_write),
+    A13_CPREG_DEF_IO(PMC1, 3, 2, 15, 1, 0, PL1_RW, apple_a13_pmu_read,
+                     apple_a13_pmc_write),
+    A13_CPREG_DEF_IO(PMCR0, 3, 1, 15, 0, 0, PL1_RW, apple_a13_pmu_read,
+                     apple_a13_pmu_ctl_write),
     A13_CPREG_DEF(PMCR1, 3, 1, 15, 1, 0, PL1_RW, 0),
-    A13_CPREG_DEF(PMSR, 3, 1, 15, 13, 0, PL1_RW, 0),
+    A13_CPREG_DEF_IO(PMSR, 3, 1, 15, 13, 0, PL1_RW, apple_a13_pmu_read,
+                     apple_a13_pmu_ctl_write),
     A13_CPREG_DEF(S3_4_c15_c0_5, 3, 4, 15, 0, 5, PL1_RW, 0),
     A13_CPREG_DEF(AMX_STATUS_EL1, 3, 4, 15, 1, 3, PL1_R, 0),
     A13_CPREG_DEF(AMX_CTL_EL1, 3, 4, 15, 1, 4, PL1_RW, 0),
@@ -554,7 +878,7 @@ static const ARMCPRegInfo apple_a13_cp_reginfo_tcg[] = {
         .crm = 0,
         .opc2 = 0,
         .access = PL1_W,
-        .type = ARM_CP_IO | ARM_CP_NO_RAW,
+        .type = ARM_CP_IO | ARM_CP_IO_NO_BQL | ARM_CP_NO_RAW,
         .state = ARM_CP_STATE_AA64,
         .readfn = arm_cp_read_zero,
         .writefn = apple_a13_ipi_rr_local,
@@ -568,7 +892,7 @@ static const ARMCPRegInfo apple_a13_cp_reginfo_tcg[] = {
         .crm = 0,
         .opc2 = 1,
         .access = PL1_W,
-        .type = ARM_CP_IO | ARM_CP_NO_RAW,
+        .type = ARM_CP_IO | ARM_CP_IO_NO_BQL | ARM_CP_NO_RAW,
         .state = ARM_CP_STATE_AA64,
         .readfn = arm_cp_read_zero,
         .writefn = apple_a13_ipi_rr_global,
@@ -582,7 +906,7 @@ static const ARMCPRegInfo apple_a13_cp_reginfo_tcg[] = {
         .crm = 1,
         .opc2 = 1,
         .access = PL1_RW,
-        .type = ARM_CP_IO | ARM_CP_NO_RAW,
+        .type = ARM_CP_IO | ARM_CP_IO_NO_BQL | ARM_CP_NO_RAW,
         .state = ARM_CP_STATE_AA64,
         .readfn = apple_a13_ipi_read_sr,
         .writefn = apple_a13_ipi_write_sr,
@@ -628,6 +952,7 @@ static void apple_a13_realize(DeviceState *dev, Error **errp)
         return;
     }
     apple_a13_init_gxf_override(acpu);
+    arm_register_el_change_hook(ARM_CPU(acpu), apple_a13_cpu_el_change, NULL);
     fiq_or = qdev_new(TYPE_OR_IRQ);
     object_property_add_child(obj, "fiq-or", OBJECT(fiq_or));
     qdev_prop_set_uint16(fiq_or, "num-lines", 16);
@@ -639,14 +964,27 @@ static void apple_a13_realize(DeviceState *dev, Error **errp)
 
     qdev_connect_gpio_out(dev, GTIMER_VIRT, qdev_get_gpio_in(fiq_or, 0));
     acpu->fast_ipi = qdev_get_gpio_in(fiq_or, 1);
+    acpu->pmi = qdev_get_gpio_in(fiq_or, 2);
+
+    acpu->pmu_timer =
+        timer_new_ns(QEMU_CLOCK_VIRTUAL, apple_a13_pmu_timer_cb, acpu);
 }
 
 static void apple_a13_reset_hold(Object *obj, ResetType type)
 {
     AppleA13Class *tclass = APPLE_A13_GET_CLASS(obj);
+    AppleA13State *acpu = APPLE_A13(obj);
+
     if (tclass->parent_phases.hold != NULL) {
         tclass->parent_phases.hold(obj, type);
     }
+
+    if (acpu->pmu_timer != NULL) {
+        timer_del(acpu->pmu_timer);
+    }
+    apple_a13_pmu_rebase(acpu);
+    /* PMCR0 is back to 0, so drop a PMI that was raised before the reset. */
+    qemu_irq_lower(acpu->pmi);
 }
 
 static void apple_a13_instance_init(Object *obj)
@@ -658,6 +996,9 @@ static void apple_a13_instance_init(Object *obj)
                                    OBJ_PROP_FLAG_READWRITE);
     object_property_add_uint64_ptr(obj, "pauth-mhi", &cpu->m_key_hi,
                                    OBJ_PROP_FLAG_READWRITE);
+    object_property_add_uint64_ptr(obj, "gxf-fast-transitions",
+                                   &cpu->gxf_fast_transitions,
+                                   OBJ_PROP_FLAG_READ);
 }
 
 AppleA13State *apple_a13_cpu_create(DTBNode *node, char *name, uint32_t cpu_id,
@@ -773,10 +1114,49 @@ static const Property apple_a13_cluster_properties[] = {
     DEFINE_PROP_UINT32("cluster-type", AppleA13Cluster, cluster_type, 0),
 };
 
+static int apple_a13_pre_save(void *opaque)
+{
+    AppleA13State *acpu = APPLE_A13(opaque);
+
+    apple_a13_pmu_sync(acpu);
+    return 0;
+}
+
+static int apple_a13_post_load(void *opaque, int version_id)
+{
+    AppleA13State *acpu = APPLE_A13(opaque);
+
+    apple_a13_pmu_rebase(acpu);
+    apple_a13_pmu_update(acpu);
+    return 0;
+}
+
+static bool apple_a13_amx_needed(void *opaque)
+{
+    return ARM_CPU(opaque)->env.amx.enabled != 0;
+}
+
+static const VMStateDescription vmstate_apple_a13_amx = {
+    .name = "apple_a13/amx",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = apple_a13_amx_needed,
+    .fields =
+        (const VMStateField[]){
+            VMSTATE_UINT8_ARRAY(env.amx.x, ARMCPU, 8 * 64),
+            VMSTATE_UINT8_ARRAY(env.amx.y, ARMCPU, 8 * 64),
+            VMSTATE_UINT8_2DARRAY(env.amx.z, ARMCPU, 64, 64),
+            VMSTATE_UINT32(env.amx.enabled, ARMCPU),
+            VMSTATE_END_OF_LIST(),
+        }
+};
+
 static const VMStateDescription vmstate_apple_a13 = {
     .name = "apple_a13",
     .version_id = 1,
     .minimum_version_id = 1,
+    .pre_save = apple_a13_pre_save,
+    .post_load = apple_a13_post_load,
     .fields =
         (const VMStateField[]){
             VMSTATE_A13_CPREG(ARM64_REG_EHID3),
@@ -818,6 +1198,11 @@ static const VMStateDescription vmstate_apple_a13 = {
             VMSTATE_UINT64(env.keys.m.lo, ARMCPU),
             VMSTATE_UINT64(env.keys.m.hi, ARMCPU),
             VMSTATE_END_OF_LIST(),
+        },
+    .subsections =
+        (const VMStateDescription *const[]){
+            &vmstate_apple_a13_amx,
+            NULL,
         }
 };
 
@@ -845,12 +1230,21 @@ static const VMStateDescription vmstate_apple_a13_cluster = {
         }
 };
 
+static TCGCPUOps apple_a13_tcg_ops;
+
 static void apple_a13_class_init(ObjectClass *klass, void *data)
 {
     ResettableClass *rc = RESETTABLE_CLASS(klass);
     DeviceClass *dc = DEVICE_CLASS(klass);
+    CPUClass *cc = CPU_CLASS(klass);
     AppleA13Class *tc = APPLE_A13_CLASS(klass);
 
+    /* Track the time spent executing for the PMU cycle counter. */
+    apple_a13_tcg_ops = *cc->tcg_ops;
+    apple_a13_tcg_ops.cpu_exec_enter = apple_a13_cpu_exec_enter;
+    apple_a13_tcg_ops.cpu_exec_exit = apple_a13_cpu_exec_exit;
+    cc->tcg_ops = &apple_a13_tcg_ops;
+
     device_class_set_parent_realize(dc, apple_a13_realize, &tc->parent_realize);
     resettable_class_set_parent_phases(rc, NULL, apple_a13_reset_hold, NULL,
                                        &tc->parent_phases);
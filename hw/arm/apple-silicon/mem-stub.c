@@ -0,0 +1,28 @@
+/*
+ * General Apple XNU memory utilities, stubs for targets without the Apple
+ * machines.
+ *
+ * Copyright (c) 2023-2025 Visual Ehrmanntraut (VisualEhrmanntraut).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "monitor/hmp-target.h"
+#include "monitor/monitor.h"
+
+void hmp_info_apple_memmap(Monitor *mon, const QDict *qdict)
+{
+    monitor_printf(mon, "Apple machines are not available in this QEMU\n");
+}
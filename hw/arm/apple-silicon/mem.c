@@ -18,12 +18,25 @@
  */
 
 #include "qemu/osdep.h"
+#include "exec/address-spaces.h"
+#include "exec/cpu-common.h"
 #include "exec/hwaddr.h"
 #include "exec/memory.h"
+#include "exec/target_page.h"
 #include "hw/arm/apple-silicon/dtb.h"
 #include "hw/arm/apple-silicon/mem.h"
+#include "hw/boards.h"
+#include "migration/vmstate.h"
+#include "monitor/hmp-target.h"
+#include "monitor/monitor.h"
 #include "qapi/error.h"
+#include "qemu/cutils.h"
 #include "qemu/error-report.h"
+#include "qemu/units.h"
+#include "qobject/qobject.h"
+#include "qom/object_interfaces.h"
+#include "qom/qom-qobject.h"
+#include "system/hostmem.h"
 
 hwaddr g_virt_base, g_phys_base, g_virt_slide, g_phys_slide;
 
@@ -58,12 +71,194 @@ hwaddr vtop_slid(hwaddr va)
     return vtop_static(va + g_virt_slide);
 }
 
+typedef struct AppleMemRegion {
+    char *name;
+    hwaddr addr;
+    MemoryRegion *mr;
+} AppleMemRegion;
+
+static GPtrArray *apple_mem_regions;
+
+typedef struct AppleCarveout {
+    char name[32];
+    hwaddr base;
+    hwaddr size;
+    uint32_t flags;
+} AppleCarveout;
+
+// Carveouts of the current boot, for `info apple-memmap`.
+static GArray *apple_carveouts;
+
+// Host memory backend properties inherited from the machine's DRAM backend.
+static const char *const apple_mem_backend_props[] = {
+    "merge", "dump", "share", "reserve", "prealloc",
+    "prealloc-threads", "host-nodes", "policy", "hugetlb", "hugetlbsize",
+    "seal",
+};
+
+/*
+ * Create a backend for one of the smaller RAM regions (SRAM, SEP memory...)
+ * that is set up the same way as the DRAM backend: same NUMA binding and
+ * preallocation and, for memfd, the same huge page size where the region
+ * is large enough for it.
+ */
+static HostMemoryBackend *apple_mem_backend_new(const char *name, hwaddr size)
+{
+    MachineState *machine = MACHINE(qdev_get_machine());
+    Object *tmpl = OBJECT(machine->memdev);
+    const char *type = TYPE_MEMORY_BACKEND_RAM;
+    Object *obj;
+    size_t i;
+
+    if (tmpl && object_dynamic_cast(tmpl, TYPE_MEMORY_BACKEND_MEMFD) &&
+        QEMU_IS_ALIGNED(size, qemu_ram_pagesize(machine->ram->ram_block))) {
+        type = TYPE_MEMORY_BACKEND_MEMFD;
+    }
+
+    obj = object_new(type);
+    object_property_set_uint(obj, "size", size, &error_fatal);
+    for (i = 0; tmpl && i < ARRAY_SIZE(apple_mem_backend_props); i++) {
+        const char *prop = apple_mem_backend_props[i];
+        QObject *val;
+
+        if (!object_property_find(obj, prop) ||
+            !object_property_find(tmpl, prop)) {
+            continue;
+        }
+        val = object_property_get_qobject(tmpl, prop, &error_fatal);
+        object_property_set_qobject(obj, prop, val, &error_fatal);
+        qobject_unref(val);
+    }
+
+    // The object id becomes the RAMBlock id, which keeps migration stable.
+    object_property_add_child(object_get_objects_root(), name, obj);
+    user_creatable_complete(USER_CREATABLE(obj), &error_fatal);
+    object_unref(obj);
+
+    return MEMORY_BACKEND(obj);
+}
+
+void apple_mem_map_ram(MemoryRegion *top, const char *name, hwaddr addr,
+                       MemoryRegion *mr, int priority)
+{
+    AppleMemRegion *region = g_new0(AppleMemRegion, 1);
+
+    region->name = g_strdup(name);
+    region->addr = addr;
+    region->mr = mr;
+    if (apple_mem_regions == NULL) {
+        apple_mem_regions = g_ptr_array_new();
+    }
+    g_ptr_array_add(apple_mem_regions, region);
+
+    memory_region_add_subregion_overlap(top, addr, mr, priority);
+}
+
 void allocate_ram(MemoryRegion *top, const char *name, hwaddr addr, hwaddr size,
                   int priority)
 {
-    MemoryRegion *sec = g_new(MemoryRegion, 1);
-    memory_region_init_ram(sec, NULL, name, size, &error_fatal);
-    memory_region_add_subregion_overlap(top, addr, sec, priority);
+    HostMemoryBackend *backend = apple_mem_backend_new(name, size);
+    MemoryRegion *sec = host_memory_backend_get_memory(backend);
+
+    host_memory_backend_set_mapped(backend, true);
+    vmstate_register_ram_global(sec);
+    apple_mem_map_ram(top, name, addr, sec, priority);
+}
+
+// Number of bytes of the guest memory at `base` resident on the host.
+static uint64_t apple_mem_resident(hwaddr base, hwaddr size)
+{
+    uint64_t resident = 0;
+#if defined(__linux__)
+    MemoryRegionSection section;
+    size_t page_size = qemu_real_host_page_size();
+    uintptr_t start, end;
+    unsigned char *vec;
+    size_t i;
+
+    section = memory_region_find(get_system_memory(), base, size);
+    if (section.mr == NULL) {
+        return 0;
+    }
+    if (memory_region_is_ram(section.mr)) {
+        start = (uintptr_t)memory_region_get_ram_ptr(section.mr) +
+                section.offset_within_region;
+        end = ROUND_UP(start + int128_get64(section.size), page_size);
+        start = ROUND_DOWN(start, page_size);
+        vec = g_malloc((end - start) / page_size);
+        if (mincore((void *)start, end - start, vec) == 0) {
+            for (i = 0; i < (end - start) / page_size; i++) {
+                resident += (vec[i] & 1) ? page_size : 0;
+            }
+        }
+        g_free(vec);
+    }
+    memory_region_unref(section.mr);
+#endif
+    return resident;
+}
+
+static char *apple_mem_backend_prop(Object *obj, const char *name)
+{
+    if (!object_property_find(obj, name)) {
+        return g_strdup("-");
+    }
+    return object_property_print(obj, name, true, NULL);
+}
+
+void hmp_info_apple_memmap(Monitor *mon, const QDict *qdict)
+{
+    guint i;
+
+    if (apple_mem_regions == NULL) {
+        monitor_printf(mon, "No Apple memory regions\n");
+        return;
+    }
+
+    monitor_printf(mon, "%-12s %-37s %10s  %-22s %8s %-8s %-10s %s\n",
+                   "Region", "Range", "Size", "Backend", "Page", "Prealloc",
+                   "Policy", "Host nodes");
+    for (i = 0; i < apple_mem_regions->len; i++) {
+        AppleMemRegion *region = g_ptr_array_index(apple_mem_regions, i);
+        uint64_t size = memory_region_size(region->mr);
+        Object *backend =
+            object_dynamic_cast(region->mr->owner, TYPE_MEMORY_BACKEND);
+        g_autofree char *prealloc = NULL;
+        g_autofree char *policy = NULL;
+        g_autofree char *nodes = NULL;
+
+        monitor_printf(mon,
+                       "%-12s 0x%016" HWADDR_PRIx "-0x%016" HWADDR_PRIx
+                       " %7" PRIu64 " KiB  %-22s %5zu KiB",
+                       region->name, region->addr, region->addr + size - 1,
+                       size / KiB,
+                       backend ? object_get_typename(backend) : "-",
+                       qemu_ram_pagesize(region->mr->ram_block) / KiB);
+        if (backend) {
+            prealloc = apple_mem_backend_prop(backend, "prealloc");
+            policy = apple_mem_backend_prop(backend, "policy");
+            nodes = apple_mem_backend_prop(backend, "host-nodes");
+        }
+        monitor_printf(mon, " %-8s %-10s %s\n", prealloc ?: "-",
+                       policy ?: "-", nodes && *nodes ? nodes : "-");
+    }
+
+    if (apple_carveouts == NULL || apple_carveouts->len == 0) {
+        return;
+    }
+
+    monitor_printf(mon, "\n%-12s %-37s %10s %12s  %s\n", "Carveout", "Range",
+                   "Reserved", "Resident", "Flags");
+    for (i = 0; i < apple_carveouts->len; i++) {
+        AppleCarveout *c = &g_array_index(apple_carveouts, AppleCarveout, i);
+
+        monitor_printf(mon,
+                       "%-12s 0x%016" HWADDR_PRIx "-0x%016" HWADDR_PRIx
+                       " %6" PRIu64 " KiB %8" PRIu64 " KiB  %s\n",
+                       c->name, c->base, c->base + c->size - 1, c->size / KiB,
+                       apple_mem_resident(c->base, c->size) / KiB,
+                       (c->flags & CARVEOUT_DISCARDABLE) ? "discardable" : "-");
+    }
 }
 
 struct CarveoutAllocator {
@@ -89,13 +284,58 @@ CarveoutAllocator *carveout_alloc_new(DTBNode *carveout_mmap, hwaddr dram_base,
     ca->alignment = alignment;
     ca->node = carveout_mmap;
 
+    if (apple_carveouts == NULL) {
+        apple_carveouts = g_array_new(false, true, sizeof(AppleCarveout));
+    }
+    // The previous boot's contents are about to be set up again.
+    carveout_discard_all();
+    g_array_set_size(apple_carveouts, 0);
+
     return ca;
 }
 
-hwaddr carveout_alloc_mem(CarveoutAllocator *ca, hwaddr size)
+/*
+ * Give the host pages of a carveout back. Preallocated backends are left
+ * alone, the user asked for that memory to stay populated. Carveouts are
+ * only 16 KiB aligned, so with huge pages just the pages that lie wholly
+ * inside the carveout are discarded.
+ */
+static void carveout_discard(hwaddr base, hwaddr size)
+{
+    MemoryRegionSection section;
+    Object *backend;
+    size_t page_size;
+    hwaddr start, end;
+
+    if (ram_block_discard_is_disabled()) {
+        return;
+    }
+
+    section = memory_region_find(get_system_memory(), base, size);
+    if (section.mr == NULL) {
+        return;
+    }
+    backend = object_dynamic_cast(section.mr->owner, TYPE_MEMORY_BACKEND);
+    if (memory_region_is_ram(section.mr) &&
+        int128_get64(section.size) == size &&
+        !(backend && object_property_get_bool(backend, "prealloc", NULL))) {
+        page_size = qemu_ram_pagesize(section.mr->ram_block);
+        start = ROUND_UP(section.offset_within_region, page_size);
+        end = ROUND_DOWN(section.offset_within_region + size, page_size);
+        if (start < end) {
+            ram_block_discard_range(section.mr->ram_block, start,
+                                    end - start);
+        }
+    }
+    memory_region_unref(section.mr);
+}
+
+hwaddr carveout_alloc_mem(CarveoutAllocator *ca, const char *name,
+                          hwaddr size, uint32_t flags)
 {
     hwaddr data[2];
     char region_name[32];
+    AppleCarveout carveout = { 0 };
 
     g_assert_cmphex(size, !=, 0);
 
@@ -107,6 +347,12 @@ hwaddr carveout_alloc_mem(CarveoutAllocator *ca, hwaddr size)
     snprintf(region_name, sizeof(region_name), "region-id-%d", ca->cur_id);
     dtb_set_prop(ca->node, region_name, sizeof(data), data);
 
+    g_strlcpy(carveout.name, name, sizeof(carveout.name));
+    carveout.base = ca->end;
+    carveout.size = size;
+    carveout.flags = flags;
+    g_array_append_val(apple_carveouts, carveout);
+
     ca->cur_id += 1;
     if (ca->cur_id == 55) { // This is an iBoot profiler region. SKIP!
         ca->cur_id += 1;
@@ -125,3 +371,124 @@ hwaddr carveout_alloc_finalise(CarveoutAllocator *ca)
 
     return ret;
 }
+
+void carveout_discard_all(void)
+{
+    guint i;
+
+    if (apple_carveouts == NULL) {
+        return;
+    }
+
+    for (i = 0; i < apple_carveouts->len; i++) {
+        AppleCarveout *c = &g_array_index(apple_carveouts, AppleCarveout, i);
+
+        if (c->flags & CARVEOUT_DISCARDABLE) {
+            carveout_discard(c->base, c->size);
+        }
+    }
+}
+
+typedef struct {
+    MemoryRegion *mr;
+    hwaddr addr;
+    hwaddr offset;
+    hwaddr size;
+    // NULL when the range is all zeroes.
+    uint8_t *data;
+} AppleBootImageRange;
+
+struct AppleBootImage {
+    GBytes *key;
+    GArray *ranges;
+};
+
+AppleBootImage *apple_boot_image_new(GBytes *key)
+{
+    AppleBootImage *image = g_new0(AppleBootImage, 1);
+
+    image->key = g_bytes_ref(key);
+    image->ranges = g_array_new(false, true, sizeof(AppleBootImageRange));
+    return image;
+}
+
+void apple_boot_image_add(AppleBootImage *image, hwaddr addr, hwaddr size,
+                          bool zero)
+{
+    MemoryRegionSection section;
+    AppleBootImageRange range = { 0 };
+
+    g_assert_true(QEMU_IS_ALIGNED(addr | size, qemu_target_page_size()));
+
+    section = memory_region_find(get_system_memory(), addr, size);
+    g_assert_nonnull(section.mr);
+    g_assert_true(memory_region_is_ram(section.mr));
+    g_assert_cmphex(int128_get64(section.size), ==, size);
+
+    range.mr = section.mr;
+    range.addr = addr;
+    range.offset = section.offset_within_region;
+    range.size = size;
+    if (!zero) {
+        range.data = g_memdup2(memory_region_get_ram_ptr(range.mr) +
+                                   range.offset,
+                               size);
+    }
+
+    g_array_append_val(image->ranges, range);
+}
+
+/*
+ * Pages are compared instead of relying on dirty logging, which misses
+ * memory rewritten by loadvm or an incoming migration.
+ */
+bool apple_boot_image_restore(AppleBootImage *image, GBytes *key)
+{
+    AppleBootImageRange *range;
+    hwaddr page_size = qemu_target_page_size();
+    hwaddr off;
+    uint8_t *ptr;
+    guint i;
+
+    if (!g_bytes_equal(image->key, key)) {
+        return false;
+    }
+
+    for (i = 0; i < image->ranges->len; i++) {
+        range = &g_array_index(image->ranges, AppleBootImageRange, i);
+        ptr = memory_region_get_ram_ptr(range->mr) + range->offset;
+        // Write through the address space so translated code is dropped.
+        for (off = 0; off < range->size; off += page_size) {
+            if (range->data == NULL ?
+                    buffer_is_zero(ptr + off, page_size) :
+                    memcmp(ptr + off, range->data + off, page_size) == 0) {
+                continue;
+            }
+            if (range->data == NULL) {
+                address_space_set(&address_space_memory, range->addr + off, 0,
+                                  page_size, MEMTXATTRS_UNSPECIFIED);
+            } else {
+                address_space_write(&address_space_memory, range->addr + off,
+                                    MEMTXATTRS_UNSPECIFIED, range->data + off,
+                                    page_size);
+            }
+        }
+    }
+
+    return true;
+}
+
+void apple_boot_image_free(AppleBootImage *image)
+{
+    AppleBootImageRange *range;
+    guint i;
+
+    for (i = 0; i < image->ranges->len; i++) {
+        range = &g_array_index(image->ranges, AppleBootImageRange, i);
+        memory_region_unref(range->mr);
+        g_free(range->data);
+    }
+    g_array_free(image->ranges, true);
+    g_bytes_unref(image->key);
+    g_free(image);
+}
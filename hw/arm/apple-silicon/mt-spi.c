@@ -21,6 +21,7 @@
 #include "qemu/osdep.h"
 #include "hw/arm/apple-silicon/mt-spi.h"
 #include "hw/irq.h"
+#include "hw/misc/apple-silicon/pmgr.h"
 #include "hw/ssi/ssi.h"
 #include "migration/vmstate.h"
 #include "qemu/crc16.h"
@@ -58,6 +59,11 @@ struct AppleMTSPIState {
     uint8_t frame;
     QEMUTimer *timer;
     QEMUTimer *end_timer;
+    /// Cleared while the PMGR domain is off, the timers then hold their
+    /// time left here.
+    bool powered;
+    int64_t timer_left;
+    int64_t end_timer_left;
     int32_t x;
     int32_t y;
     int32_t prev_x;
@@ -302,6 +308,8 @@ static void apple_mt_spi_reset_unlocked(AppleMTSPIState *s, ResetType type)
 
     timer_del(s->timer);
     timer_del(s->end_timer);
+    s->timer_left = -1;
+    s->end_timer_left = -1;
 
     s->btn_state = 0;
     s->prev_btn_state = 0;
@@ -331,6 +339,7 @@ static void apple_mt_spi_reset_hold(Object *obj, ResetType type)
     s = APPLE_MT_SPI(obj);
 
     QEMU_LOCK_GUARD(&s->lock);
+    s->powered = true;
     apple_mt_spi_reset_unlocked(s, type);
 }
 
@@ -881,6 +890,11 @@ static void apple_mt_spi_mouse_event(void *opaque, int dx, int dy, int dz,
 
     QEMU_LOCK_GUARD(&s->lock);
 
+    // The controller does not report touches while it is powered down.
+    if (!s->powered) {
+        return;
+    }
+
     s->prev_x = s->x;
     s->prev_y = s->y;
     s->x = qemu_input_scale_axis(dx, INPUT_EVENT_ABS_MIN, INPUT_EVENT_ABS_MAX,
@@ -910,6 +924,31 @@ static void apple_mt_spi_mouse_event(void *opaque, int dx, int dy, int dz,
                                     NANOSECONDS_PER_SECOND / 20);
     }
 }
+
+static void apple_mt_spi_set_power(void *opaque, int n, int level)
+{
+    AppleMTSPIState *s;
+
+    s = APPLE_MT_SPI(opaque);
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    if (s->powered == !!level) {
+        return;
+    }
+    s->powered = level;
+
+    if (level) {
+        apple_pmgr_timer_resume(s->timer, s->timer_left);
+        apple_pmgr_timer_resume(s->end_timer, s->end_timer_left);
+        s->timer_left = -1;
+        s->end_timer_left = -1;
+    } else {
+        s->timer_left = apple_pmgr_timer_pause(s->timer);
+        s->end_timer_left = apple_pmgr_timer_pause(s->end_timer);
+    }
+}
+
 static void apple_mt_spi_realize(SSIPeripheral *dev, Error **errp)
 {
     AppleMTSPIState *s;
@@ -950,6 +989,27 @@ static const VMStateDescription vmstate_apple_mt_spi_ll_packet = {
         },
 };
 
+static bool apple_mt_spi_power_needed(void *opaque)
+{
+    AppleMTSPIState *s = opaque;
+
+    return !s->powered;
+}
+
+static const VMStateDescription vmstate_apple_mt_spi_power = {
+    .name = "AppleMTSPIState/power",
+    .version_id = 0,
+    .minimum_version_id = 0,
+    .needed = apple_mt_spi_power_needed,
+    .fields =
+        (const VMStateField[]){
+            VMSTATE_BOOL(powered, AppleMTSPIState),
+            VMSTATE_INT64(timer_left, AppleMTSPIState),
+            VMSTATE_INT64(end_timer_left, AppleMTSPIState),
+            VMSTATE_END_OF_LIST(),
+        },
+};
+
 static const VMStateDescription vmstate_apple_mt_spi = {
     .name = "AppleMTSPIState",
     .version_id = 0,
@@ -978,6 +1038,11 @@ static const VMStateDescription vmstate_apple_mt_spi = {
             VMSTATE_INT32(prev_btn_state, AppleMTSPIState),
             VMSTATE_END_OF_LIST(),
         },
+    .subsections =
+        (const VMStateDescription *const[]){
+            &vmstate_apple_mt_spi_power,
+            NULL,
+        },
 };
 
 static void apple_mt_spi_class_init(ObjectClass *klass, void *data)
@@ -1003,8 +1068,11 @@ static void apple_mt_instance_init(Object *obj)
     s = APPLE_MT_SPI(obj);
 
     qdev_init_gpio_out_named(DEVICE(s), &s->irq, APPLE_MT_SPI_IRQ, 1);
+    qdev_init_gpio_in_named(DEVICE(s), apple_mt_spi_set_power,
+                            APPLE_PMGR_POWER, 1);
     s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, touch_timer_tick, s);
     s->end_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, touch_end_timer_tick, s);
+    s->powered = true;
 
     QTAILQ_INIT(&s->pending_fw);
 
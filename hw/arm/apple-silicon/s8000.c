@@ -535,6 +535,7 @@ static void pmgr_reg_write(void *opaque, hwaddr addr, uint64_t data,
         break;
     }
     memcpy(s8000_machine->pmgr_reg + addr, &value, size);
+    apple_pmgr_ps_write(s8000_machine->pmgr, addr, value);
 }
 
 static uint64_t pmgr_reg_read(void *opaque, hwaddr addr, unsigned size)
@@ -610,6 +611,9 @@ static void s8000_create_aic(S8000MachineState *s8000_machine)
                               OBJECT(s8000_machine->aic));
     g_assert_nonnull(s8000_machine->aic);
     sysbus_realize(s8000_machine->aic, &error_fatal);
+    apple_pmgr_connect(
+        s8000_machine->pmgr, child,
+        qdev_get_gpio_in_named(DEVICE(s8000_machine->aic), APPLE_PMGR_POWER, 0));
 
     prop = dtb_find_prop(child, "reg");
     g_assert_nonnull(prop);
@@ -634,10 +638,16 @@ static void s8000_pmgr_setup(S8000MachineState *s8000_machine)
     char name[32];
     DTBProp *prop;
     DTBNode *child;
+    SysBusDevice *sbd;
 
     child = dtb_get_node(s8000_machine->device_tree, "arm-io/pmgr");
     g_assert_nonnull(child);
 
+    sbd = apple_pmgr_create(child);
+    object_property_add_child(OBJECT(s8000_machine), "pmgr", OBJECT(sbd));
+    sysbus_realize_and_unref(sbd, &error_fatal);
+    s8000_machine->pmgr = APPLE_PMGR(sbd);
+
     prop = dtb_find_prop(child, "reg");
     g_assert_nonnull(prop);
 
@@ -1211,6 +1221,9 @@ static void s8000_display_create(S8000MachineState *s8000_machine)
                                s8000_machine->sys_mem,
                                s8000_machine->video_args.base_addr);
     object_property_add_child(OBJECT(s8000_machine), "disp0", OBJECT(sbd));
+    apple_pmgr_connect(
+        s8000_machine->pmgr, child,
+        qdev_get_gpio_in_named(DEVICE(sbd), APPLE_PMGR_POWER, 0));
 
     sysbus_realize_and_unref(sbd, &error_fatal);
 }
@@ -1314,8 +1327,8 @@ static void s8000_machine_init(MachineState *machine)
     s8000_machine->sys_mem = get_system_memory();
     allocate_ram(s8000_machine->sys_mem, "SRAM", S8000_SRAM_BASE,
                  S8000_SRAM_SIZE, 0);
-    allocate_ram(s8000_machine->sys_mem, "DRAM", S8000_DRAM_BASE,
-                 S8000_DRAM_SIZE, 0);
+    apple_mem_map_ram(s8000_machine->sys_mem, "DRAM", S8000_DRAM_BASE,
+                      machine->ram, 0);
     allocate_ram(s8000_machine->sys_mem, "SEPROM", S8000_SEPROM_BASE,
                  S8000_SEPROM_SIZE, 0);
     MemoryRegion *mr = g_new0(MemoryRegion, 1);
@@ -1404,9 +1417,9 @@ static void s8000_machine_init(MachineState *machine)
     dtb_set_prop_u32(child, "device-color-policy", 0);
 
     s8000_cpu_setup(s8000_machine);
+    s8000_pmgr_setup(s8000_machine);
     s8000_create_aic(s8000_machine);
     s8000_create_s3c_uart(s8000_machine, serial_hd(0));
-    s8000_pmgr_setup(s8000_machine);
     s8000_create_dart(s8000_machine, "dart-disp0", false);
     s8000_create_dart(s8000_machine, "dart-apcie0", true);
     s8000_create_dart(s8000_machine, "dart-apcie1", true);
@@ -1626,6 +1639,8 @@ static void s8000_machine_class_init(ObjectClass *klass, void *data)
     mc->minimum_page_bits = 14;
     mc->default_ram_size = S8000_DRAM_SIZE;
     mc->fixup_ram_size = s8000_machine_fixup_ram_size;
+    // DRAM used to be allocated as "DRAM", keep its RAMBlock id.
+    mc->default_ram_id = "DRAM";
 
     object_class_property_add_str(klass, "trustcache",
                                   s8000_get_trustcache_filename,
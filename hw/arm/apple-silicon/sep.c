@@ -39,8 +39,13 @@
 #include "hw/qdev-properties.h"
 #include "hw/resettable.h"
 #include "qapi/error.h"
+#include "qapi/qapi-builtin-visit.h"
+#include "qapi/visitor.h"
+#include "qemu/bitmap.h"
 #include "qemu/cutils.h"
+#include "qemu/error-report.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/units.h"
 #include "qom/object.h"
 #include "nettle/ccm.h"
@@ -233,6 +238,60 @@ static void drbg_ctr_aes256_update(struct aes256_ctx *key,
     block16_set(V, &tmp[2]);
 }
 
+static QCryptoCipher *apple_sep_cipher_get(AppleSEPCipherCache *cache,
+                                           QCryptoCipherAlgo alg,
+                                           QCryptoCipherMode mode,
+                                           const uint8_t *key, size_t key_len)
+{
+    AppleSEPCipherCacheEntry *e;
+    AppleSEPCipherCacheEntry *victim = &cache->entries[0];
+    uint8_t iv[AES_BLOCK_SIZE] = { 0 };
+    int i;
+
+    g_assert_cmpuint(key_len, <=, sizeof(victim->key));
+
+    for (i = 0; i < SEP_CIPHER_CACHE_SIZE; i++) {
+        e = &cache->entries[i];
+        if (e->cipher != NULL && e->alg == alg && e->mode == mode &&
+            e->key_len == key_len && memcmp(e->key, key, key_len) == 0) {
+            goto found;
+        }
+        if (e->cipher == NULL ||
+            (victim->cipher != NULL && e->last_use < victim->last_use)) {
+            victim = e;
+        }
+    }
+
+    e = victim;
+    qcrypto_cipher_free(e->cipher);
+    e->cipher = qcrypto_cipher_new(alg, mode, key, key_len, &error_abort);
+    g_assert_nonnull(e->cipher);
+    e->alg = alg;
+    e->mode = mode;
+    e->key_len = key_len;
+    memcpy(e->key, key, key_len);
+
+found:
+    e->last_use = ++cache->clock;
+    // Callers expect the zero IV of a freshly created context.
+    if (mode != QCRYPTO_CIPHER_MODE_ECB) {
+        qcrypto_cipher_setiv(e->cipher, iv,
+                             qcrypto_cipher_get_iv_len(alg, mode),
+                             &error_abort);
+    }
+    return e->cipher;
+}
+
+static void apple_sep_cipher_flush(AppleSEPCipherCache *cache)
+{
+    int i;
+
+    for (i = 0; i < SEP_CIPHER_CACHE_SIZE; i++) {
+        qcrypto_cipher_free(cache->entries[i].cipher);
+    }
+    memset(cache, 0, sizeof(*cache));
+}
+
 static const char *
 sepos_return_module_thread_string_t8015(uint64_t module_thread_id)
 {
@@ -431,7 +490,7 @@ static const char *sepos_return_module_thread_string(uint32_t chip_id,
 static void debug_trace_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                   unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint32_t offset = 0;
     if (size == 1) {
         // iOS 15 SEPFW workaround against a brief logspam
@@ -811,7 +870,7 @@ static void debug_trace_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t debug_trace_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -899,23 +958,39 @@ static const MemoryRegionOps debug_trace_reg_ops = {
 #define REG_TRNG_COUNTER_LOW (0x68)
 #define REG_TRNG_COUNTER_HI (0x6c)
 
+static void trng_pool_refill(void *opaque)
+{
+    AppleTRNGState *s = opaque;
+
+    qcrypto_random_bytes(s->pool + s->pool_avail,
+                         sizeof(s->pool) - s->pool_avail, NULL);
+    s->pool_avail = sizeof(s->pool);
+}
+
+static void trng_pool_read(AppleTRNGState *s, uint8_t *buf, size_t len)
+{
+    if (s->pool_avail < len) {
+        trng_pool_refill(s);
+    }
+    s->pool_avail -= len;
+    memcpy(buf, s->pool + s->pool_avail, len);
+    if (s->pool_avail < sizeof(s->pool) / 2) {
+        qemu_bh_schedule(s->pool_bh);
+    }
+}
+
 static void trng_regs_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                 unsigned size)
 {
-    MachineState *machine = MACHINE(qdev_get_machine());
-    AppleSEPState *sep;
-    AppleTRNGState *s;
+    AppleTRNGState *s = opaque;
+    AppleSEPState *sep = s->sep;
+    AppleA7IOP *a7iop = APPLE_A7IOP(sep);
     uint32_t enabled;
 
-    sep = APPLE_SEP(
-        object_property_get_link(OBJECT(machine), "sep", &error_fatal));
-    AppleA7IOP *a7iop = APPLE_A7IOP(sep);
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(sep->cpu), stderr, CPU_DUMP_CODE);
 #endif
 
-    s = (AppleTRNGState *)opaque;
-
 #if 0
     DPRINTF(
                   "TRNG_REGS: Write at 0x" HWADDR_FMT_plx
@@ -933,19 +1008,18 @@ static void trng_regs_reg_write(void *opaque, hwaddr addr, uint64_t data,
             ((s->offset_0x70 & 0x40) != 0)) {
             QCryptoCipher *cipher;
 
-            cipher = qcrypto_cipher_new(QCRYPTO_CIPHER_ALGO_AES_256,
-                                        QCRYPTO_CIPHER_MODE_ECB, s->key,
-                                        sizeof(s->key), &error_abort);
-            g_assert_nonnull(cipher);
+            cipher = apple_sep_cipher_get(&s->ciphers,
+                                          QCRYPTO_CIPHER_ALGO_AES_256,
+                                          QCRYPTO_CIPHER_MODE_ECB, s->key,
+                                          sizeof(s->key));
             qcrypto_cipher_encrypt(cipher, s->fifo, s->fifo, sizeof(s->fifo),
                                    &error_abort);
-            qcrypto_cipher_free(cipher);
         }
         break;
     case REG_TRNG_STATUS:
         enabled = (s->config & TRNG_CONTROL_ENABLED) != 0;
         if ((data & TRNG_STATUS_READY) != 0 && (s->offset_0x70 & 0xC0) == 0) {
-            qcrypto_random_bytes(s->fifo, sizeof(s->fifo), NULL);
+            trng_pool_read(s, s->fifo, sizeof(s->fifo));
         }
         break;
     case REG_TRNG_CONTROL: {
@@ -966,7 +1040,10 @@ static void trng_regs_reg_write(void *opaque, hwaddr addr, uint64_t data,
         if ((s->offset_0x70 & 0xc0) != 0) {
             data = bswap32(data);
         }
-        memcpy(s->key + (addr - REG_TRNG_AES_KEY_BASE), &data, size);
+        if (memcmp(s->key + (addr - REG_TRNG_AES_KEY_BASE), &data, size)) {
+            memcpy(s->key + (addr - REG_TRNG_AES_KEY_BASE), &data, size);
+            apple_sep_cipher_flush(&s->ciphers);
+        }
         break;
     case REG_TRNG_ECID_LOW:
         if ((s->offset_0x70 & 0x80) != 0) {
@@ -1017,6 +1094,7 @@ static void trng_regs_reg_write(void *opaque, hwaddr addr, uint64_t data,
             s->ctr_drbg_init = 1;
         } else if ((s->offset_0x70 & 0x40) == 0) {
             memset(s->key, 0, sizeof(s->key));
+            apple_sep_cipher_flush(&s->ciphers);
         }
         // don't do the encryption here
         break;
@@ -1033,20 +1111,15 @@ static void trng_regs_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t trng_regs_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    MachineState *machine = MACHINE(qdev_get_machine());
-    AppleSEPState *sep;
-    AppleTRNGState *s;
+    AppleTRNGState *s = opaque;
+    AppleSEPState *sep = s->sep;
+    AppleA7IOP *a7iop = APPLE_A7IOP(sep);
     uint64_t ret = 0;
 
-    sep = APPLE_SEP(
-        object_property_get_link(OBJECT(machine), "sep", &error_fatal));
-    AppleA7IOP *a7iop = APPLE_A7IOP(sep);
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(sep->cpu), stderr, CPU_DUMP_CODE);
 #endif
 
-    s = (AppleTRNGState *)opaque;
-
     uint32_t enabled = (s->config & TRNG_CONTROL_ENABLED) != 0;
     switch (addr) {
     case REG_TRNG_FIFO_OUTPUT_BASE ... REG_TRNG_FIFO_OUTPUT_END:
@@ -1147,7 +1220,7 @@ const char *sepos_powerstate_name(uint64_t powerstate_offset)
 static void pmgr_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                 unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(s->cpu), stderr, CPU_DUMP_CODE);
@@ -1215,9 +1288,11 @@ static void pmgr_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
         // the resulting values should only reset on SoC reset
         if ((data & 1) != 0) {
             s->pmgr_fuse_changer_bit0_was_set = true;
+            qemu_irq_raise(s->fuse_changer[0]);
         }
         if ((data & 2) != 0) {
             s->pmgr_fuse_changer_bit1_was_set = true;
+            qemu_irq_raise(s->fuse_changer[1]);
         }
         DPRINTF("SEP PMGR_BASE: fuse change write at 0x" HWADDR_FMT_plx
                 " with value 0x%" PRIx64 "\n",
@@ -1238,7 +1313,7 @@ static void pmgr_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t pmgr_base_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -1293,7 +1368,7 @@ static const MemoryRegionOps pmgr_base_reg_ops = {
 static void key_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(s->cpu), stderr, CPU_DUMP_CODE);
@@ -1338,7 +1413,7 @@ static void key_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t key_base_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -1371,7 +1446,7 @@ static const MemoryRegionOps key_base_reg_ops = {
 static void key_fcfg_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     AppleA7IOP *a7iop = APPLE_A7IOP(s);
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -1463,7 +1538,7 @@ static void key_fcfg_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t key_fcfg_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
     uint8_t key_fcfg_offset_0x14_index = 0;
     uint8_t key_fcfg_offset_0x14_index_limit = 0;
@@ -1523,7 +1598,7 @@ static const MemoryRegionOps key_fcfg_reg_ops = {
 static void moni_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                 unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(s->cpu), stderr, CPU_DUMP_CODE);
@@ -1541,7 +1616,7 @@ static void moni_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t moni_base_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -1574,7 +1649,7 @@ static const MemoryRegionOps moni_base_reg_ops = {
 static void moni_thrm_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                 unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(s->cpu), stderr, CPU_DUMP_CODE);
@@ -1592,7 +1667,7 @@ static void moni_thrm_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t moni_thrm_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -1625,7 +1700,7 @@ static const MemoryRegionOps moni_thrm_reg_ops = {
 static void eisp_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                 unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(s->cpu), stderr, CPU_DUMP_CODE);
@@ -1643,7 +1718,7 @@ static void eisp_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t eisp_base_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -1682,7 +1757,7 @@ static const MemoryRegionOps eisp_base_reg_ops = {
 static void eisp_hmac_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                 unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(s->cpu), stderr, CPU_DUMP_CODE);
@@ -1700,7 +1775,7 @@ static void eisp_hmac_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t eisp_hmac_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -1758,9 +1833,8 @@ static void xor_32bit_value(uint8_t *dest, uint32_t val, int size)
 
 static void aess_raise_interrupt(AppleAESSState *s)
 {
-    MachineState *machine = MACHINE(qdev_get_machine());
-    AppleSEPState *sep = APPLE_SEP(
-        object_property_get_link(OBJECT(machine), "sep", &error_fatal));
+    AppleSEPState *sep = s->sep;
+
     // bit1==interrupts_enabled; bit0==interrupt_will_activate ?
     if ((s->interrupt_enabled & 0x3) == 0x3) {
         s->interrupt_status |= 0x1;
@@ -1808,12 +1882,8 @@ static void aess_keywrap_uid(AppleAESSState *s, uint8_t *in, uint8_t *out,
             s->reg_0x18_keydisable);
     HEXDUMP("aess_keywrap_uid: used_key", used_key, sizeof(used_key));
     HEXDUMP("aess_keywrap_uid: in", in, data_len);
-    cipher = qcrypto_cipher_new(cipher_alg, QCRYPTO_CIPHER_MODE_CBC, used_key,
-                                key_len, &error_abort);
-    g_assert_nonnull(cipher);
-    uint8_t iv[0x10] = { 0 };
-    memset(iv, 0x00, sizeof(iv));
-    qcrypto_cipher_setiv(cipher, iv, sizeof(iv), &error_abort);
+    cipher = apple_sep_cipher_get(&s->ciphers, cipher_alg,
+                                  QCRYPTO_CIPHER_MODE_CBC, used_key, key_len);
     uint8_t enc_temp[0x20] = { 0 };
     memcpy(enc_temp, in, sizeof(enc_temp));
 
@@ -1831,7 +1901,6 @@ static void aess_keywrap_uid(AppleAESSState *s, uint8_t *in, uint8_t *out,
     memcpy(out, enc_temp, data_len);
     HEXDUMP("aess_keywrap_uid: out1", out, data_len);
     s->reg_0x14_keywrap_iterations_counter = 0;
-    qcrypto_cipher_free(cipher);
     // only enabled by driver_ops 0x4/0x1d (keywrap) if
     // iterations_counter is over 10/0xa.
     aess_raise_interrupt(s);
@@ -1936,6 +2005,7 @@ static void aess_handle_cmd(AppleAESSState *s)
         {
             memset(s->key_256_in, 0, sizeof(s->key_256_in));
             memcpy(s->key_256_in, s->in_full, sizeof(s->in_full));
+            apple_sep_cipher_flush(&s->ciphers);
         }
     }
 #endif
@@ -2024,9 +2094,9 @@ static void aess_handle_cmd(AppleAESSState *s)
             }
         }
         QCryptoCipher *cipher;
-        cipher = qcrypto_cipher_new(cipher_alg, QCRYPTO_CIPHER_MODE_CBC,
-                                    used_key, key_len, &error_abort);
-        g_assert_nonnull(cipher);
+        cipher = apple_sep_cipher_get(&s->ciphers, cipher_alg,
+                                      QCRYPTO_CIPHER_MODE_CBC, used_key,
+                                      key_len);
         uint8_t iv[0x10] = { 0 };
         uint8_t in[0x10] = { 0 };
         if (do_encryption) {
@@ -2061,7 +2131,6 @@ static void aess_handle_cmd(AppleAESSState *s)
             qcrypto_cipher_decrypt(cipher, in, s->out, sizeof(in),
                                    &error_abort);
         }
-        qcrypto_cipher_free(cipher);
     }
 #endif
 #if 1
@@ -2124,6 +2193,7 @@ static void aess_handle_cmd(AppleAESSState *s)
             0x20 /
                 4); // unset (real zero-key) != zero-key set (not real zero-key)
         s->custom_key_index_enabled[custom_keywrap_index] = true;
+        apple_sep_cipher_flush(&s->ciphers);
         DPRINTF("SEP AESS_BASE: %s: sync/set key command 0x%02x "
                 "s->command 0x%02x\n",
                 __func__, normalized_cmd, s->command);
@@ -2162,11 +2232,8 @@ jump_return:
 static void aess_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                 unsigned size)
 {
-    MachineState *machine = MACHINE(qdev_get_machine());
-    AppleSEPState *sep = APPLE_SEP(
-        object_property_get_link(OBJECT(machine), "sep", &error_fatal));
-    AppleAESSState *s;
-    s = (AppleAESSState *)opaque;
+    AppleAESSState *s = opaque;
+    AppleSEPState *sep = s->sep;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     DPRINTF("\n");
@@ -2243,11 +2310,8 @@ static void aess_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t aess_base_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    MachineState *machine = MACHINE(qdev_get_machine());
-    AppleSEPState *sep = APPLE_SEP(
-        object_property_get_link(OBJECT(machine), "sep", &error_fatal));
-    AppleAESSState *s;
-    s = (AppleAESSState *)opaque;
+    AppleAESSState *s = opaque;
+    AppleSEPState *sep = s->sep;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -2331,7 +2395,7 @@ static const MemoryRegionOps aess_base_reg_ops = {
 static void aesh_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                 unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(s->cpu), stderr, CPU_DUMP_CODE);
@@ -2352,7 +2416,7 @@ static void aesh_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t aesh_base_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -2392,11 +2456,8 @@ static const MemoryRegionOps aesh_base_reg_ops = {
 static void pka_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                unsigned size)
 {
-    MachineState *machine = MACHINE(qdev_get_machine());
-    AppleSEPState *sep = APPLE_SEP(
-        object_property_get_link(OBJECT(machine), "sep", &error_fatal));
-    ApplePKAState *s;
-    s = (ApplePKAState *)opaque;
+    ApplePKAState *s = opaque;
+    AppleSEPState *sep = s->sep;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(sep->cpu), stderr, CPU_DUMP_CODE);
@@ -2482,11 +2543,8 @@ static void pka_base_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t pka_base_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    MachineState *machine = MACHINE(qdev_get_machine());
-    AppleSEPState *sep = APPLE_SEP(
-        object_property_get_link(OBJECT(machine), "sep", &error_fatal));
-    ApplePKAState *s;
-    s = (ApplePKAState *)opaque;
+    ApplePKAState *s = opaque;
+    AppleSEPState *sep = s->sep;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -2555,7 +2613,7 @@ static const MemoryRegionOps pka_base_reg_ops = {
 static void pka_tmm_reg_write(void *opaque, hwaddr addr, uint64_t data,
                               unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(s->cpu), stderr, CPU_DUMP_CODE);
@@ -2579,7 +2637,7 @@ static void pka_tmm_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t pka_tmm_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -2618,7 +2676,7 @@ static const MemoryRegionOps pka_tmm_reg_ops = {
 static void misc2_reg_write(void *opaque, hwaddr addr, uint64_t data,
                             unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(s->cpu), stderr, CPU_DUMP_CODE);
@@ -2637,7 +2695,7 @@ static void misc2_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t misc2_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -2671,7 +2729,7 @@ static const MemoryRegionOps misc2_reg_ops = {
 static void boot_monitor_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                    unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
 
 #ifdef ENABLE_CPU_DUMP_STATE
     cpu_dump_state(CPU(s->cpu), stderr, CPU_DUMP_CODE);
@@ -2707,7 +2765,7 @@ static void boot_monitor_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t boot_monitor_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -2966,7 +3024,7 @@ static void apple_sep_send_message(AppleSEPState *s, uint8_t ep, uint8_t tag,
 static void progress_reg_write(void *opaque, hwaddr addr, uint64_t data,
                                unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     SEPMessage sep_msg = { 0 };
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -3205,7 +3263,7 @@ static void progress_reg_write(void *opaque, hwaddr addr, uint64_t data,
 
 static uint64_t progress_reg_read(void *opaque, hwaddr addr, unsigned size)
 {
-    AppleSEPState *s = APPLE_SEP(opaque);
+    AppleSEPState *s = opaque;
     uint64_t ret = 0;
 
 #ifdef ENABLE_CPU_DUMP_STATE
@@ -3356,6 +3414,11 @@ AppleSEPState *apple_sep_create(DTBNode *node, MemoryRegion *ool_mr, vaddr base,
 
     // AKF_MBOX reg is handled using the device tree
     // XPRT_{PMSC,FUSE,MISC} regs are handled in t8030.c
+    qdev_init_gpio_out_named(dev, s->fuse_changer, APPLE_SEP_FUSE_CHANGER,
+                             APPLE_SEP_FUSE_CHANGER_COUNT);
+    s->trng_state.sep = s;
+    s->aess_state.sep = s;
+    s->pka_state.sep = s;
     memory_region_init_io(&s->pmgr_base_mr, OBJECT(dev), &pmgr_base_reg_ops, s,
                           "sep.pmgr_base", PMGR_BASE_REG_SIZE); // T8030
     sysbus_init_mmio(sbd, &s->pmgr_base_mr);
@@ -3503,6 +3566,62 @@ static void apple_sep_cpu_reset_work(CPUState *cpu, run_on_cpu_data data)
     cpu_set_pc(cpu, s->base);
 }
 
+static void apple_sep_set_host_cpus(Object *obj, Visitor *v, const char *name,
+                                    void *opaque, Error **errp)
+{
+    AppleSEPState *s = APPLE_SEP(obj);
+    uint16List *l, *host_cpus = NULL;
+
+    if (!visit_type_uint16List(v, name, &host_cpus, errp)) {
+        return;
+    }
+
+    if (host_cpus == NULL) {
+        error_setg(errp, "CPU list is empty");
+        return;
+    }
+
+    g_free(s->host_cpus);
+    s->host_cpus_nbits = 0;
+    for (l = host_cpus; l; l = l->next) {
+        s->host_cpus_nbits = MAX(s->host_cpus_nbits, l->value + 1);
+    }
+    s->host_cpus = bitmap_new(s->host_cpus_nbits);
+    for (l = host_cpus; l; l = l->next) {
+        set_bit(l->value, s->host_cpus);
+    }
+    qapi_free_uint16List(host_cpus);
+}
+
+static void apple_sep_pin_cpu(AppleSEPState *s)
+{
+    int ret;
+
+    if (s->host_cpus == NULL) {
+        return;
+    }
+
+    // Without MTTCG the SEP shares one thread with the AP cores.
+    if (!qemu_tcg_mttcg_enabled()) {
+        warn_report("SEP: host-cpus needs multi-threaded TCG, ignoring it");
+        return;
+    }
+
+    ret = qemu_thread_set_affinity(CPU(s->cpu)->thread, s->host_cpus,
+                                   s->host_cpus_nbits);
+    if (ret) {
+        warn_report("SEP: setting the host CPU affinity failed: %s",
+                    strerror(ret));
+    }
+}
+
+static void apple_sep_cpu_el_change(ARMCPU *cpu, void *opaque)
+{
+    AppleSEPState *s = opaque;
+
+    apple_a7iop_mailbox_poll_cpu_resumed(APPLE_A7IOP(s)->iop_mailbox);
+}
+
 static void apple_sep_realize(DeviceState *dev, Error **errp)
 {
     AppleSEPState *s;
@@ -3514,6 +3633,13 @@ static void apple_sep_realize(DeviceState *dev, Error **errp)
         sc->parent_realize(dev, errp);
     }
     qdev_realize(DEVICE(s->cpu), NULL, errp);
+    apple_sep_pin_cpu(s);
+    if (s->mailbox_poll_halt) {
+        apple_a7iop_mailbox_set_poll_cpu(APPLE_A7IOP(s)->iop_mailbox,
+                                         CPU(s->cpu));
+        arm_register_el_change_hook(s->cpu, apple_sep_cpu_el_change, s);
+    }
+    s->trng_state.pool_bh = qemu_bh_new(trng_pool_refill, &s->trng_state);
     s->irq_or = qdev_new(TYPE_OR_IRQ);
     object_property_add_child(OBJECT(dev), "irq-or", OBJECT(s->irq_or));
     qdev_prop_set_uint16(s->irq_or, "num-lines", 16);
@@ -3549,6 +3675,7 @@ static void aess_reset(AppleAESSState *s)
     memset(s->keywrap_key_uid1, 0, sizeof(s->keywrap_key_uid1));
     memset(s->custom_key_index, 0, sizeof(s->custom_key_index));
     memset(s->custom_key_index_enabled, 0, sizeof(s->custom_key_index_enabled));
+    apple_sep_cipher_flush(&s->ciphers);
 }
 
 static void pka_reset(ApplePKAState *s)
@@ -3600,6 +3727,8 @@ static void apple_sep_reset_hold(Object *obj, ResetType type)
            sizeof(s->key_fcfg_offset_0x14_values));
     s->pmgr_fuse_changer_bit0_was_set = false;
     s->pmgr_fuse_changer_bit1_was_set = false;
+    qemu_irq_lower(s->fuse_changer[0]);
+    qemu_irq_lower(s->fuse_changer[1]);
     memset(s->pmgr_base_regs, 0, sizeof(s->pmgr_base_regs));
     memset(s->key_base_regs, 0, sizeof(s->key_base_regs));
     memset(s->key_fcfg_regs, 0, sizeof(s->key_fcfg_regs));
@@ -3616,6 +3745,7 @@ static void apple_sep_reset_hold(Object *obj, ResetType type)
     memset(s->progress_regs, 0, sizeof(s->progress_regs));
     memset(s->debug_trace_regs, 0, sizeof(s->debug_trace_regs));
 
+    apple_sep_cipher_flush(&s->trng_state.ciphers);
     aess_reset(&s->aess_state);
     pka_reset(&s->pka_state);
     // apple_ssc_reset is being called, but not here.
@@ -3623,6 +3753,11 @@ static void apple_sep_reset_hold(Object *obj, ResetType type)
     map_sepfw(s);
 }
 
+static const Property apple_sep_props[] = {
+    DEFINE_PROP_BOOL("mailbox-poll-halt", AppleSEPState, mailbox_poll_halt,
+                     false),
+};
+
 static void apple_sep_class_init(ObjectClass *klass, void *data)
 {
     ResettableClass *rc = RESETTABLE_CLASS(klass);
@@ -3632,7 +3767,13 @@ static void apple_sep_class_init(ObjectClass *klass, void *data)
     resettable_class_set_parent_phases(rc, NULL, apple_sep_reset_hold, NULL,
                                        &sc->parent_phases);
     dc->desc = "Apple SEP";
+    device_class_set_props(dc, apple_sep_props);
     set_bit(DEVICE_CATEGORY_MISC, dc->categories);
+
+    object_class_property_add(klass, "host-cpus", "int", NULL,
+                              apple_sep_set_host_cpus, NULL, NULL);
+    object_class_property_set_description(
+        klass, "host-cpus", "Host CPUs to pin the SEP vCPU thread to");
 }
 
 static const TypeInfo apple_sep_info = {
@@ -3845,14 +3986,12 @@ static int kbkdf_generate_key(uint8_t *cmac_key, uint8_t *label,
     return 0;
 }
 
-static int generate_ec_priv(const char *priv, struct ecc_scalar *ecc_key,
-                            struct ecc_point *ecc_pub)
+static void set_ec_priv(const char *priv, struct ecc_scalar *ecc_key)
 {
     // TODO: use fully random value if priv == NULL
     const struct ecc_curve *ecc = nettle_get_secp_384r1();
     mpz_t temp1;
 
-    ecc_point_init(ecc_pub, ecc);
     ecc_scalar_init(ecc_key, ecc);
 
     mpz_init(temp1);
@@ -3860,6 +3999,15 @@ static int generate_ec_priv(const char *priv, struct ecc_scalar *ecc_key,
     mpz_add_ui(temp1, temp1, 1);
     g_assert_cmpuint(ecc_scalar_set(ecc_key, temp1), !=, 0);
     mpz_clear(temp1);
+}
+
+static int generate_ec_priv(const char *priv, struct ecc_scalar *ecc_key,
+                            struct ecc_point *ecc_pub)
+{
+    const struct ecc_curve *ecc = nettle_get_secp_384r1();
+
+    ecc_point_init(ecc_pub, ecc);
+    set_ec_priv(priv, ecc_key);
 
     ecc_point_mul_g(ecc_pub, ecc_key);
 
@@ -3906,12 +4054,32 @@ static int input_ec_pub(struct ecc_point *ecc_pub, uint8_t *pub_xy)
     return ret;
 }
 
+// The private keys are fixed per slot, so each public key is derived once.
+static void ssc_ec_keypair(const char *priv, struct ecc_scalar *ecc_key,
+                           AppleSSCKeyCache *cache, uint8_t *pub_xy)
+{
+    struct ecc_point ecc_pub;
+
+    if (cache->priv[0] != '\0' && strcmp(cache->priv, priv) == 0) {
+        set_ec_priv(priv, ecc_key);
+    } else {
+        generate_ec_priv(priv, ecc_key, &ecc_pub);
+        memset(cache, 0, sizeof(*cache));
+        output_ec_pub(&ecc_pub, cache->pub_xy);
+        ecc_point_clear(&ecc_pub);
+        g_strlcpy(cache->priv, priv, sizeof(cache->priv));
+    }
+    memcpy(pub_xy, cache->pub_xy, sizeof(cache->pub_xy));
+}
+
 static int generate_kbkdf_keys(struct AppleSSCState *ssc_state,
                                struct ecc_scalar *ecc_key,
                                struct ecc_point *ecc_pub_peer,
-                               uint8_t *hmac_key, uint8_t *label,
-                               uint8_t *context, uint8_t kbkdf_index)
+                               const uint8_t *peer_xy, uint8_t *hmac_key,
+                               uint8_t *label, uint8_t *context,
+                               uint8_t kbkdf_index)
 {
+    AppleSSCKeyCache *cache = &ssc_state->key_cache[kbkdf_index];
     const struct ecc_curve *ecc = nettle_get_secp_384r1();
     struct ecc_point T;
     // shared_key == pub_x (first half)
@@ -3922,11 +4090,20 @@ static int generate_kbkdf_keys(struct AppleSSCState *ssc_state,
             context[0x01], context[0x02],
             context[0x03]); // 4 bytes
 
-    ecc_point_init(&T, ecc);
-    ecc_point_mul(&T, ecc_key, ecc_pub_peer);
-    DPRINTF("generate_kbkdf_keys: shared_key==pub_x:\n");
-    output_ec_pub(&T, shared_key_xy);
-    ecc_point_clear(&T);
+    // Repeated sessions with the same peer key share the ECDH result.
+    if (cache->shared_valid &&
+        memcmp(cache->peer_xy, peer_xy, sizeof(cache->peer_xy)) == 0) {
+        memcpy(shared_key_xy, cache->shared_x, sizeof(cache->shared_x));
+    } else {
+        ecc_point_init(&T, ecc);
+        ecc_point_mul(&T, ecc_key, ecc_pub_peer);
+        DPRINTF("generate_kbkdf_keys: shared_key==pub_x:\n");
+        output_ec_pub(&T, shared_key_xy);
+        ecc_point_clear(&T);
+        memcpy(cache->peer_xy, peer_xy, sizeof(cache->peer_xy));
+        memcpy(cache->shared_x, shared_key_xy, sizeof(cache->shared_x));
+        cache->shared_valid = true;
+    }
 
     struct hmac_sha256_ctx ctx;
     hmac_sha256_set_key(&ctx, SHA256_DIGEST_SIZE, hmac_key);
@@ -4013,7 +4190,7 @@ static int answer_cmd_0x0_init1(struct AppleSSCState *ssc_state,
                                 uint8_t *request, uint8_t *response)
 {
     DPRINTF("%s: entered function\n", __func__);
-    struct ecc_point cmd0_ecpub, ecc_pub;
+    struct ecc_point cmd0_ecpub;
     struct knuth_lfib_ctx rctx;
     struct dsa_signature signature;
     uint8_t digest[BYTELEN_384] = { 0 };
@@ -4045,17 +4222,17 @@ static int answer_cmd_0x0_init1(struct AppleSSCState *ssc_state,
     // TODO: use priv_str = NULL here after the function has been reworked
     // TODO: ASAN might show a (spurious?) __gmp_default_allocate leak here.
     // already fixed?
-    int err =
-        generate_ec_priv(priv_str, &ssc_state->ecc_keys[kbkdf_index], &ecc_pub);
-    output_ec_pub(&ecc_pub,
-                  &response[MSG_PREFIX_LENGTH + SECP384_PUBLIC_XY_SIZE]);
-    ecc_point_clear(&ecc_pub);
+    ssc_ec_keypair(priv_str, &ssc_state->ecc_keys[kbkdf_index],
+                   &ssc_state->key_cache[kbkdf_index],
+                   &response[MSG_PREFIX_LENGTH + SECP384_PUBLIC_XY_SIZE]);
     memcpy(ssc_state->random_hmac_key, &request[MSG_PREFIX_LENGTH],
            SHA256_DIGEST_SIZE);
     DPRINTF("INFOSTR_AKE_SESSIONSEED: %s\n", INFOSTR_AKE_SESSIONSEED);
     generate_kbkdf_keys(ssc_state, &ssc_state->ecc_keys[kbkdf_index],
-                        &cmd0_ecpub, ssc_state->random_hmac_key,
-                        INFOSTR_AKE_SESSIONSEED, request, kbkdf_index);
+                        &cmd0_ecpub,
+                        &request[MSG_PREFIX_LENGTH + SHA256_DIGEST_SIZE],
+                        ssc_state->random_hmac_key, INFOSTR_AKE_SESSIONSEED,
+                        request, kbkdf_index);
 
     struct sha384_ctx ctx;
     sha384_init(&ctx);
@@ -4090,9 +4267,10 @@ static int answer_cmd_0x1_connect_sp(struct AppleSSCState *ssc_state,
 {
     DPRINTF("%s: entered function\n", __func__);
     HEXDUMP("cmd_0x01_req", request, SSC_REQUEST_SIZE_CMD_0x1);
-    struct ecc_point cmd1_ecpub, ecc_pub;
+    struct ecc_point cmd1_ecpub;
     uint8_t kbkdf_index = request[1];
     char priv_str[0x60 + 1] = { 0 };
+    uint8_t public_xy[SECP384_PUBLIC_XY_SIZE] = { 0 };
 
     uint8_t *cmac_req_should = &request[MSG_PREFIX_LENGTH];
     uint8_t *sw_public_xy2 = &request[MSG_PREFIX_LENGTH + AES_BLOCK_SIZE];
@@ -4126,8 +4304,8 @@ static int answer_cmd_0x1_connect_sp(struct AppleSSCState *ssc_state,
         "9999999999999999999999999999%02x",
         kbkdf_index);
     // TODO: use priv_str = NULL here after the function has been reworked
-    int err =
-        generate_ec_priv(priv_str, &ssc_state->ecc_keys[kbkdf_index], &ecc_pub);
+    ssc_ec_keypair(priv_str, &ssc_state->ecc_keys[kbkdf_index],
+                   &ssc_state->key_cache[kbkdf_index], public_xy);
     uint8_t aes_key_mackey_req[0x20] = { 0 };
     uint8_t aes_key_extractorkey_req[0x20] = { 0 };
     aes_keys_from_sp_key(ssc_state, kbkdf_index, request, aes_key_mackey_req,
@@ -4144,12 +4322,13 @@ static int answer_cmd_0x1_connect_sp(struct AppleSSCState *ssc_state,
     if (memcmp(cmac_req_should, cmac_req_is, sizeof(cmac_req_is)) != 0) {
         DPRINTF("%s: invalid CMAC\n", __func__);
         do_response_prefix(request, response, SSC_RESPONSE_FLAG_CMAC_INVALID);
-        goto jump_ret0;
+        goto jump_ret1;
     }
     do_response_prefix(request, response, SSC_RESPONSE_FLAG_OK);
-    output_ec_pub(&ecc_pub, &response[MSG_PREFIX_LENGTH + AES_BLOCK_SIZE]);
+    memcpy(&response[MSG_PREFIX_LENGTH + AES_BLOCK_SIZE], public_xy,
+           sizeof(public_xy));
     generate_kbkdf_keys(ssc_state, &ssc_state->ecc_keys[kbkdf_index],
-                        &cmd1_ecpub, aes_key_extractorkey_req,
+                        &cmd1_ecpub, sw_public_xy2, aes_key_extractorkey_req,
                         INFOSTR_AKE_SESSIONSEED, request, kbkdf_index);
 
     uint8_t *cmac_resp = &response[MSG_PREFIX_LENGTH];
@@ -4158,8 +4337,6 @@ static int answer_cmd_0x1_connect_sp(struct AppleSSCState *ssc_state,
                                   public_xy2, cmac_resp);
 
     HEXDUMP("cmd_0x01_resp", response, SSC_RESPONSE_SIZE_CMD_0x1);
-jump_ret0:
-    ecc_point_clear(&ecc_pub);
 jump_ret1:
     ecc_point_clear(&cmd1_ecpub);
     return 0;
@@ -4186,6 +4363,55 @@ static int answer_cmd_0x2_disconnect_sp(struct AppleSSCState *ssc_state,
     return 0;
 }
 
+// The store is small, so it is read in one go and then served from memory.
+static void ssc_store_load(AppleSSCState *ssc_state)
+{
+    int64_t len;
+    int ret;
+
+    ssc_state->store = g_malloc0(SSC_STORE_SIZE);
+    if (ssc_state->blk == NULL) {
+        return;
+    }
+    len = blk_getlength(ssc_state->blk);
+    if (len < 0) {
+        error_report("%s: failed to get the drive length: %s", __func__,
+                     strerror(-len));
+        return;
+    }
+    ret = blk_pread(ssc_state->blk, 0, MIN(len, SSC_STORE_SIZE),
+                    ssc_state->store, 0);
+    if (ret < 0) {
+        error_report("%s: failed to read the store: %s", __func__,
+                     strerror(-ret));
+    }
+}
+
+static void ssc_store_read(AppleSSCState *ssc_state, uint64_t offset,
+                           void *buf, size_t len)
+{
+    g_assert(offset + len <= SSC_STORE_SIZE);
+    memcpy(buf, ssc_state->store + offset, len);
+}
+
+// Writes are only acknowledged to the SEP once they are on stable storage.
+static void ssc_store_write(AppleSSCState *ssc_state, uint64_t offset,
+                            const void *buf, size_t len)
+{
+    int ret;
+
+    g_assert(offset + len <= SSC_STORE_SIZE);
+    memcpy(ssc_state->store + offset, buf, len);
+    if (ssc_state->blk == NULL) {
+        return;
+    }
+    ret = blk_pwrite(ssc_state->blk, offset, len, buf, BDRV_REQ_FUA);
+    if (ret < 0) {
+        error_report("%s: failed to write 0x%zx bytes at 0x%" PRIx64 ": %s",
+                     __func__, len, offset, strerror(-ret));
+    }
+}
+
 static int answer_cmd_0x3_metadata_write(struct AppleSSCState *ssc_state,
                                          uint8_t *request, uint8_t *response)
 {
@@ -4251,11 +4477,13 @@ static int answer_cmd_0x3_metadata_write(struct AppleSSCState *ssc_state,
     // req_dec_out, 0); // Is it really necessary to write the mac_key or any
     // metadata to blk_offset?
     uint8_t zeroes_0x40[CMD_METADATA_DATA_PAYLOAD_LENGTH] = { 0 };
-    blk_pwrite(ssc_state->blk, blk_offset, CMD_METADATA_DATA_PAYLOAD_LENGTH,
-               zeroes_0x40, 0); // clear it on metadata write, all 0x40 bytes at
-                                // blk_offset. is this correct?
-    blk_pwrite(ssc_state->blk, key_offset, CMD_METADATA_PAYLOAD_LENGTH,
-               req_dec_out, 0);
+    ssc_store_write(ssc_state, blk_offset, zeroes_0x40,
+                    CMD_METADATA_DATA_PAYLOAD_LENGTH); // clear it on metadata
+                                                       // write, all 0x40 bytes
+                                                       // at blk_offset. is this
+                                                       // correct?
+    ssc_store_write(ssc_state, key_offset, req_dec_out,
+                    CMD_METADATA_PAYLOAD_LENGTH);
 
     uint8_t resp_nop_out[1] = { 0x00 };
     HEXDUMP("cmd_0x03_resp: resp_nop_out", resp_nop_out, 1);
@@ -4310,8 +4538,8 @@ static int answer_cmd_0x4_metadata_data_read(struct AppleSSCState *ssc_state,
     HEXDUMP("cmd_0x04_req: req_nop_out", req_nop_out, 1);
 
     uint8_t resp_dec_out[CMD_METADATA_DATA_PAYLOAD_LENGTH] = { 0 };
-    blk_pread(ssc_state->blk, blk_offset, CMD_METADATA_DATA_PAYLOAD_LENGTH,
-              resp_dec_out, 0);
+    ssc_store_read(ssc_state, blk_offset, resp_dec_out,
+                   CMD_METADATA_DATA_PAYLOAD_LENGTH);
 
     HEXDUMP("cmd_0x04_resp: resp_dec_out", resp_dec_out,
             CMD_METADATA_DATA_PAYLOAD_LENGTH);
@@ -4367,8 +4595,8 @@ static int answer_cmd_0x5_metadata_data_write(struct AppleSSCState *ssc_state,
     HEXDUMP("cmd_0x05_req: req_dec_out", req_dec_out,
             CMD_METADATA_DATA_PAYLOAD_LENGTH);
 
-    blk_pwrite(ssc_state->blk, blk_offset, CMD_METADATA_DATA_PAYLOAD_LENGTH,
-               req_dec_out, 0);
+    ssc_store_write(ssc_state, blk_offset, req_dec_out,
+                    CMD_METADATA_DATA_PAYLOAD_LENGTH);
 
     uint8_t resp_nop_out[1] = { 0x00 };
     HEXDUMP("cmd_0x05_resp: resp_nop_out", resp_nop_out, 1);
@@ -4437,10 +4665,11 @@ static int answer_cmd_0x6_metadata_read(struct AppleSSCState *ssc_state,
     HEXDUMP("cmd_0x06_req: req_nop_out", req_nop_out, 1);
 
     uint8_t resp_dec_out[CMD_METADATA_PAYLOAD_LENGTH] = { 0 };
-    blk_pread(ssc_state->blk, blk_offset, CMD_METADATA_PAYLOAD_LENGTH,
-              resp_dec_out, 0);
-    blk_pread(ssc_state->blk, key_offset, CMD_METADATA_PAYLOAD_LENGTH,
-              ssc_state->slot_hmac_key[kbkdf_index_dataslot], 0);
+    ssc_store_read(ssc_state, blk_offset, resp_dec_out,
+                   CMD_METADATA_PAYLOAD_LENGTH);
+    ssc_store_read(ssc_state, key_offset,
+                   ssc_state->slot_hmac_key[kbkdf_index_dataslot],
+                   CMD_METADATA_PAYLOAD_LENGTH);
 
     HEXDUMP("cmd_0x06_resp: resp_dec_out", resp_dec_out,
             CMD_METADATA_PAYLOAD_LENGTH);
@@ -4455,12 +4684,10 @@ static int answer_cmd_0x6_metadata_read(struct AppleSSCState *ssc_state,
 static int answer_cmd_0x7_init0(struct AppleSSCState *ssc_state,
                                 uint8_t *request, uint8_t *response)
 {
-    struct ecc_point ecc_pub;
     DPRINTF("%s: entered function\n", __func__);
 
     const char *priv_str = "cccccccccccccccccccccccccccccccccccccccccccccccc"
                            "cccccccccccccccccccccccccccccccccccccccccccccccc";
-    int err = generate_ec_priv(priv_str, &ssc_state->ecc_key_main, &ecc_pub);
     do_response_prefix(request, response, SSC_RESPONSE_FLAG_OK);
     uint8_t unknown0[0x06] = { 0x12, 0x34, 0x56, 0x78, 0x90, 0xab };
     uint8_t cpsn[0x07] = { 0xde, 0xad, 0xbe, 0xef, 0xca, 0xfe, 0xcc };
@@ -4472,10 +4699,10 @@ static int answer_cmd_0x7_init0(struct AppleSSCState *ssc_state,
     memcpy(&response[MSG_PREFIX_LENGTH + sizeof(unknown0) +
                      sizeof(ssc_state->cpsn)],
            unknown1, sizeof(unknown1));
-    output_ec_pub(&ecc_pub,
-                  &response[MSG_PREFIX_LENGTH + sizeof(unknown0) +
-                            sizeof(ssc_state->cpsn) + sizeof(unknown1)]);
-    ecc_point_clear(&ecc_pub);
+    ssc_ec_keypair(priv_str, &ssc_state->ecc_key_main,
+                   &ssc_state->main_key_cache,
+                   &response[MSG_PREFIX_LENGTH + sizeof(unknown0) +
+                             sizeof(ssc_state->cpsn) + sizeof(unknown1)]);
 
     HEXDUMP("cmd_0x07_resp", response, SSC_RESPONSE_SIZE_CMD_0x7);
     return 0;
@@ -4621,8 +4848,10 @@ static void apple_ssc_reset(DeviceState *state)
     memset(ssc->kbkdf_counter, 0, sizeof(ssc->kbkdf_counter));
     uint8_t cpsn[0x07] = { 0xde, 0xad, 0xbe, 0xef, 0xca, 0xfe, 0xfe };
     memcpy(ssc->cpsn, cpsn, sizeof(cpsn));
-    blk_set_perm(ssc->blk, BLK_PERM_CONSISTENT_READ | BLK_PERM_WRITE,
-                 BLK_PERM_ALL, &error_fatal);
+    // The drive is attached after realize, so load it on the first reset.
+    if (ssc->store == NULL) {
+        ssc_store_load(ssc);
+    }
 }
 
 AppleSSCState *apple_ssc_create(MachineState *machine, uint8_t addr)
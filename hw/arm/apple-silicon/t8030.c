@@ -50,6 +50,7 @@
 #include "hw/misc/apple-silicon/aop.h"
 #include "hw/misc/apple-silicon/baseband.h"
 #include "hw/misc/apple-silicon/chestnut.h"
+#include "hw/misc/apple-silicon/reg-page.h"
 #include "hw/misc/apple-silicon/roswell.h"
 #include "hw/misc/apple-silicon/smc.h"
 #include "hw/misc/apple-silicon/spmi-baseband.h"
@@ -104,8 +105,9 @@
 #define AMCC_PLANE_STRIDE (0x40000)
 #define AMCC_LOWER(_p) (0x680 + (_p) * AMCC_PLANE_STRIDE)
 #define AMCC_UPPER(_p) (0x684 + (_p) * AMCC_PLANE_STRIDE)
-#define AMCC_REG(_tms, _x) *(uint32_t *)(&t8030_machine->amcc_reg[_x])
+#define AMCC_PLANE_REG(_p, _x) ((_x) + (_p) * AMCC_PLANE_STRIDE)
 
+// Number of application cores allowed by -smp, the SEP takes one slot.
 static size_t t8030_real_cpu_count(T8030MachineState *t8030_machine)
 {
     MachineState *machine;
@@ -122,7 +124,7 @@ static void t8030_start_cpus(T8030MachineState *t8030_machine,
 {
     int i;
 
-    for (i = 0; i < t8030_real_cpu_count(t8030_machine); i++) {
+    for (i = 0; i < t8030_machine->cpu_count; i++) {
         if (test_bit(i, (unsigned long *)&cpu_mask) &&
             apple_a13_cpu_is_powered_off(t8030_machine->cpus[i])) {
             apple_a13_cpu_start(t8030_machine->cpus[i]);
@@ -131,7 +133,8 @@ static void t8030_start_cpus(T8030MachineState *t8030_machine,
 }
 
 static void t8030_create_s3c_uart(const T8030MachineState *t8030_machine,
-                                  uint32_t port, Chardev *chr)
+                                  uint32_t port, Chardev *chr,
+                                  AppleUartLog *log)
 {
     DeviceState *dev;
     hwaddr base;
@@ -159,9 +162,20 @@ static void t8030_create_s3c_uart(const T8030MachineState *t8030_machine,
                                              lduw_le_p(prop->data) + port));
     g_assert_nonnull(dev);
     dev->id = g_strdup(name);
+
+    child = dtb_get_node(t8030_machine->device_tree, "arm-io");
+    child = dtb_get_node(child, name);
+    if (child != NULL) {
+        apple_pmgr_connect(t8030_machine->pmgr, child,
+                           qdev_get_gpio_in_named(dev, APPLE_PMGR_POWER, 0));
+    }
+    if (log != NULL) {
+        apple_uart_set_log(dev, log, port);
+    }
 }
 
-static void t8030_patch_kernel(MachoHeader64 *hdr, uint32_t build_version)
+static void t8030_patch_kernel(T8030MachineState *t8030_machine,
+                               MachoHeader64 *hdr, uint32_t build_version)
 {
     xnu_kpf(hdr);
 
@@ -180,11 +194,13 @@ static void t8030_patch_kernel(MachoHeader64 *hdr, uint32_t build_version)
     // AppleSEPManager::_initTimeoutMultiplier 'sim' -> '  m'
     *(uint32_t *)vtop_slid(0xFFFFFFF008B569E0) = cpu_to_le32(0x52840408);
 
-    // Disable AMX
-    // _gAMXVersion = 0
-    // __cpu_capabilities | 0x800 (ucnormal)
-    *(uint32_t *)vtop_slid(0xFFFFFFF007B64494) = cpu_to_le32(0x5280000A);
-    *(uint32_t *)vtop_slid(0xFFFFFFF007B644A4) = cpu_to_le32(0x52810009);
+    if (!t8030_machine->amx) {
+        // Disable AMX
+        // _gAMXVersion = 0
+        // __cpu_capabilities | 0x800 (ucnormal)
+        *(uint32_t *)vtop_slid(0xFFFFFFF007B64494) = cpu_to_le32(0x5280000A);
+        *(uint32_t *)vtop_slid(0xFFFFFFF007B644A4) = cpu_to_le32(0x52810009);
+    }
 
 #ifndef ENABLE_SEP
     // Make all AppleSEPKeyStoreUserClient requests do nothing but return
@@ -323,8 +339,6 @@ static void t8030_load_classic_kc(T8030MachineState *t8030_machine,
     hwaddr dtb_va;
     hwaddr mem_size;
     hwaddr phys_ptr;
-    hwaddr amcc_lower;
-    hwaddr amcc_upper;
     AppleBootInfo *info = &t8030_machine->boot_info;
     hwaddr last_base;
     MachoSegmentCommand64 *last_seg;
@@ -389,15 +403,6 @@ static void t8030_load_classic_kc(T8030MachineState *t8030_machine,
     info->sep_fw_size = SEPFW_MAPPING_SIZE;
     phys_ptr += info->sep_fw_size;
 
-    amcc_lower = info->sep_fw_addr;
-    amcc_upper = amcc_lower + info->sep_fw_size - 1;
-    for (int i = 0; i < 4; i++) {
-        AMCC_REG(t8030_machine, AMCC_LOWER(i)) =
-            (amcc_lower - T8030_DRAM_BASE) >> 14;
-        AMCC_REG(t8030_machine, AMCC_UPPER(i)) =
-            (amcc_upper - T8030_DRAM_BASE) >> 14;
-    }
-
     // Kernel boot args
     info->kern_boot_args_addr = phys_ptr;
     info->kern_boot_args_size = 0x4000;
@@ -438,8 +443,6 @@ static void t8030_load_fileset_kc(T8030MachineState *t8030_machine,
     hwaddr dtb_va;
     hwaddr mem_size;
     hwaddr phys_ptr;
-    hwaddr amcc_lower;
-    hwaddr amcc_upper;
     AppleBootInfo *info = &t8030_machine->boot_info;
     uint64_t extradata_size;
     uint64_t l2_remaining;
@@ -522,15 +525,6 @@ static void t8030_load_fileset_kc(T8030MachineState *t8030_machine,
     info->sep_fw_size = SEPFW_MAPPING_SIZE;
     phys_ptr += info->sep_fw_size;
 
-    amcc_lower = info->sep_fw_addr;
-    amcc_upper = amcc_lower + info->sep_fw_size - 1;
-    for (int i = 0; i < 4; i++) {
-        AMCC_REG(t8030_machine, AMCC_LOWER(i)) =
-            (amcc_lower - T8030_DRAM_BASE) >> 14;
-        AMCC_REG(t8030_machine, AMCC_UPPER(i)) =
-            (amcc_upper - T8030_DRAM_BASE) >> 14;
-    }
-
     info->kern_boot_args_addr = phys_ptr;
     info->kern_boot_args_size = 0x4000;
     phys_ptr += info->kern_boot_args_size;
@@ -569,7 +563,8 @@ static void t8030_rtkit_mem_setup(T8030MachineState *t8030_machine,
     dtb_set_prop_str(child, "segment-names", "__TEXT;__DATA");
     dtb_set_prop_str(iop_nub, "segment-names", "__TEXT;__DATA");
 
-    segranges[0].phys = carveout_alloc_mem(ca, text_size + data_size);
+    segranges[0].phys = carveout_alloc_mem(ca, name, text_size + data_size,
+                                           CARVEOUT_DISCARDABLE);
     segranges[0].virt = 0;
     segranges[0].remap = 0;
     segranges[0].size = text_size;
@@ -589,14 +584,163 @@ static void t8030_rtkit_mem_setup(T8030MachineState *t8030_machine,
     }
 }
 
+#define AMCC_PLANE_REGS(_p)                                      \
+    { AMCC_PLANE_REG(_p, 0x4), 0x2f, APPLE_REG_RO },             \
+    { AMCC_PLANE_REG(_p, 0x6A0), 0, APPLE_REG_RO },              \
+    { AMCC_PLANE_REG(_p, 0x6A4), 0, APPLE_REG_RO },              \
+    { AMCC_PLANE_REG(_p, 0x6A8), 0x1, APPLE_REG_RO },            \
+    { AMCC_PLANE_REG(_p, 0x6B8), 0x1, APPLE_REG_RO }
+
+static const AppleRegDef amcc_regs[] = {
+    AMCC_PLANE_REGS(0),
+    AMCC_PLANE_REGS(1),
+    AMCC_PLANE_REGS(2),
+    AMCC_PLANE_REGS(3),
+};
+
+static const AppleRegPageInfo amcc_reg_info = {
+    .regs = amcc_regs,
+    .nb_regs = ARRAY_SIZE(amcc_regs),
+};
+
+// Protect the SEPFW mapping and point the fixed protected range at the
+// kernel data, once both are known.
+static void t8030_amcc_update(T8030MachineState *t8030_machine)
+{
+    AppleBootInfo *info = &t8030_machine->boot_info;
+    hwaddr amcc_lower = info->sep_fw_addr;
+    hwaddr amcc_upper = amcc_lower + info->sep_fw_size - 1;
+    uint64_t base = info->top_of_kernel_data_pa - T8030_DRAM_BASE;
+    uint64_t amcc_size = 0xf000000;
+
+    for (int i = 0; i < 4; i++) {
+        apple_reg_page_write32(&t8030_machine->amcc, AMCC_LOWER(i),
+                               (amcc_lower - T8030_DRAM_BASE) >> 14);
+        apple_reg_page_write32(&t8030_machine->amcc, AMCC_UPPER(i),
+                               (amcc_upper - T8030_DRAM_BASE) >> 14);
+    }
+    for (int i = 0; i < AMCC_PLANE_COUNT; i++) {
+        apple_reg_page_write32(&t8030_machine->amcc, AMCC_PLANE_REG(i, 0x6A0),
+                               base >> 12);
+        apple_reg_page_write32(&t8030_machine->amcc, AMCC_PLANE_REG(i, 0x6A4),
+                               ((amcc_size + base) - 1) >> 12);
+    }
+}
+
+// Settles the boot mode with NVRAM and returns the kernel command line.
+static char *t8030_boot_cmdline(T8030MachineState *t8030_machine)
+{
+    MachineState *machine = MACHINE(t8030_machine);
+    AppleBootInfo *info = &t8030_machine->boot_info;
+    AppleNvramState *nvram;
+    char *cmdline;
+
+    nvram =
+        APPLE_NVRAM(object_resolve_path_at(NULL, "/machine/peripheral/nvram"));
+    if (nvram == NULL) {
+        error_setg(&error_abort, "Failed to find NVRAM device");
+        return NULL;
+    }
+    apple_nvram_load(nvram);
+
+    if (machine->initrd_filename == NULL &&
+        t8030_machine->boot_mode != kBootModeExitRecovery &&
+        !env_get_bool(nvram, "auto-boot", false)) {
+        t8030_machine->boot_mode = kBootModeExitRecovery;
+        warn_report(
+            "No RAM Disk specified but auto boot disabled, exiting recovery.");
+    }
+
+    info_report("boot_mode: %u", t8030_machine->boot_mode);
+    switch (t8030_machine->boot_mode) {
+    case kBootModeEnterRecovery:
+        env_set(nvram, "auto-boot", "false", 0);
+        t8030_machine->boot_mode = kBootModeAuto;
+        break;
+    case kBootModeExitRecovery:
+        env_set(nvram, "auto-boot", "true", 0);
+        t8030_machine->boot_mode = kBootModeAuto;
+        break;
+    default:
+        break;
+    }
+
+    info_report("auto-boot=%s",
+                env_get_bool(nvram, "auto-boot", false) ? "true" : "false");
+
+    if (t8030_machine->boot_mode == kBootModeAuto &&
+        !env_get_bool(nvram, "auto-boot", false)) {
+        cmdline = g_strconcat("-restore rd=md0 nand-enable-reformat=1 ",
+                              machine->kernel_cmdline, NULL);
+    } else {
+        cmdline = g_strdup(machine->kernel_cmdline);
+    }
+
+    apple_nvram_save(nvram);
+
+    info->nvram_size = nvram->len;
+
+    if (info->nvram_size > XNU_MAX_NVRAM_SIZE) {
+        info->nvram_size = XNU_MAX_NVRAM_SIZE;
+    }
+    if (apple_nvram_serialize(nvram, info->nvram_data,
+                              sizeof(info->nvram_data)) < 0) {
+        error_report("Failed to read NVRAM");
+    }
+
+    return cmdline;
+}
+
+// Everything the boot image depends on, besides the files given on the
+// command line, which are only read once.
+static GBytes *t8030_boot_image_key(T8030MachineState *t8030_machine,
+                                    const char *cmdline)
+{
+    AppleBootInfo *info = &t8030_machine->boot_info;
+    GByteArray *key = g_byte_array_new();
+
+    g_byte_array_append(key, (const guint8 *)cmdline, strlen(cmdline) + 1);
+    g_byte_array_append(key, info->nvram_data, info->nvram_size);
+    return g_byte_array_free_to_bytes(key);
+}
+
+// Keeps what t8030_memory_setup() wrote to guest memory for warm reboots.
+static void t8030_boot_image_take(T8030MachineState *t8030_machine,
+                                  GBytes *key)
+{
+    AppleBootImage *image;
+
+    g_clear_pointer(&t8030_machine->boot_image, apple_boot_image_free);
+    if (!t8030_machine->warm_reboot) {
+        return;
+    }
+
+    image = apple_boot_image_new(key);
+    // Trust cache, kernel, RAM disk, SEPFW, boot args and device tree. The
+    // carveouts, including the panic log, are above the kernel region.
+    apple_boot_image_add(image, T8030_DRAM_BASE,
+                         t8030_machine->boot_info.top_of_kernel_data_pa -
+                             T8030_DRAM_BASE,
+                         false);
+    if (t8030_machine->sep_rom_filename) {
+        apple_boot_image_add(image, T8030_SEPROM_BASE, T8030_SEPROM_SIZE,
+                             false);
+        apple_boot_image_add(image, 0x300000000ULL, 0x8000000ULL, true);
+        apple_boot_image_add(image, 0x340000000ULL, 0x2000000ULL, true);
+        apple_boot_image_add(image, t8030_machine->soc_base_pa + 0x42140000,
+                             0x4000, false);
+    }
+    t8030_machine->boot_image = image;
+}
+
 static void t8030_memory_setup(T8030MachineState *t8030_machine)
 {
     MachineState *machine;
     MachoHeader64 *hdr;
-    AppleNvramState *nvram;
     AppleBootInfo *info;
     DTBNode *memory_map;
     char *cmdline;
+    GBytes *key;
     char *seprom;
     gsize fsize;
     CarveoutAllocator *ca;
@@ -620,6 +764,21 @@ static void t8030_memory_setup(T8030MachineState *t8030_machine)
         return;
     }
 
+    cmdline = t8030_boot_cmdline(t8030_machine);
+    key = t8030_boot_image_key(t8030_machine, cmdline);
+
+    if (t8030_machine->boot_image != NULL) {
+        if (apple_boot_image_restore(t8030_machine->boot_image, key)) {
+            info_report("Warm reboot, restored the boot image");
+            carveout_discard_all();
+            t8030_amcc_update(t8030_machine);
+            g_bytes_unref(key);
+            g_free(cmdline);
+            return;
+        }
+        g_clear_pointer(&t8030_machine->boot_image, apple_boot_image_free);
+    }
+
     info->dram_base = T8030_DRAM_BASE;
     info->dram_size = machine->maxram_size;
 
@@ -751,59 +910,6 @@ static void t8030_memory_setup(T8030MachineState *t8030_machine)
 #endif // for T8030 SEPROM
     }
 
-    nvram =
-        APPLE_NVRAM(object_resolve_path_at(NULL, "/machine/peripheral/nvram"));
-    if (nvram == NULL) {
-        error_setg(&error_abort, "Failed to find NVRAM device");
-        return;
-    }
-    apple_nvram_load(nvram);
-
-    if (machine->initrd_filename == NULL &&
-        t8030_machine->boot_mode != kBootModeExitRecovery &&
-        !env_get_bool(nvram, "auto-boot", false)) {
-        t8030_machine->boot_mode = kBootModeExitRecovery;
-        warn_report(
-            "No RAM Disk specified but auto boot disabled, exiting recovery.");
-    }
-
-    info_report("boot_mode: %u", t8030_machine->boot_mode);
-    switch (t8030_machine->boot_mode) {
-    case kBootModeEnterRecovery:
-        env_set(nvram, "auto-boot", "false", 0);
-        t8030_machine->boot_mode = kBootModeAuto;
-        break;
-    case kBootModeExitRecovery:
-        env_set(nvram, "auto-boot", "true", 0);
-        t8030_machine->boot_mode = kBootModeAuto;
-        break;
-    default:
-        break;
-    }
-
-    info_report("auto-boot=%s",
-                env_get_bool(nvram, "auto-boot", false) ? "true" : "false");
-
-    if (t8030_machine->boot_mode == kBootModeAuto &&
-        !env_get_bool(nvram, "auto-boot", false)) {
-        cmdline = g_strconcat("-restore rd=md0 nand-enable-reformat=1 ",
-                              machine->kernel_cmdline, NULL);
-    } else {
-        cmdline = g_strdup(machine->kernel_cmdline);
-    }
-
-    apple_nvram_save(nvram);
-
-    info->nvram_size = nvram->len;
-
-    if (info->nvram_size > XNU_MAX_NVRAM_SIZE) {
-        info->nvram_size = XNU_MAX_NVRAM_SIZE;
-    }
-    if (apple_nvram_serialize(nvram, info->nvram_data,
-                              sizeof(info->nvram_data)) < 0) {
-        error_report("Failed to read NVRAM");
-    }
-
     if (t8030_machine->ticket_filename) {
         if (!g_file_get_contents(t8030_machine->ticket_filename,
                                  &info->ticket_data,
@@ -834,7 +940,8 @@ static void t8030_memory_setup(T8030MachineState *t8030_machine)
     DTBNode *pram = dtb_get_node(t8030_machine->device_tree, "pram");
     if (pram) {
         uint64_t panic_reg[2];
-        panic_reg[0] = carveout_alloc_mem(ca, T8030_PANIC_SIZE);
+        // Kept across resets, t8030_check_panic() reads it back.
+        panic_reg[0] = carveout_alloc_mem(ca, "panic", T8030_PANIC_SIZE, 0);
         panic_reg[1] = T8030_PANIC_SIZE;
         dtb_set_prop(pram, "reg", sizeof(panic_reg), &panic_reg);
         dtb_set_prop_u64(chosen, "embedded-panic-log-size", panic_reg[1]);
@@ -845,7 +952,8 @@ static void t8030_memory_setup(T8030MachineState *t8030_machine)
     DTBNode *vram = dtb_get_node(t8030_machine->device_tree, "vram");
     if (vram) {
         t8030_machine->video_args.base_addr =
-            carveout_alloc_mem(ca, T8030_DISPLAY_SIZE);
+            carveout_alloc_mem(ca, "vram", T8030_DISPLAY_SIZE,
+                               CARVEOUT_DISCARDABLE);
         uint64_t vram_reg[2];
         vram_reg[0] = t8030_machine->video_args.base_addr;
         vram_reg[1] = T8030_DISPLAY_SIZE;
@@ -877,191 +985,159 @@ static void t8030_memory_setup(T8030MachineState *t8030_machine)
         break;
     }
 
+    t8030_amcc_update(t8030_machine);
+    t8030_boot_image_take(t8030_machine, key);
+
+    g_bytes_unref(key);
     g_free(cmdline);
 }
 
-static uint64_t pmgr_unk_e4800 = 0;
-static uint32_t pmgr_unk_e4000[0x180 / 4] = { 0 };
+#define PMGR_FUSE_SET (0xA55AC33C)
+#define PMGR_FUSE_CLEAR (0xA050C030)
+
+#define PMGR_CURRENT_SECURE_MODE (0x3D2BC004)
+#define PMGR_CURRENT_BOARD_ID (0x3D2BC010)
+
+// On IMG4: Security Epoch ; On IMG3: Minimum Epoch, verified on SecureROM
+// s5l8955xsi
+#define PMGR_SECURITY_EPOCH (0x1)
+
+static uint32_t t8030_pmgr_board_id(T8030MachineState *t8030_machine)
+{
+    // Bit 31 is set for both SEP and AP.
+    return ((t8030_machine->board_id >> 5) & 0x7) |
+           ((PMGR_SECURITY_EPOCH & 0x7f) << 5) | (1 << 31);
+}
+
+// Adds the registers of the fuse and unknown PMGR blocks that fall into
+// the page [base, base + size), in SoC-relative addresses. Everything else
+// reads as zero and ignores writes.
+static void t8030_pmgr_region_regs(T8030MachineState *t8030_machine,
+                                   GArray *regs, hwaddr base, uint64_t size)
+{
+    const AppleRegDef fuses[] = {
+        { 0x3D280088, 0xFF, APPLE_REG_RO }, // PMGR_AON
+        // CURRENT_PROD, ignored if RAW_PROD is set
+        { 0x3D2BC000, PMGR_FUSE_SET, APPLE_REG_RO },
+        // Current Secure Mode, T8015 SEPOS Kernel also requires this.
+        // The SEP can demote it, see t8030_pmgr_fuse_changer.
+        { PMGR_CURRENT_SECURE_MODE, PMGR_FUSE_SET, APPLE_REG_RO },
+        // Security Domain bit 0 and bit 1
+        { 0x3D2BC008, PMGR_FUSE_SET, APPLE_REG_RO },
+        { 0x3D2BC00C, PMGR_FUSE_SET, APPLE_REG_RO },
+        { PMGR_CURRENT_BOARD_ID, t8030_pmgr_board_id(t8030_machine),
+          APPLE_REG_RO },
+        // T8030 iBSS panics on anything else.
+        { 0x3D2BC020, PMGR_FUSE_SET, APPLE_REG_RO },
+        // Unknown SEP T8020, bit 31 causes a panic.
+        { 0x3D2BC02C, 1 << 30, APPLE_REG_RO },
+        // CPRV (Chip Revision), low and high nibble. Bit 1 being set causes a
+        // kernel data abort.
+        { 0x3D2BC030,
+          ((t8030_machine->chip_revision & 0x7) << 6) |
+              (((t8030_machine->chip_revision & 0x70) >> 4) << 5),
+          APPLE_REG_RO },
+        { 0x3D2BC300, t8030_machine->ecid & 0xffffffff, APPLE_REG_RO },
+        { 0x3D2BC304, t8030_machine->ecid >> 32, APPLE_REG_RO },
+        // SEP Chip Revision. 8 might be a development value, it skips a few
+        // checks (lynx and others). Production SARS doesn't like 0 in
+        // combination with kbkdf_index being 0.
+        { 0x3D2BC30C, 8 << 28, APPLE_REG_RO },
+        // RAW_PROD, clearing it breaks SEPROM
+        { 0x3D2BC400, PMGR_FUSE_SET, APPLE_REG_RO },
+        { 0x3D2BC404, PMGR_FUSE_SET, APPLE_REG_RO }, // Raw Secure Mode
+        { 0x3D2BC408, PMGR_FUSE_SET, APPLE_REG_RO },
+        { 0x3D2BC40C, PMGR_FUSE_SET, APPLE_REG_RO },
+        { 0x3D2BC410, t8030_pmgr_board_id(t8030_machine), APPLE_REG_RO },
+        // Memory encryption AMK (Authentication Master Key) enabled,
+        // 0x32B3 disables it.
+        { 0x3D2E8000, 0xC2E9, APPLE_REG_RO },
+        { 0x3C100C4C, 0x1, APPLE_REG_RO },
+    };
+    AppleRegDef def;
+    hwaddr addr;
+    int i;
 
-static void pmgr_unk_reg_write(void *opaque, hwaddr addr, uint64_t data,
-                               unsigned size)
-{
-    hwaddr base = (hwaddr)opaque;
-    switch (base + addr) {
-    case 0x3D2E4800: // ???? 0x240002c00 and 0x2400037a4
-        pmgr_unk_e4800 = data; // 0x240002c00 and 0x2400037a4
-        break;
-    case 0x3D2E4000 ... 0x3D2E417f: // ???? 0x24000377c
-        pmgr_unk_e4000[((base + addr) - 0x3D2E4000) / 4] = data; // 0x24000377c
-        break;
-    default:
-        break;
+    for (addr = base; addr < base + size; addr += 4) {
+        if (addr == 0x3D2E4800 || (addr >= 0x3D2E4000 && addr < 0x3D2E4180)) {
+            // Read-back storage, 0x240002c00, 0x2400037a4 and 0x24000377c
+            def = (AppleRegDef){ addr - base, 0, 0 };
+        } else if ((addr & 0x10E70000) == 0x10E70000) {
+            def = (AppleRegDef){ addr - base, (108 << 4) | 0x200000,
+                                 APPLE_REG_RO };
+        } else {
+            continue;
+        }
+        g_array_append_val(regs, def);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(fuses); i++) {
+        if (fuses[i].addr >= base && fuses[i].addr < base + size) {
+            def = fuses[i];
+            def.addr -= base;
+            g_array_append_val(regs, def);
+        }
     }
-#if 0
-    qemu_log_mask(LOG_UNIMP,
-                  "PMGR reg WRITE unk @ 0x" TARGET_FMT_lx
-                  " base: 0x" TARGET_FMT_lx " value: 0x" TARGET_FMT_lx "\n",
-                  base + addr, base, data);
-#endif
 }
 
-static uint64_t pmgr_unk_reg_read(void *opaque, hwaddr addr, unsigned size)
+static void t8030_pmgr_region_init(T8030MachineState *t8030_machine,
+                                   T8030PMGRRegion *region, const char *name,
+                                   hwaddr base, uint64_t size)
 {
-    T8030MachineState *t8030_machine = T8030_MACHINE(qdev_get_machine());
-    AppleSEPState *sep;
-    hwaddr base = (hwaddr)opaque;
-    sep = (AppleSEPState *)object_dynamic_cast(
-        object_property_get_link(OBJECT(t8030_machine), "sep", &error_fatal),
-        TYPE_APPLE_SEP);
+    GArray *regs = g_array_new(false, false, sizeof(AppleRegDef));
 
-#if 0
-    if ((((base + addr) & 0xfffffffb) != 0x10E20020) &&
-        (((base + addr) & 0xfffffffb) != 0x11E20020)) {
-        qemu_log_mask(LOG_UNIMP,
-                      "PMGR reg READ unk @ 0x" TARGET_FMT_lx
-                      " base: 0x" TARGET_FMT_lx "\n",
-                      base + addr, base);
-    }
-#endif
-    uint64_t security_epoch; // On IMG4: Security Epoch ; On IMG3: Minimum
-                             // Epoch, verified on SecureROM s5l8955xsi
-    int current_prod = 1;
-    int current_secure_mode = 1; // T8015 SEPOS Kernel also requires this.
-    int security_domain = 1;
-    int raw_prod = 1;
-    int raw_secure_mode = 1;
-    // sep_bit30_current_value should stay zero on raw and only change current.
-    int sep_bit30_current_value = 0;
-    security_epoch = 0x1;
-    // current_prod = raw_prod = current_secure_mode = raw_secure_mode = 0;
-    switch (base + addr) {
-    case 0x3D280088: // PMGR_AON
-        return 0xFF;
-    case 0x3D2BC000: // T8030 CURRENT_PROD
-        // if 0xBC404 returns 1==0xA55AC33C, this will get ignored
-        if (current_prod == 1)
-            return 0xA55AC33C; // IBFL | 0x10 // CPFM | 0x03 ; IBFL_base == 0x0C
-        return 0xA050C030; // IBFL | 0x00 // CPFM | 0x00 ; IBFL_base == 0x04
-    // case 0x3D2BC200: // RAW_PROD T8020 AP/SEP
-    case 0x3D2BC400: // T8030 RAW_PROD
-        // if (sep->pmgr_base_regs[0x68] != 0) // if T8020 AP/SEP current_prod
-        // and raw_prod are disabled, scrd sets a flag
-        //     return 0xA050C030;
-        // return 0xA55AC33C; // IBFL | 0x10
-        // return 0xA050C030; // not prod. breaks SEPROM
-        if (raw_prod == 1)
-            return 0xA55AC33C; // IBFL | 0x10
-        return 0xA050C030; // IBFL | 0x00
-    case 0x3D2BC004: // Current Secure Mode SEP T8020
-        // handle SEP DSEC demotion
-        if (sep != NULL && sep->pmgr_fuse_changer_bit1_was_set)
-            current_secure_mode = 0; // SEP DSEC img4 tag demotion active
-        if (current_secure_mode)
-            return 0xA55AC33C; // CPFM | 0x01 ; IBFL_base == 0x0C
-        return 0xA050C030; // CPFM | 0x00 ; IBFL_base == 0x04
-    // case 0x3D2BC204: // Raw Secure Mode AP/SEP T8020
-    case 0x3D2BC404: // Raw Secure Mode AP/SEP T8030
-        ////case 0x3D2BC604: //? maybe also raw secure mode for T8030???
-        if (raw_secure_mode)
-            return 0xA55AC33C; // CPFM | 0x01 ; IBFL_base == 0x0C
-        return 0xA050C030;
-    case 0x3D2BC008:
-    case 0x3D2BC408: // raw for t8030?
-        // case 0x3D2BC208: // Security (raw?) Domain BIT0 T8020 SEP
-        if ((security_domain & (1 << 0)) != 0)
-            return 0xA55AC33C; // security domain | 0x1
-        return 0xA050C030;
-    case 0x3D2BC00C:
-    case 0x3D2BC40C: // raw for t8030?
-        // case 0x3D2BC20C: // Security Domain (raw?) BIT1 T8020 SEP
-        if ((security_domain & (1 << 1)) != 0)
-            return 0xA55AC33C; // security domain | 0x2
-        return 0xA050C030; // security domain | 0x0
-    case 0x3D2BC010:
-        sep_bit30_current_value =
-            ((sep == NULL) ? 0 : (sep->pmgr_fuse_changer_bit0_was_set << 30));
-        QEMU_FALLTHROUGH;
-    // case 0x3D2BC210: // (raw?) board id/minimum epoch? //CEPO? SEPO?
-    //                  // AppleSEPROM-A12-D331pAP
-    case 0x3D2BC410: // raw board id and epoch t8030
-        return ((t8030_machine->board_id >> 5) & 0x7) |
-               ((security_epoch & 0x7f) << 5) | sep_bit30_current_value |
-               (1 << 31);
-        // (security epoch & 0x7F) << 5 ;; (sep_bit30 << 30)
-        // for SEP | (1 << 31) for SEP and AP
-    case 0x3D2BC020: // T8030 iBSS: FUN_19c07feac_return_value_causes_crash;
-                     // same address on T8020 iBoot, but possibly different
-                     // handling
-        if (1)
-            return 0xA55AC33C;
-        return 0xA050C030; // causes panic, so does a invalid value
-    case 0x3D2BC02c: // Unknown SEP T8020
-        // return 0xc000ce71;
-        // return 0 << 30; // no panic
-        // return (1 << 31) | (1 << 30); // panic
-        return (0 << 31) | (1 << 30); // // bit31 causes a panic
-    case 0x3D2BC030: // CPRV (Chip Revision) T8030 T8020
-        // return 0xa6016242;
-        // return ((chip_revision & 0x7) << 6) | (((chip_revision & 0x70) >> 4)
-        // << 5); // LOW&HIGH NIBBLE T8030, T8020 and AppleSEPROM-S4-S5-B1 //
-        // maybe 0x1c0 instead of 0x7 return ((chip_revision & 0x7) << 6) |
-        // (((chip_revision & 0x70) >> 4) << 5) | (1 << 1); // LOW&HIGH NIBBLE
-        // T8030, T8020 and AppleSEPROM-S4-S5-B1 // maybe 0x1c0 instead of 0x7
-        return ((t8030_machine->chip_revision & 0x7) << 6) |
-               (((t8030_machine->chip_revision & 0x70) >> 4) << 5) |
-               (0 << 1); // LOW&HIGH NIBBLE T8030, T8020 and
-                         // AppleSEPROM-S4-S5-B1 // maybe 0x1c0 instead of 0x7 ;
-                         // bit1 being set causes kernel data abort
-    // case 0x3D2BC100: // ECID LOW T8020
-    case 0x3D2BC300: // ECID LOW T8030
-        return t8030_machine->ecid & 0xffffffff; // ECID lower
-    // case 0x3D2BC104: // ECID HIGH T8020
-    case 0x3D2BC304: // ECID HIGH T8030
-        return t8030_machine->ecid >> 32; // ECID upper
-    // case 0x3D2BC10C: // T8020 SEP Chip Revision
-    case 0x3D2BC30C: // T8030 SEP Chip Revision
-        // case 0x3D2BC30c: // Maybe the T8030 SEP equivalent?
-        //  1 vs. not 1: TRNG/Monitor
-        //  0 vs. not 0: Monitor
-        //  2 vs. not 2: ARTM
-        //  Production SARS doesn't like value (0 << 28) in combination with
-        //  kbkdf_index being 0
-        // return 0 << 28; // 0 ; might be the production value
-        // return 2 << 28; // 1
-        // return 3 << 28; // 1
-        return 8 << 28; // 2 ; might be a development value, skips a few checks
-                        // (lynx and others)
-    case 0x3D2E8000: // ????
-        // return 0x32B3; // memory encryption AMK (Authentication Master Key)
-        // disabled
-        return 0xC2E9; // memory encryption AMK (Authentication Master Key)
-                       // enabled
-    case 0x3D2E4800: // ???? 0x240002c00 and 0x2400037a4
-        return pmgr_unk_e4800; // 0x240002c00 and 0x2400037a4
-    case 0x3D2E4000 ... 0x3D2E417f: // ???? 0x24000377c
-        return pmgr_unk_e4000[((base + addr) - 0x3D2E4000) / 4]; // 0x24000377c
-    ///
-    case 0x3c100c4c: // Could that also have been for T8015? No idea anymore.
-        return 0x1;
-    ///
-    default:
-        if (((base + addr) & 0x10E70000) == 0x10E70000) {
-            return (108 << 4) | 0x200000; //?
+    t8030_pmgr_region_regs(t8030_machine, regs, base, size);
+
+    region->base = base;
+    region->info.flags = APPLE_REG_RO;
+    region->info.nb_regs = regs->len;
+    region->info.regs = (AppleRegDef *)g_array_free(regs, false);
+    apple_reg_page_init(&region->page, OBJECT(t8030_machine), name, size,
+                        &region->info, t8030_machine);
+}
+
+static void t8030_pmgr_fuse_write(T8030MachineState *t8030_machine,
+                                  hwaddr addr, uint32_t val)
+{
+    T8030PMGRRegion *region;
+    int i;
+
+    for (i = 0; i < t8030_machine->pmgr_nb_regions; i++) {
+        region = &t8030_machine->pmgr_regions[i];
+        if (addr >= region->base && addr < region->base + region->page.size) {
+            apple_reg_page_write32(&region->page, addr - region->base, val);
+            return;
         }
-        return 0;
     }
 }
 
-static const MemoryRegionOps pmgr_unk_reg_ops = {
-    .write = pmgr_unk_reg_write,
-    .read = pmgr_unk_reg_read,
-};
+// The SEP demotes the current fuses until the next SoC reset.
+static void t8030_pmgr_fuse_changer(void *opaque, int n, int level)
+{
+    T8030MachineState *t8030_machine = opaque;
+
+    switch (n) {
+    case 0:
+        // SEP bit 30 only ever changes the current value, never the raw one.
+        t8030_pmgr_fuse_write(t8030_machine, PMGR_CURRENT_BOARD_ID,
+                              t8030_pmgr_board_id(t8030_machine) |
+                                  (level ? 1 << 30 : 0));
+        break;
+    case 1:
+        // SEP DSEC img4 tag demotion
+        t8030_pmgr_fuse_write(t8030_machine, PMGR_CURRENT_SECURE_MODE,
+                              level ? PMGR_FUSE_CLEAR : PMGR_FUSE_SET);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
 
 static void pmgr_reg_write(void *opaque, hwaddr addr, uint64_t data,
                            unsigned size)
 {
     T8030MachineState *t8030_machine = T8030_MACHINE(opaque);
-    AppleSEPState *sep;
+    AppleA13State *sep_cpu;
     uint32_t value = data;
 
     if (addr >= 0x80000 && addr <= 0x8C000) {
@@ -1079,25 +1155,22 @@ static void pmgr_reg_write(void *opaque, hwaddr addr, uint64_t data,
         return;
     case 0x80C00:
         // case 0x80400: // T8015
-        sep = (AppleSEPState *)object_dynamic_cast(
-            object_property_get_link(OBJECT(t8030_machine), "sep",
-                                     &error_fatal),
-            TYPE_APPLE_SEP);
-
-        if (sep != NULL) {
+        if (t8030_machine->sep_cpu != NULL) {
+            sep_cpu = APPLE_A13(t8030_machine->sep_cpu);
             if (data & (1 << 31)) {
-                apple_a13_cpu_reset(APPLE_A13(sep->cpu));
+                apple_a13_cpu_reset(sep_cpu);
             } else if (data & (1 << 10)) {
-                apple_a13_cpu_off(APPLE_A13(sep->cpu));
+                apple_a13_cpu_off(sep_cpu);
             } else {
-                if (apple_a13_cpu_is_powered_off(APPLE_A13(sep->cpu))) {
-                    apple_a13_cpu_start(APPLE_A13(sep->cpu));
+                if (apple_a13_cpu_is_powered_off(sep_cpu)) {
+                    apple_a13_cpu_start(sep_cpu);
                 }
             }
         }
         break;
     }
     memcpy(t8030_machine->pmgr_reg + addr, &value, size);
+    apple_pmgr_ps_write(t8030_machine->pmgr, addr, value);
 }
 
 static uint64_t pmgr_reg_read(void *opaque, hwaddr addr, unsigned size)
@@ -1126,77 +1199,17 @@ static const MemoryRegionOps pmgr_reg_ops = {
     .read = pmgr_reg_read,
 };
 
-static void amcc_reg_write(void *opaque, hwaddr addr, uint64_t data,
-                           unsigned size)
-{
-    T8030MachineState *t8030_machine = T8030_MACHINE(opaque);
-    uint32_t value = data;
-
-    memcpy(t8030_machine->amcc_reg + addr, &value, size);
-}
-
-static uint64_t amcc_reg_read(void *opaque, hwaddr addr, unsigned size)
-{
-    T8030MachineState *t8030_machine = T8030_MACHINE(opaque);
-    uint64_t result = 0;
-    uint64_t base =
-        t8030_machine->boot_info.top_of_kernel_data_pa - T8030_DRAM_BASE;
-    uint64_t amcc_size = 0xf000000;
-    switch (addr) {
-    case 0x6A0:
-    case 0x406A0:
-    case 0x806A0:
-    case 0xC06A0:
-        result = base >> 12;
-        break;
-    case 0x6A4:
-    case 0x406A4:
-    case 0x806A4:
-    case 0xC06A4:
-        result = ((amcc_size + base) - 1) >> 12;
-        break;
-    case 0x6A8:
-    case 0x406A8:
-    case 0x806A8:
-    case 0xC06A8:
-        result = 0x1;
-        break;
-    case 0x6B8:
-    case 0x406B8:
-    case 0x806B8:
-    case 0xC06B8:
-        result = 0x1;
-        break;
-    case 0x4:
-    case 0x40004:
-    case 0x80004:
-    case 0xc0004:
-        result = 0x2f;
-        break;
-    default: {
-        memcpy(&result, t8030_machine->amcc_reg + addr, size);
-        break;
-    }
-    }
-#if 0
-    qemu_log_mask(LOG_UNIMP,
-                  "AMCC reg READ @ 0x" TARGET_FMT_lx " value: 0x" TARGET_FMT_lx
-                  "\n",
-                  orig_addr, result);
-#endif
-    return result;
-}
-
-static const MemoryRegionOps amcc_reg_ops = {
-    .write = amcc_reg_write,
-    .read = amcc_reg_read,
-};
-
-static void t8030_cluster_setup(T8030MachineState *t8030_machine)
+// Clusters left without cores are not created at all.
+static void t8030_cluster_setup(T8030MachineState *t8030_machine,
+                                const uint8_t *cluster_type)
 {
     for (int i = 0; i < A13_MAX_CLUSTER; i++) {
         char *name = NULL;
 
+        if (!cluster_type[i]) {
+            continue;
+        }
+
         name = g_strdup_printf("cluster%d", i);
         object_initialize_child(OBJECT(t8030_machine), name,
                                 &t8030_machine->clusters[i],
@@ -1204,39 +1217,112 @@ static void t8030_cluster_setup(T8030MachineState *t8030_machine)
         g_free(name);
         qdev_prop_set_uint32(DEVICE(&t8030_machine->clusters[i]), "cluster-id",
                              i);
+        qdev_prop_set_uint32(DEVICE(&t8030_machine->clusters[i]),
+                             "cluster-type", cluster_type[i]);
     }
 }
 
-static void t8030_cluster_realize(T8030MachineState *t8030_machine)
+static void t8030_cluster_realize(T8030MachineState *t8030_machine,
+                                  const uint8_t *cluster_type)
 {
     for (int i = 0; i < A13_MAX_CLUSTER; i++) {
-        qdev_realize(DEVICE(&t8030_machine->clusters[i]), NULL, &error_fatal);
+        if (cluster_type[i]) {
+            qdev_realize(DEVICE(&t8030_machine->clusters[i]), NULL,
+                         &error_fatal);
+        }
     }
 }
 
-static void t8030_cpu_setup(T8030MachineState *t8030_machine)
+/*
+ * Keep the cores allowed by -smp and the e-cores/p-cores properties, in
+ * device tree order, and drop the others from the device tree. The kept
+ * cores get contiguous cpu-ids, which the AIC, the IPI matrices and the
+ * PMGR CPU start mask are indexed by; the first one becomes the boot CPU.
+ */
+static void t8030_cpu_select(T8030MachineState *t8030_machine,
+                             uint8_t *cluster_type)
 {
+    unsigned int e_cores = 0, p_cores = 0;
     unsigned int i;
     DTBNode *root;
     GList *iter;
     GList *next = NULL;
 
-    t8030_cluster_setup(t8030_machine);
-
     root = dtb_get_node(t8030_machine->device_tree, "cpus");
     g_assert_nonnull(root);
 
-    for (iter = root->children, i = 0; iter; iter = next, i++) {
-        uint32_t cluster_id;
+    for (iter = root->children, i = 0; iter; iter = next) {
         DTBNode *node;
+        DTBProp *prop;
+        uint32_t cluster_id;
+        uint8_t type;
+        bool keep;
+        char name[16];
 
         next = iter->next;
         node = (DTBNode *)iter->data;
-        if (i >= t8030_real_cpu_count(t8030_machine)) {
+
+        prop = dtb_find_prop(node, "cluster-type");
+        g_assert_nonnull(prop);
+        type = *prop->data;
+
+        keep = i < t8030_real_cpu_count(t8030_machine) && i < A13_MAX_CPU;
+        switch (type) {
+        case 'E':
+            keep = keep && e_cores < t8030_machine->e_cores;
+            e_cores += keep;
+            break;
+        case 'P':
+            keep = keep && p_cores < t8030_machine->p_cores;
+            p_cores += keep;
+            break;
+        default:
+            break;
+        }
+
+        if (!keep) {
             dtb_remove_node(root, node);
             continue;
         }
 
+        prop = dtb_find_prop(node, "cluster-id");
+        g_assert_nonnull(prop);
+        cluster_id = *(uint32_t *)prop->data;
+        g_assert_cmpuint(cluster_id, <, A13_MAX_CLUSTER);
+        cluster_type[cluster_id] = type;
+
+        snprintf(name, sizeof(name), "cpu%u", i);
+        dtb_set_prop_str(node, "name", name);
+        dtb_set_prop_u32(node, "cpu-id", i);
+        dtb_set_prop_str(node, "state", i == 0 ? "running" : "waiting");
+        i++;
+    }
+
+    if (i == 0) {
+        error_setg(&error_fatal, "No CPU cores left: check -smp, e-cores "
+                                 "and p-cores");
+    }
+    t8030_machine->cpu_count = i;
+}
+
+static void t8030_cpu_setup(T8030MachineState *t8030_machine)
+{
+    uint8_t cluster_type[A13_MAX_CLUSTER] = { 0 };
+    unsigned int i;
+    DTBNode *root;
+    GList *iter;
+
+    t8030_cpu_select(t8030_machine, cluster_type);
+    t8030_cluster_setup(t8030_machine, cluster_type);
+
+    root = dtb_get_node(t8030_machine->device_tree, "cpus");
+    g_assert_nonnull(root);
+
+    for (iter = root->children, i = 0; iter; iter = iter->next, i++) {
+        uint32_t cluster_id;
+        DTBNode *node;
+
+        node = (DTBNode *)iter->data;
         t8030_machine->cpus[i] = apple_a13_cpu_create(node, NULL, 0, 0, 0, 0);
         cluster_id = t8030_machine->cpus[i]->cluster_id;
 
@@ -1245,7 +1331,7 @@ static void t8030_cpu_setup(T8030MachineState *t8030_machine)
                                   OBJECT(t8030_machine->cpus[i]));
         qdev_realize(DEVICE(t8030_machine->cpus[i]), NULL, &error_fatal);
     }
-    t8030_cluster_realize(t8030_machine);
+    t8030_cluster_realize(t8030_machine, cluster_type);
 }
 
 static void t8030_create_aic(T8030MachineState *t8030_machine)
@@ -1264,18 +1350,21 @@ static void t8030_create_aic(T8030MachineState *t8030_machine)
     g_assert_nonnull(timebase);
 
     t8030_machine->aic =
-        apple_aic_create(t8030_real_cpu_count(t8030_machine), child, timebase);
+        apple_aic_create(t8030_machine->cpu_count, child, timebase);
     object_property_add_child(OBJECT(t8030_machine), "aic",
                               OBJECT(t8030_machine->aic));
     g_assert_nonnull(t8030_machine->aic);
     sysbus_realize(t8030_machine->aic, &error_fatal);
+    apple_pmgr_connect(
+        t8030_machine->pmgr, child,
+        qdev_get_gpio_in_named(DEVICE(t8030_machine->aic), APPLE_PMGR_POWER, 0));
 
     prop = dtb_find_prop(child, "reg");
     g_assert_nonnull(prop);
 
     reg = (hwaddr *)prop->data;
 
-    for (i = 0; i < t8030_real_cpu_count(t8030_machine); i++) {
+    for (i = 0; i < t8030_machine->cpu_count; i++) {
         memory_region_add_subregion_overlap(
             &t8030_machine->cpus[i]->memory,
             t8030_machine->soc_base_pa + reg[0],
@@ -1289,47 +1378,62 @@ static void t8030_create_aic(T8030MachineState *t8030_machine)
 static void t8030_pmgr_setup(T8030MachineState *t8030_machine)
 {
     uint64_t *reg;
+    int nb_reg;
     int i;
+    T8030PMGRRegion *region;
     char name[32];
     DTBProp *prop;
+    SysBusDevice *sbd;
     DTBNode *child = dtb_get_node(t8030_machine->device_tree, "arm-io");
 
     g_assert_nonnull(child);
     child = dtb_get_node(child, "pmgr");
     g_assert_nonnull(child);
 
+    sbd = apple_pmgr_create(child);
+    object_property_add_child(OBJECT(t8030_machine), "pmgr", OBJECT(sbd));
+    sysbus_realize_and_unref(sbd, &error_fatal);
+    t8030_machine->pmgr = APPLE_PMGR(sbd);
+
     prop = dtb_find_prop(child, "reg");
     g_assert_nonnull(prop);
 
     reg = (uint64_t *)prop->data;
+    nb_reg = prop->length / 16;
+
+    // Every block but the first one, plus PMP, only holds fuses and storage.
+    t8030_machine->pmgr_nb_regions = nb_reg;
+    t8030_machine->pmgr_regions = g_new0(T8030PMGRRegion, nb_reg);
+
+    for (i = 0; i < nb_reg; i++) {
+        hwaddr base = reg[i * 2];
+        uint64_t size = reg[i * 2 + 1];
+        MemoryRegion *mem;
 
-    for (i = 0; i < prop->length / 8; i += 2) {
-        MemoryRegion *mem = g_new(MemoryRegion, 1);
         if (i > 0) {
-            snprintf(name, 32, "pmgr-unk-reg-%d", i);
-            memory_region_init_io(mem, OBJECT(t8030_machine), &pmgr_unk_reg_ops,
-                                  (void *)reg[i], name, reg[i + 1]);
+            snprintf(name, 32, "pmgr-unk-reg-%d", i * 2);
+            region = &t8030_machine->pmgr_regions[i - 1];
+            t8030_pmgr_region_init(t8030_machine, region, name, base, size);
+            mem = &region->page.mr;
         } else {
+            mem = g_new(MemoryRegion, 1);
             memory_region_init_io(mem, OBJECT(t8030_machine), &pmgr_reg_ops,
-                                  t8030_machine, "pmgr-reg", reg[i + 1]);
+                                  t8030_machine, "pmgr-reg", size);
         }
         memory_region_add_subregion(get_system_memory(),
-                                    reg[i] + reg[i + 1] <
-                                            t8030_machine->soc_size ?
-                                        t8030_machine->soc_base_pa + reg[i] :
-                                        reg[i],
+                                    base + size < t8030_machine->soc_size ?
+                                        t8030_machine->soc_base_pa + base :
+                                        base,
                                     mem);
     }
 
-    {
-        MemoryRegion *mem = g_new(MemoryRegion, 1);
+    region = &t8030_machine->pmgr_regions[nb_reg - 1];
+    t8030_pmgr_region_init(t8030_machine, region, "pmp-reg", 0x3BC00000,
+                           0x60000);
+    memory_region_add_subregion(get_system_memory(),
+                                t8030_machine->soc_base_pa + 0x3BC00000,
+                                &region->page.mr);
 
-        snprintf(name, 32, "pmp-reg");
-        memory_region_init_io(mem, OBJECT(t8030_machine), &pmgr_unk_reg_ops,
-                              (void *)0x3BC00000, name, 0x60000);
-        memory_region_add_subregion(
-            get_system_memory(), t8030_machine->soc_base_pa + 0x3BC00000, mem);
-    }
     dtb_set_prop(child, "voltage-states5", sizeof(t8030_voltage_states5),
                  t8030_voltage_states5);
     dtb_set_prop(child, "voltage-states9-sram",
@@ -1423,11 +1527,11 @@ static void t8030_amcc_setup(T8030MachineState *t8030_machine)
     dtb_set_prop_u32(child, "lock-reg-mask", 1);
     dtb_set_prop_u32(child, "lock-reg-value", 1);
 
-    memory_region_init_io(&t8030_machine->amcc, OBJECT(t8030_machine),
-                          &amcc_reg_ops, t8030_machine, "amcc",
-                          T8030_AMCC_SIZE);
+    apple_reg_page_init(&t8030_machine->amcc, OBJECT(t8030_machine), "amcc",
+                        T8030_AMCC_SIZE, &amcc_reg_info, t8030_machine);
+    t8030_amcc_update(t8030_machine);
     memory_region_add_subregion(get_system_memory(), T8030_AMCC_BASE,
-                                &t8030_machine->amcc);
+                                &t8030_machine->amcc.mr);
 }
 
 static void t8030_create_dart(T8030MachineState *t8030_machine,
@@ -2326,6 +2430,9 @@ static void t8030_create_display(T8030MachineState *t8030_machine)
     }
 
     object_property_add_child(OBJECT(t8030_machine), "disp0", OBJECT(sbd));
+    apple_pmgr_connect(
+        t8030_machine->pmgr, child,
+        qdev_get_gpio_in_named(DEVICE(sbd), APPLE_PMGR_POWER, 0));
 
     sysbus_realize_and_unref(sbd, &error_fatal);
 }
@@ -2422,6 +2529,13 @@ static void t8030_create_sep(T8030MachineState *t8030_machine)
             qdev_get_gpio_in(DEVICE(t8030_machine->aic), ints[i]));
     }
 
+    for (int i = 0; i < APPLE_SEP_FUSE_CHANGER_COUNT; i++) {
+        qdev_connect_gpio_out_named(
+            DEVICE(sep), APPLE_SEP_FUSE_CHANGER, i,
+            qemu_allocate_irq(t8030_pmgr_fuse_changer, t8030_machine, i));
+    }
+    t8030_machine->sep_cpu = sep->cpu;
+
     sysbus_realize_and_unref(SYS_BUS_DEVICE(sep), &error_fatal);
 }
 
@@ -2511,6 +2625,12 @@ static void t8030_create_mt_spi(T8030MachineState *t8030_machine)
 
     qdev_connect_gpio_out_named(device, APPLE_MT_SPI_IRQ, 0,
                                 qdev_get_gpio_in(aop_gpio, ints[0]));
+
+    // The touch controller is only reachable while its SPI bus is powered.
+    child = dtb_get_node(t8030_machine->device_tree, "arm-io/spi1");
+    g_assert_nonnull(child);
+    apple_pmgr_connect(t8030_machine->pmgr, child,
+                       qdev_get_gpio_in_named(device, APPLE_PMGR_POWER, 0));
 }
 
 static void t8030_create_aop(T8030MachineState *t8030_machine)
@@ -2681,10 +2801,9 @@ static void t8030_machine_reset(MachineState *machine, ResetType type)
         !runstate_check(RUN_STATE_PRELAUNCH)) {
         t8030_memory_setup(t8030_machine);
 
-        pmgr_unk_e4800 = 0;
-        // maybe also reset pmgr_unk_e4000 array
-        // Ah, what the heck. Let's do it.
-        memset(pmgr_unk_e4000, 0, sizeof(pmgr_unk_e4000));
+        for (int i = 0; i < t8030_machine->pmgr_nb_regions; i++) {
+            apple_reg_page_reset(&t8030_machine->pmgr_regions[i].page);
+        }
     }
 
     t8030_cpu_reset(t8030_machine);
@@ -2712,6 +2831,7 @@ static void t8030_machine_init(MachineState *machine)
     DTBNode *child;
     DTBProp *prop;
     hwaddr *ranges;
+    AppleUartLog *uart_log = NULL;
 
     t8030_machine = T8030_MACHINE(machine);
 
@@ -2727,8 +2847,8 @@ static void t8030_machine_init(MachineState *machine)
                  0);
     allocate_ram(get_system_memory(), "SRAM", T8030_SRAM_BASE, T8030_SRAM_SIZE,
                  0);
-    memory_region_add_subregion(get_system_memory(), T8030_DRAM_BASE,
-                                machine->ram);
+    apple_mem_map_ram(get_system_memory(), "DRAM", T8030_DRAM_BASE,
+                      machine->ram, 0);
     if (t8030_machine->sep_rom_filename != NULL) {
         allocate_ram(get_system_memory(), "SEPROM", T8030_SEPROM_BASE,
                      T8030_SEPROM_SIZE, 0);
@@ -2812,7 +2932,7 @@ static void t8030_machine_init(MachineState *machine)
     g_virt_base = kernel_low;
     g_phys_base = (hwaddr)macho_get_buffer(hdr);
 
-    t8030_patch_kernel(hdr, build_version);
+    t8030_patch_kernel(t8030_machine, hdr, build_version);
 
     t8030_machine->device_tree = load_dtb_from_file(machine->dtb);
     if (t8030_machine->device_tree == NULL) {
@@ -2880,13 +3000,17 @@ static void t8030_machine_init(MachineState *machine)
     dtb_set_prop_u32(child, "device-color-policy", 0);
 
     t8030_cpu_setup(t8030_machine);
+    t8030_pmgr_setup(t8030_machine);
     t8030_create_aic(t8030_machine);
 
+    if (t8030_machine->uart_log_filename != NULL) {
+        uart_log =
+            apple_uart_log_open(t8030_machine->uart_log_filename, &error_fatal);
+    }
     for (int i = 0; i < T8030_NUM_UARTS; i++) {
-        t8030_create_s3c_uart(t8030_machine, i, serial_hd(i));
+        t8030_create_s3c_uart(t8030_machine, i, serial_hd(i), uart_log);
     }
 
-    t8030_pmgr_setup(t8030_machine);
     t8030_amcc_setup(t8030_machine);
     t8030_create_gpio(t8030_machine, "gpio");
     t8030_create_gpio(t8030_machine, "smc-gpio");
@@ -2969,6 +3093,7 @@ PROP_STR_GETTER_SETTER(trustcache_filename);
 PROP_STR_GETTER_SETTER(ticket_filename);
 PROP_STR_GETTER_SETTER(sep_rom_filename);
 PROP_STR_GETTER_SETTER(sep_fw_filename);
+PROP_STR_GETTER_SETTER(uart_log_filename);
 
 static void t8030_set_boot_mode(Object *obj, const char *value, Error **errp)
 {
@@ -3033,6 +3158,26 @@ static bool t8030_get_kaslr_off(Object *obj, Error **errp)
     return T8030_MACHINE(obj)->kaslr_off;
 }
 
+static void t8030_set_warm_reboot(Object *obj, bool value, Error **errp)
+{
+    T8030_MACHINE(obj)->warm_reboot = value;
+}
+
+static bool t8030_get_warm_reboot(Object *obj, Error **errp)
+{
+    return T8030_MACHINE(obj)->warm_reboot;
+}
+
+static void t8030_set_amx(Object *obj, bool value, Error **errp)
+{
+    T8030_MACHINE(obj)->amx = value;
+}
+
+static bool t8030_get_amx(Object *obj, Error **errp)
+{
+    return T8030_MACHINE(obj)->amx;
+}
+
 static void t8030_set_force_dfu(Object *obj, bool value, Error **errp)
 {
     T8030_MACHINE(obj)->force_dfu = value;
@@ -3043,6 +3188,52 @@ static bool t8030_get_force_dfu(Object *obj, Error **errp)
     return T8030_MACHINE(obj)->force_dfu;
 }
 
+static bool t8030_visit_core_count(Visitor *v, const char *name,
+                                   uint32_t *count, Error **errp)
+{
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return false;
+    }
+    if (value > A13_MAX_CPU) {
+        error_setg(errp, "%s must be at most %u", name, A13_MAX_CPU);
+        return false;
+    }
+    *count = value;
+    return true;
+}
+
+static void t8030_get_e_cores(Object *obj, Visitor *v, const char *name,
+                              void *opaque, Error **errp)
+{
+    uint32_t value;
+
+    value = T8030_MACHINE(obj)->e_cores;
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void t8030_set_e_cores(Object *obj, Visitor *v, const char *name,
+                              void *opaque, Error **errp)
+{
+    t8030_visit_core_count(v, name, &T8030_MACHINE(obj)->e_cores, errp);
+}
+
+static void t8030_get_p_cores(Object *obj, Visitor *v, const char *name,
+                              void *opaque, Error **errp)
+{
+    uint32_t value;
+
+    value = T8030_MACHINE(obj)->p_cores;
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void t8030_set_p_cores(Object *obj, Visitor *v, const char *name,
+                              void *opaque, Error **errp)
+{
+    t8030_visit_core_count(v, name, &T8030_MACHINE(obj)->p_cores, errp);
+}
+
 static void t8030_set_usb_conn_type(Object *obj, int value, Error **errp)
 {
     T8030_MACHINE(obj)->usb_conn_type = value;
@@ -3113,6 +3304,13 @@ static void t8030_machine_class_init(ObjectClass *klass, void *data)
     object_class_property_add_str(klass, "sep-fw", t8030_get_sep_fw_filename,
                                   t8030_set_sep_fw_filename);
     object_class_property_set_description(klass, "sep-fw", "SEP Firmware");
+    object_class_property_add_str(klass, "uart-log",
+                                  t8030_get_uart_log_filename,
+                                  t8030_set_uart_log_filename);
+    object_class_property_set_description(
+        klass, "uart-log",
+        "Write the output of all UARTs to this file as one timestamped "
+        "binary log (see scripts/apple-uart-log-split.py)");
     oprop = object_class_property_add_str(
         klass, "boot-mode", t8030_get_boot_mode, t8030_set_boot_mode);
     object_property_set_default_str(oprop, "auto");
@@ -3124,6 +3322,28 @@ static void t8030_machine_class_init(ObjectClass *klass, void *data)
     object_class_property_add_bool(klass, "kaslr-off", t8030_get_kaslr_off,
                                    t8030_set_kaslr_off);
     object_class_property_set_description(klass, "kaslr-off", "Disable KASLR");
+    oprop = object_class_property_add_bool(
+        klass, "warm-reboot", t8030_get_warm_reboot, t8030_set_warm_reboot);
+    object_property_set_default_bool(oprop, true);
+    object_class_property_set_description(
+        klass, "warm-reboot",
+        "Keep a copy of the boot image in host memory and restore it on "
+        "guest reboots instead of loading it again");
+    object_class_property_add_bool(klass, "amx", t8030_get_amx, t8030_set_amx);
+    object_class_property_set_description(
+        klass, "amx", "Expose the AMX coprocessor to the guest");
+    oprop = object_class_property_add(klass, "e-cores", "uint32",
+                                      t8030_get_e_cores, t8030_set_e_cores,
+                                      NULL, NULL);
+    object_property_set_default_uint(oprop, A13_MAX_CPU);
+    object_class_property_set_description(
+        klass, "e-cores", "Maximum number of efficiency cores");
+    oprop = object_class_property_add(klass, "p-cores", "uint32",
+                                      t8030_get_p_cores, t8030_set_p_cores,
+                                      NULL, NULL);
+    object_property_set_default_uint(oprop, A13_MAX_CPU);
+    object_class_property_set_description(
+        klass, "p-cores", "Maximum number of performance cores");
     object_class_property_add_bool(klass, "force-dfu", t8030_get_force_dfu,
                                    t8030_set_force_dfu);
     object_class_property_set_description(klass, "force-dfu", "Force DFU");
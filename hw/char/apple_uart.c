@@ -31,6 +31,7 @@
 
 #include "hw/char/apple_uart.h"
 #include "hw/irq.h"
+#include "hw/misc/apple-silicon/pmgr.h"
 #include "hw/qdev-properties-system.h"
 #include "hw/qdev-properties.h"
 
@@ -155,6 +156,8 @@ struct AppleUartState {
 
     QEMUTimer *fifo_timeout_timer;
     uint64_t wordtime; /* word time in ns */
+    /* Cleared while the PMGR domain is off */
+    bool powered;
 
     CharBackend chr;
     qemu_irq irq;
@@ -162,6 +165,9 @@ struct AppleUartState {
 
     uint32_t channel;
     uint32_t last_irq;
+
+    AppleUartLog *log;
+    uint8_t log_channel;
 };
 
 
@@ -373,10 +379,13 @@ static void apple_uart_write(void *opaque, hwaddr offset, uint64_t val,
         break;
 
     case UTXH:
+        ch = (uint8_t)val;
+        if (s->log != NULL) {
+            apple_uart_log_putc(s->log, s->log_channel, ch);
+        }
         if (qemu_chr_fe_backend_connected(&s->chr)) {
             s->reg[I_(UTRSTAT)] &=
                 ~(UTRSTAT_Tx_EMPTY | UTRSTAT_Tx_BUFFER_EMPTY);
-            ch = (uint8_t)val;
             /* XXX this blocks entire thread. Rewrite to use
              * qemu_chr_fe_write and background I/O callbacks */
             qemu_chr_fe_write_all(&s->chr, &ch, 1);
@@ -479,6 +488,11 @@ static int apple_uart_can_receive(void *opaque)
 {
     AppleUartState *s = (AppleUartState *)opaque;
 
+    /* Input waits in the backend until the domain is powered again */
+    if (!s->powered) {
+        return 0;
+    }
+
     if (s->reg[I_(UFCON)] & UFCON_FIFO_ENABLE) {
         return fifo8_num_free(&s->rx);
     } else {
@@ -521,11 +535,32 @@ static void apple_uart_event(void *opaque, QEMUChrEvent event)
 }
 
 
+static void apple_uart_set_power(void *opaque, int n, int level)
+{
+    AppleUartState *s = APPLE_UART(opaque);
+
+    if (s->powered == !!level) {
+        return;
+    }
+    s->powered = level;
+
+    if (level) {
+        if (!fifo8_is_empty(&s->rx)) {
+            apple_uart_rx_timeout_set(s);
+        }
+        qemu_chr_fe_accept_input(&s->chr);
+    } else {
+        timer_del(s->fifo_timeout_timer);
+    }
+}
+
 static void apple_uart_reset(DeviceState *dev)
 {
     AppleUartState *s = APPLE_UART(dev);
     int i;
 
+    s->powered = true;
+
     for (i = 0; i < ARRAY_SIZE(apple_uart_regs); i++) {
         s->reg[I_(apple_uart_regs[i].offset)] = apple_uart_regs[i].reset_value;
     }
@@ -541,11 +576,32 @@ static int apple_uart_post_load(void *opaque, int version_id)
     AppleUartState *s = APPLE_UART(opaque);
 
     apple_uart_update_parameters(s);
-    apple_uart_rx_timeout_set(s);
+    if (s->powered) {
+        apple_uart_rx_timeout_set(s);
+    }
 
     return 0;
 }
 
+static bool apple_uart_power_needed(void *opaque)
+{
+    AppleUartState *s = APPLE_UART(opaque);
+
+    return !s->powered;
+}
+
+static const VMStateDescription vmstate_apple_uart_power = {
+    .name = "apple.uart/power",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = apple_uart_power_needed,
+    .fields =
+        (const VMStateField[]){
+            VMSTATE_BOOL(powered, AppleUartState),
+            VMSTATE_END_OF_LIST(),
+        }
+};
+
 static const VMStateDescription vmstate_apple_uart = {
     .name = "apple.uart",
     .version_id = 1,
@@ -557,6 +613,11 @@ static const VMStateDescription vmstate_apple_uart = {
             VMSTATE_UINT32_ARRAY(reg, AppleUartState,
                                  APPLE_UART_REGS_MEM_SIZE / sizeof(uint32_t)),
             VMSTATE_END_OF_LIST(),
+        },
+    .subsections =
+        (const VMStateDescription *const[]){
+            &vmstate_apple_uart_power,
+            NULL,
         }
 };
 
@@ -583,12 +644,22 @@ DeviceState *apple_uart_create(hwaddr addr, int fifo_size, int channel,
     return dev;
 }
 
+void apple_uart_set_log(DeviceState *dev, AppleUartLog *log, uint8_t channel)
+{
+    AppleUartState *s = APPLE_UART(dev);
+
+    g_assert_cmpuint(channel, <, APPLE_UART_LOG_MAX_CHANNELS);
+    s->log = log;
+    s->log_channel = channel;
+}
+
 static void apple_uart_init(Object *obj)
 {
     SysBusDevice *dev = SYS_BUS_DEVICE(obj);
     AppleUartState *s = APPLE_UART(dev);
 
     s->wordtime = NANOSECONDS_PER_SECOND * 10 / 115200;
+    s->powered = true;
 
     /* memory mapping */
     memory_region_init_io(&s->iomem, obj, &apple_uart_ops, s, "apple.uart",
@@ -597,6 +668,8 @@ static void apple_uart_init(Object *obj)
 
     sysbus_init_irq(dev, &s->irq);
     sysbus_init_irq(dev, &s->dmairq);
+    qdev_init_gpio_in_named(DEVICE(obj), apple_uart_set_power,
+                            APPLE_PMGR_POWER, 1);
 }
 
 static void apple_uart_realize(DeviceState *dev, Error **errp)
@@ -0,0 +1,263 @@
+/*
+ *  Apple UART binary log
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "hw/char/apple_uart.h"
+#include "qapi/error.h"
+#include "qemu/bswap.h"
+#include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/notify.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include "system/system.h"
+
+/*
+ * The log starts with APPLE_UART_LOG_MAGIC, followed by records of
+ *
+ *   le64 host time of the first byte, in ns since the epoch
+ *   u8   channel
+ *   u8   flags
+ *   le16 payload length
+ *   payload
+ *
+ * Output is buffered per channel and turned into a record at every newline,
+ * when the buffer fills up, or when it has been idle for a while.  Records
+ * go through a ring that a background thread writes out.  When the ring is
+ * full, records are dropped and the next one that fits is flagged, so a
+ * slow log never stalls the guest.
+ */
+#define APPLE_UART_LOG_MAGIC "AUARTLG1"
+#define APPLE_UART_LOG_HDR_SIZE (12)
+#define APPLE_UART_LOG_FLAG_DROPPED (1 << 0)
+
+#define APPLE_UART_LOG_RING_SIZE (1 * MiB)
+#define APPLE_UART_LOG_LINE_MAX (256)
+#define APPLE_UART_LOG_IDLE_NS (50 * SCALE_MS)
+
+typedef struct {
+    uint8_t buf[APPLE_UART_LOG_LINE_MAX];
+    uint16_t len;
+    int64_t ts;
+    // QEMU_CLOCK_REALTIME of the last byte, for the idle flush.
+    int64_t last;
+} AppleUartLogLine;
+
+struct AppleUartLog {
+    int fd;
+    QemuThread thread;
+    QemuMutex lock;
+    QemuCond cond;
+    uint8_t *ring;
+    // Free-running offsets, the ring holds [tail, head).
+    uint64_t head;
+    uint64_t tail;
+    bool drop_pending;
+    bool write_failed;
+    bool stopping;
+    uint64_t dropped;
+    // Only touched by the UARTs and the flush timer, under the BQL.
+    AppleUartLogLine lines[APPLE_UART_LOG_MAX_CHANNELS];
+    QEMUTimer *flush_timer;
+    Notifier exit_notifier;
+};
+
+static void apple_uart_log_ring_put(AppleUartLog *log, const void *data,
+                                    size_t len)
+{
+    size_t off = log->head % APPLE_UART_LOG_RING_SIZE;
+    size_t first = MIN(len, APPLE_UART_LOG_RING_SIZE - off);
+
+    memcpy(log->ring + off, data, first);
+    memcpy(log->ring, (const uint8_t *)data + first, len - first);
+    log->head += len;
+}
+
+static void apple_uart_log_commit(AppleUartLog *log, uint8_t channel)
+{
+    AppleUartLogLine *line = &log->lines[channel];
+    uint8_t hdr[APPLE_UART_LOG_HDR_SIZE];
+    size_t total = sizeof(hdr) + line->len;
+
+    if (line->len == 0) {
+        return;
+    }
+
+    WITH_QEMU_LOCK_GUARD(&log->lock)
+    {
+        if (APPLE_UART_LOG_RING_SIZE - (log->head - log->tail) < total) {
+            log->dropped++;
+            log->drop_pending = true;
+        } else {
+            stq_le_p(hdr, line->ts);
+            hdr[8] = channel;
+            hdr[9] = log->drop_pending ? APPLE_UART_LOG_FLAG_DROPPED : 0;
+            stw_le_p(hdr + 10, line->len);
+            apple_uart_log_ring_put(log, hdr, sizeof(hdr));
+            apple_uart_log_ring_put(log, line->buf, line->len);
+            log->drop_pending = false;
+            qemu_cond_signal(&log->cond);
+        }
+    }
+    line->len = 0;
+}
+
+static void apple_uart_log_flush_lines(AppleUartLog *log)
+{
+    int i;
+
+    for (i = 0; i < APPLE_UART_LOG_MAX_CHANNELS; i++) {
+        apple_uart_log_commit(log, i);
+    }
+}
+
+// Commits the lines that have been idle long enough, and waits for the rest.
+static void apple_uart_log_flush_timer(void *opaque)
+{
+    AppleUartLog *log = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t next = INT64_MAX;
+    AppleUartLogLine *line;
+    int i;
+
+    for (i = 0; i < APPLE_UART_LOG_MAX_CHANNELS; i++) {
+        line = &log->lines[i];
+        if (line->len == 0) {
+            continue;
+        }
+        if (now - line->last >= APPLE_UART_LOG_IDLE_NS) {
+            apple_uart_log_commit(log, i);
+        } else {
+            next = MIN(next, line->last + APPLE_UART_LOG_IDLE_NS);
+        }
+    }
+    if (next != INT64_MAX) {
+        timer_mod(log->flush_timer, next);
+    }
+}
+
+void apple_uart_log_putc(AppleUartLog *log, uint8_t channel, uint8_t ch)
+{
+    AppleUartLogLine *line;
+
+    g_assert_cmpuint(channel, <, APPLE_UART_LOG_MAX_CHANNELS);
+    line = &log->lines[channel];
+
+    if (line->len == 0) {
+        line->ts = qemu_clock_get_ns(QEMU_CLOCK_HOST);
+    }
+    line->buf[line->len++] = ch;
+
+    if (ch == '\n' || line->len == sizeof(line->buf)) {
+        apple_uart_log_commit(log, channel);
+        return;
+    }
+
+    // Every byte pushes the channel's flush back, the timer catches up
+    // with the latest deadline when it fires.
+    line->last = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    if (!timer_pending(log->flush_timer)) {
+        timer_mod(log->flush_timer, line->last + APPLE_UART_LOG_IDLE_NS);
+    }
+}
+
+static void *apple_uart_log_thread(void *opaque)
+{
+    AppleUartLog *log = opaque;
+    uint64_t off;
+    size_t len;
+
+    qemu_mutex_lock(&log->lock);
+    for (;;) {
+        while (log->head == log->tail && !log->stopping) {
+            qemu_cond_wait(&log->cond, &log->lock);
+        }
+        if (log->head == log->tail) {
+            break;
+        }
+        off = log->tail % APPLE_UART_LOG_RING_SIZE;
+        len = MIN(log->head - log->tail, APPLE_UART_LOG_RING_SIZE - off);
+        qemu_mutex_unlock(&log->lock);
+
+        // The producers never touch [tail, head), so write it unlocked.
+        if (qemu_write_full(log->fd, log->ring + off, len) != len &&
+            !log->write_failed) {
+            log->write_failed = true;
+            error_report("apple-uart-log: write failed: %s", strerror(errno));
+        }
+
+        qemu_mutex_lock(&log->lock);
+        log->tail += len;
+    }
+    qemu_mutex_unlock(&log->lock);
+
+    return NULL;
+}
+
+static void apple_uart_log_exit(Notifier *n, void *data)
+{
+    AppleUartLog *log = container_of(n, AppleUartLog, exit_notifier);
+
+    apple_uart_log_flush_lines(log);
+
+    WITH_QEMU_LOCK_GUARD(&log->lock)
+    {
+        log->stopping = true;
+        qemu_cond_signal(&log->cond);
+    }
+    qemu_thread_join(&log->thread);
+
+    if (log->dropped) {
+        warn_report("apple-uart-log: %" PRIu64 " records dropped",
+                    log->dropped);
+    }
+    close(log->fd);
+}
+
+AppleUartLog *apple_uart_log_open(const char *path, Error **errp)
+{
+    AppleUartLog *log;
+    int fd;
+
+    fd = qemu_create(path, O_WRONLY | O_TRUNC | O_BINARY, 0644, errp);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (qemu_write_full(fd, APPLE_UART_LOG_MAGIC,
+                        strlen(APPLE_UART_LOG_MAGIC)) !=
+        strlen(APPLE_UART_LOG_MAGIC)) {
+        error_setg_errno(errp, errno, "failed to write to '%s'", path);
+        close(fd);
+        return NULL;
+    }
+
+    log = g_new0(AppleUartLog, 1);
+    log->fd = fd;
+    log->ring = g_malloc(APPLE_UART_LOG_RING_SIZE);
+    qemu_mutex_init(&log->lock);
+    qemu_cond_init(&log->cond);
+    log->flush_timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                    apple_uart_log_flush_timer, log);
+    log->exit_notifier.notify = apple_uart_log_exit;
+    qemu_add_exit_notifier(&log->exit_notifier);
+    qemu_thread_create(&log->thread, "apple-uart-log", apple_uart_log_thread,
+                       log, QEMU_THREAD_JOINABLE);
+
+    return log;
+}
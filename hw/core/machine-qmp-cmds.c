@@ -8,6 +8,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "exec/memory.h"
 #include "hw/acpi/vmgenid.h"
 #include "hw/boards.h"
 #include "hw/intc/intc.h"
@@ -319,6 +320,25 @@ HumanReadableText *qmp_x_query_ramblock(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+void qmp_x_mtree_profile(bool enable, bool has_reset, bool reset,
+                         Error **errp)
+{
+    if (has_reset && reset) {
+        mtree_profile_reset();
+    }
+    mtree_profile_enable(enable);
+}
+
+HumanReadableText *qmp_x_query_mtree_profile(bool has_folded, bool folded,
+                                             bool has_max, uint32_t max,
+                                             Error **errp)
+{
+    g_autoptr(GString) buf = mtree_profile_format(has_folded && folded,
+                                                  has_max ? max : 0);
+
+    return human_readable_text_from_str(buf);
+}
+
 static int qmp_x_query_irq_foreach(Object *obj, void *opaque)
 {
     InterruptStatsProvider *intc;
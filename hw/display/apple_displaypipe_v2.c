@@ -19,9 +19,14 @@
 
 #include "qemu/osdep.h"
 #include "hw/display/apple_displaypipe_v2.h"
+#include "hw/irq.h"
+#include "hw/misc/apple-silicon/pmgr.h"
 #include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
 #include "qemu/log.h"
+#include "qemu/timer.h"
 #include "ui/console.h"
 #include "framebuffer.h"
 
@@ -45,6 +50,18 @@ struct AppleDisplayPipeV2State {
 
     DisplayBackEndState dbe_state;
     QemuConsole *console;
+
+    // Vertical frame timing generator, paces scanout while enabled.
+    uint32_t refresh_rate;
+    int32_t vblank_irq;
+    // Only armed when there is a vblank IRQ to pulse.
+    QEMUTimer *vftg_timer;
+    // Frames generated before the VFTG last (re)started at vftg_start.
+    uint64_t vftg_frames;
+    int64_t vftg_start;
+    uint64_t scanout_frame;
+    // Cleared while the PMGR domain is off, which stops the VFTG.
+    bool powered;
 };
 
 #define REG_SPDS_VERSION (0x1014)
@@ -60,6 +77,73 @@ struct AppleDisplayPipeV2State {
 #define REG_DBE_BACK_PORCH (0x18)
 #define REG_DBE_CONST_COLOUR (0x34)
 
+static bool adp_v2_vftg_running(AppleDisplayPipeV2State *s)
+{
+    return s->powered && (s->dbe_state.vftg_ctl & DBE_VFTG_CTRL_VFTG_ENABLE);
+}
+
+// Frames generated so far, derived from the virtual clock.
+static uint64_t adp_v2_frame_count(AppleDisplayPipeV2State *s)
+{
+    int64_t period = NANOSECONDS_PER_SECOND / s->refresh_rate;
+
+    if (!adp_v2_vftg_running(s)) {
+        return s->vftg_frames;
+    }
+    return s->vftg_frames +
+           (qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - s->vftg_start) / period;
+}
+
+// Called before anything that may start or stop the VFTG.
+static void adp_v2_vftg_sync(AppleDisplayPipeV2State *s)
+{
+    s->vftg_frames = adp_v2_frame_count(s);
+    s->vftg_start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+}
+
+// Arms the vblank timer for the end of the current frame.
+static void adp_v2_vftg_update(AppleDisplayPipeV2State *s)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t period = NANOSECONDS_PER_SECOND / s->refresh_rate;
+
+    if (!adp_v2_vftg_running(s) || s->vblank_irq < 0) {
+        timer_del(s->vftg_timer);
+        return;
+    }
+
+    timer_mod(s->vftg_timer,
+              s->vftg_start + ((now - s->vftg_start) / period + 1) * period);
+}
+
+static void adp_v2_vblank(void *opaque)
+{
+    AppleDisplayPipeV2State *s = opaque;
+
+    qemu_irq_pulse(s->irqs[s->vblank_irq]);
+    adp_v2_vftg_update(s);
+}
+
+static void adp_v2_set_power(void *opaque, int n, int level)
+{
+    AppleDisplayPipeV2State *s = opaque;
+
+    if (s->powered == !!level) {
+        return;
+    }
+    adp_v2_vftg_sync(s);
+    s->powered = level;
+    adp_v2_vftg_update(s);
+}
+
+static void adp_v2_get_frames(Object *obj, Visitor *v, const char *name,
+                              void *opaque, Error **errp)
+{
+    uint64_t frames = adp_v2_frame_count(APPLE_DISPLAY_PIPE_V2(obj));
+
+    visit_type_uint64(v, name, &frames, errp);
+}
+
 static void frontend_write(void *opaque, hwaddr addr, uint64_t data,
                            unsigned size)
 {
@@ -113,7 +197,13 @@ static void backend_write(void *opaque, hwaddr addr, uint64_t data,
         if (data & DBE_VFTG_CTRL_VFTG_ENABLE) {
             data |= DBE_VFTG_CTRL_VFTG_STATUS;
         }
-        s->dbe_state.vftg_ctl = (uint32_t)data;
+        if ((data ^ s->dbe_state.vftg_ctl) & DBE_VFTG_CTRL_VFTG_ENABLE) {
+            adp_v2_vftg_sync(s);
+            s->dbe_state.vftg_ctl = (uint32_t)data;
+            adp_v2_vftg_update(s);
+        } else {
+            s->dbe_state.vftg_ctl = (uint32_t)data;
+        }
         break;
     case REG_DBE_SCREEN_SIZE:
         qemu_log_mask(LOG_GUEST_ERROR,
@@ -238,6 +328,13 @@ static void adp_v2_gfx_update(void *opaque)
     int stride = s->width * sizeof(uint32_t);
 
     int first = 0, last = 0;
+    uint64_t frame = adp_v2_frame_count(s);
+
+    // Scan out at most once per generated frame.
+    if (frame == s->scanout_frame) {
+        return;
+    }
+    s->scanout_frame = frame;
 
     if (!s->vram_section.mr) {
         framebuffer_update_memory_section(&s->vram_section, &s->vram, 0,
@@ -259,18 +356,42 @@ static void adp_v2_realize(DeviceState *dev, Error **errp)
 {
     AppleDisplayPipeV2State *s = APPLE_DISPLAY_PIPE_V2(dev);
 
+    if (s->refresh_rate == 0 || s->refresh_rate > 240) {
+        error_setg(errp, "refresh-rate must be between 1 and 240");
+        return;
+    }
+    if (s->vblank_irq >= (int32_t)ARRAY_SIZE(s->irqs)) {
+        error_setg(errp, "vblank-irq must be below %zu", ARRAY_SIZE(s->irqs));
+        return;
+    }
+
     memset(&s->dbe_state, 0, sizeof(s->dbe_state));
     s->dbe_state.vftg_ctl =
         DBE_VFTG_CTRL_VFTG_ENABLE | DBE_VFTG_CTRL_VFTG_STATUS |
         DBE_VFTG_CTRL_UPDATE_ENABLE_TIMING | DBE_VFTG_CTRL_UPDATE_REQ_TIMING;
     s->console = graphic_console_init(dev, 0, &adp_v2_ops, s);
     qemu_console_resize(s->console, s->width, s->height);
+
+    s->vftg_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, adp_v2_vblank, s);
+    object_property_add(OBJECT(dev), "frames", "uint64", adp_v2_get_frames,
+                        NULL, NULL, NULL);
+    s->vftg_start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    adp_v2_vftg_update(s);
+}
+
+static void adp_v2_reset(DeviceState *dev)
+{
+    adp_v2_set_power(APPLE_DISPLAY_PIPE_V2(dev), 0, 1);
 }
 
 static const Property adp_v2_props[] = {
     // iPhone 4/4S
     DEFINE_PROP_UINT32("width", AppleDisplayPipeV2State, width, 640),
     DEFINE_PROP_UINT32("height", AppleDisplayPipeV2State, height, 960),
+    DEFINE_PROP_UINT32("refresh-rate", AppleDisplayPipeV2State, refresh_rate,
+                       60),
+    // The interrupt status layout is unknown, so no vblank IRQ by default.
+    DEFINE_PROP_INT32("vblank-irq", AppleDisplayPipeV2State, vblank_irq, -1),
 };
 
 static const VMStateDescription vmstate_adp_v2_dbe = {
@@ -285,10 +406,39 @@ static const VMStateDescription vmstate_adp_v2_dbe = {
         },
 };
 
+static int adp_v2_post_load(void *opaque, int version_id)
+{
+    AppleDisplayPipeV2State *s = opaque;
+
+    s->vftg_start = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    adp_v2_vftg_update(s);
+    return 0;
+}
+
+static bool adp_v2_power_needed(void *opaque)
+{
+    AppleDisplayPipeV2State *s = opaque;
+
+    return !s->powered;
+}
+
+static const VMStateDescription vmstate_adp_v2_power = {
+    .name = "Apple Display Pipe V2 State/power",
+    .version_id = 0,
+    .minimum_version_id = 0,
+    .needed = adp_v2_power_needed,
+    .fields =
+        (const VMStateField[]){
+            VMSTATE_BOOL(powered, AppleDisplayPipeV2State),
+            VMSTATE_END_OF_LIST(),
+        },
+};
+
 static const VMStateDescription vmstate_adp_v2 = {
     .name = "Apple Display Pipe V2 State",
     .version_id = 0,
     .minimum_version_id = 0,
+    .post_load = adp_v2_post_load,
     .fields =
         (const VMStateField[]){
             VMSTATE_UINT32(width, AppleDisplayPipeV2State),
@@ -297,6 +447,11 @@ static const VMStateDescription vmstate_adp_v2 = {
                            vmstate_adp_v2_dbe, DisplayBackEndState),
             VMSTATE_END_OF_LIST(),
         },
+    .subsections =
+        (const VMStateDescription *const[]){
+            &vmstate_adp_v2_power,
+            NULL,
+        },
 };
 
 static void adp_v2_class_init(ObjectClass *klass, void *data)
@@ -304,6 +459,7 @@ static void adp_v2_class_init(ObjectClass *klass, void *data)
     DeviceClass *dc = DEVICE_CLASS(klass);
 
     dc->realize = adp_v2_realize;
+    device_class_set_legacy_reset(dc, adp_v2_reset);
     dc->vmsd = &vmstate_adp_v2;
     device_class_set_props(dc, adp_v2_props);
     set_bit(DEVICE_CATEGORY_DISPLAY, dc->categories);
@@ -398,6 +554,9 @@ SysBusDevice *adp_v2_create(DTBNode *node, MemoryRegion *dma_mr,
         sysbus_init_irq(sbd, &s->irqs[i]);
     }
 
+    s->powered = true;
+    qdev_init_gpio_in_named(dev, adp_v2_set_power, APPLE_PMGR_POWER, 1);
+
     return sbd;
 }
 
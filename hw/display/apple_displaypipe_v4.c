@@ -21,6 +21,7 @@
 #include "qemu/osdep.h"
 #include "hw/display/apple_displaypipe_v4.h"
 #include "hw/irq.h"
+#include "hw/misc/apple-silicon/pmgr.h"
 #include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
 #include "qemu/log.h"
@@ -125,6 +126,9 @@ struct AppleDisplayPipeV4State {
     QemuConsole *console;
     QEMUBH *update_disp_image_bh;
     bool invalidated;
+    // Cleared while the PMGR domain is off, which stops composition and
+    // scanout.
+    bool powered;
 };
 
 #define REG_CONTROL_INT_STATUS (0x45818)
@@ -212,12 +216,12 @@ static pixman_format_code_t adp_v4_gp_fmt_to_pixman(ADPV4GenPipeState *s)
     if ((s->pixel_format & GP_PIXEL_FORMAT_BGRA) == GP_PIXEL_FORMAT_BGRA) {
         ADP_INFO("gp%d: pixel format is BGRA (0x%X).", s->index,
                  s->pixel_format);
-        return PIXMAN_b8g8r8a8;
+        return PIXMAN_BE_a8r8g8b8;
     } else if ((s->pixel_format & GP_PIXEL_FORMAT_ARGB) ==
                GP_PIXEL_FORMAT_ARGB) {
         ADP_INFO("gp%d: pixel format is ARGB (0x%X).", s->index,
                  s->pixel_format);
-        return PIXMAN_a8r8g8b8;
+        return PIXMAN_LE_a8r8g8b8;
     } else {
         qemu_log_mask(LOG_GUEST_ERROR,
                       "gp%d: pixel format is unknown (0x%X).\n", s->index,
@@ -426,6 +430,11 @@ static void adp_v4_blend_reset(ADPV4BlendUnitState *s)
 
 static void adp_v4_update_disp_image(AppleDisplayPipeV4State *s)
 {
+    // Dirty layers are composed once the domain is powered again.
+    if (!s->powered) {
+        return;
+    }
+
     if (!s->blend_unit.dirty && !s->generic_pipe[0].dirty &&
         !s->generic_pipe[1].dirty) {
         return;
@@ -526,17 +535,6 @@ static const MemoryRegionOps adp_v4_reg_ops = {
     .valid.unaligned = false,
 };
 
-static void adp_v4_draw_row(void *opaque, uint8_t *dest, const uint8_t *src,
-                            int width, int dest_pitch)
-{
-    while (width--) {
-        uint32_t colour = ldl_le_p(src);
-        memcpy(dest, &colour, sizeof(colour));
-        src += sizeof(colour);
-        dest += sizeof(colour);
-    }
-}
-
 static void adp_v4_invalidate(void *opaque)
 {
     AppleDisplayPipeV4State *s = APPLE_DISPLAY_PIPE_V4(opaque);
@@ -546,25 +544,73 @@ static void adp_v4_invalidate(void *opaque)
     s->invalidated = true;
 }
 
+/*
+ * The blended output in VRAM is little-endian x8r8g8b8, like any guest
+ * framebuffer, so the console surface is backed by VRAM directly instead
+ * of being a copy.
+ */
+static bool adp_v4_update_surface(AppleDisplayPipeV4State *s)
+{
+    int stride = s->width * sizeof(uint32_t);
+    DisplaySurface *surface;
+
+    framebuffer_update_memory_section(&s->vram_section, s->vram_mr,
+                                      s->vram_off, s->height, stride);
+    if (s->vram_section.mr == NULL) {
+        qemu_console_resize(s->console, s->width, s->height);
+        return false;
+    }
+
+    surface = qemu_create_displaysurface_from(
+        s->width, s->height, PIXMAN_LE_x8r8g8b8, stride,
+        memory_region_get_ram_ptr(s->vram_section.mr) +
+            s->vram_section.offset_within_region);
+    dpy_gfx_replace_surface(s->console, surface);
+    return true;
+}
+
 static void adp_v4_gfx_update(void *opaque)
 {
     AppleDisplayPipeV4State *s = APPLE_DISPLAY_PIPE_V4(opaque);
-    DisplaySurface *surface = qemu_console_surface(s->console);
-
+    MemoryRegion *mr;
+    DirtyBitmapSnapshot *snap;
+    hwaddr addr;
     int stride = s->width * sizeof(uint32_t);
-    int first = 0, last = 0;
+    int first = -1;
+    bool full = false;
+    int y;
+
+    if (!s->powered) {
+        return;
+    }
 
     if (s->invalidated) {
-        framebuffer_update_memory_section(&s->vram_section, s->vram_mr,
-                                          s->vram_off, s->height, stride);
+        full = adp_v4_update_surface(s);
         s->invalidated = false;
     }
 
-    framebuffer_update_display(surface, &s->vram_section, s->width, s->height,
-                               stride, stride, 0, 0, adp_v4_draw_row, s, &first,
-                               &last);
-    if (first >= 0) {
-        dpy_gfx_update(s->console, 0, first, s->width, last - first + 1);
+    mr = s->vram_section.mr;
+    if (mr != NULL) {
+        addr = s->vram_section.offset_within_region;
+        snap = memory_region_snapshot_and_clear_dirty(
+            mr, addr, stride * s->height, DIRTY_MEMORY_VGA);
+
+        // Report every band of dirty rows as its own damage rectangle.
+        for (y = 0; y < s->height; y++, addr += stride) {
+            if (full ||
+                memory_region_snapshot_get_dirty(mr, snap, addr, stride)) {
+                if (first < 0) {
+                    first = y;
+                }
+            } else if (first >= 0) {
+                dpy_gfx_update(s->console, 0, first, s->width, y - first);
+                first = -1;
+            }
+        }
+        if (first >= 0) {
+            dpy_gfx_update(s->console, 0, first, s->width, s->height - first);
+        }
+        g_free(snap);
     }
 
     s->int_status |= CONTROL_INT_STATUS_VBLANK;
@@ -604,16 +650,31 @@ static void adp_v4_update_disp_image_ptr(AppleDisplayPipeV4State *s)
 {
     qemu_pixman_image_unref(s->disp_image);
     s->disp_image = pixman_image_create_bits(
-        PIXMAN_a8r8g8b8, s->width, s->height, (uint32_t *)adp_v4_get_ram_ptr(s),
+        PIXMAN_LE_a8r8g8b8, s->width, s->height,
+        (uint32_t *)adp_v4_get_ram_ptr(s),
         s->width * sizeof(uint32_t));
 }
 
+static void adp_v4_set_power(void *opaque, int n, int level)
+{
+    AppleDisplayPipeV4State *s = APPLE_DISPLAY_PIPE_V4(opaque);
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    s->powered = level;
+    if (level) {
+        s->invalidated = true;
+        adp_v4_update_disp_image(s);
+    }
+}
+
 static void adp_v4_reset_hold(Object *obj, ResetType type)
 {
     AppleDisplayPipeV4State *s = APPLE_DISPLAY_PIPE_V4(obj);
 
     QEMU_LOCK_GUARD(&s->lock);
 
+    s->powered = true;
     s->invalidated = true;
     s->int_status = 0;
 
@@ -682,6 +743,25 @@ static const VMStateDescription vmstate_adp_v4_blend_unit = {
         },
 };
 
+static bool adp_v4_power_needed(void *opaque)
+{
+    AppleDisplayPipeV4State *s = APPLE_DISPLAY_PIPE_V4(opaque);
+
+    return !s->powered;
+}
+
+static const VMStateDescription vmstate_adp_v4_power = {
+    .name = "Apple Display Pipe V4 State/power",
+    .version_id = 0,
+    .minimum_version_id = 0,
+    .needed = adp_v4_power_needed,
+    .fields =
+        (const VMStateField[]){
+            VMSTATE_BOOL(powered, AppleDisplayPipeV4State),
+            VMSTATE_END_OF_LIST(),
+        },
+};
+
 static const VMStateDescription vmstate_adp_v4 = {
     .name = "Apple Display Pipe V4 State",
     .version_id = 0,
@@ -699,6 +779,11 @@ static const VMStateDescription vmstate_adp_v4 = {
             VMSTATE_BOOL(invalidated, AppleDisplayPipeV4State),
             VMSTATE_END_OF_LIST(),
         },
+    .subsections =
+        (const VMStateDescription *const[]){
+            &vmstate_adp_v4_power,
+            NULL,
+        },
 };
 
 static void adp_v4_class_init(ObjectClass *klass, void *data)
@@ -885,6 +970,9 @@ SysBusDevice *adp_v4_create(DTBNode *node, MemoryRegion *dma_mr,
         sysbus_init_irq(sbd, &s->irqs[i]);
     }
 
+    s->powered = true;
+    qdev_init_gpio_in_named(dev, adp_v4_set_power, APPLE_PMGR_POWER, 1);
+
     return sbd;
 }
 
@@ -2,11 +2,13 @@
 #include "hw/arm/apple-silicon/dtb.h"
 #include "hw/intc/apple_aic.h"
 #include "hw/irq.h"
+#include "hw/misc/apple-silicon/pmgr.h"
 #include "hw/pci/msi.h"
 #include "migration/vmstate.h"
 #include "qemu/bitops.h"
 #include "qemu/lockable.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/module.h"
 #include "qemu/timer.h"
 #include "trace.h"
@@ -111,6 +113,51 @@ static inline uint64_t apple_aic_emulate_timer(void)
     return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) / period_ns;
 }
 
+/*
+ * The AIC registers are accessed without the BQL; all state, including the
+ * wanted level of each cpu's IRQ line, is protected by the AIC mutex.  Line
+ * changes are only recorded under the mutex and applied afterwards by
+ * apple_aic_flush_irqs(), which needs the BQL to interrupt a cpu.  Accesses
+ * that leave every line as it was (IPI masking, acks with more work pending,
+ * register reads) therefore never touch the BQL.
+ *
+ * Lock order is BQL, then AIC mutex.
+ */
+static void apple_aic_set_line(AppleAICState *s, AppleAICCPU *o, bool level)
+{
+    if (o->irq_level != level) {
+        o->irq_level = level;
+        if (o->irq_applied != level) {
+            qatomic_set(&s->irq_dirty, true);
+        }
+    }
+}
+
+/*
+ * Apply the recorded line levels, call with mutex unlocked
+ */
+static void apple_aic_flush_irqs(AppleAICState *s)
+{
+    int i;
+
+    if (!qatomic_read(&s->irq_dirty)) {
+        return;
+    }
+
+    BQL_LOCK_GUARD();
+    QEMU_LOCK_GUARD(&s->mutex);
+
+    for (i = 0; i < s->numCPU; i++) {
+        AppleAICCPU *o = &s->cpus[i];
+
+        if (o->irq_applied != o->irq_level) {
+            o->irq_applied = o->irq_level;
+            qemu_set_irq(o->irq, o->irq_level);
+        }
+    }
+    qatomic_set(&s->irq_dirty, false);
+}
+
 /*
  * Check state and interrupt cpus, call with mutex locked
  */
@@ -120,11 +167,6 @@ static void apple_aic_update(AppleAICState *s)
     uint32_t potential = 0;
     int i;
 
-    for (i = 0; i < s->numCPU; i++) {
-        s->cpus[i].pendingIPI |= s->cpus[i].deferredIPI;
-        s->cpus[i].deferredIPI = 0;
-    }
-
     for (i = 0; i < s->numCPU; i++) {
         if ((s->cpus[i].pendingIPI & AIC_IPI_SELF) & (~s->cpus[i].ipi_mask)) {
             intr |= (1 << i);
@@ -161,7 +203,7 @@ static void apple_aic_update(AppleAICState *s)
     }
     for (i = 0; i < s->numCPU; i++) {
         if (intr & (1 << i)) {
-            qemu_irq_raise(s->cpus[i].irq);
+            apple_aic_set_line(s, &s->cpus[i], true);
         }
     }
 }
@@ -170,31 +212,89 @@ static void apple_aic_set_irq(void *opaque, int irq, int level)
 {
     AppleAICState *s = APPLE_AIC(opaque);
 
-    QEMU_LOCK_GUARD(&s->mutex);
-
-    trace_aic_set_irq(irq, level);
-    if (level) {
-        set_bit32(irq, s->eir_state);
-    } else {
-        clear_bit32(irq, s->eir_state);
+    WITH_QEMU_LOCK_GUARD(&s->mutex) {
+        trace_aic_set_irq(irq, level);
+        if (level) {
+            set_bit32(irq, s->eir_state);
+            apple_aic_update(s);
+        } else {
+            clear_bit32(irq, s->eir_state);
+        }
     }
+    apple_aic_flush_irqs(s);
 }
 
+/*
+ * Deferred IPIs are folded into the pending set once the wait window has
+ * elapsed; the timer is only armed while some are outstanding, so an idle
+ * system sees no periodic AIC wakeups.
+ */
 static void apple_aic_tick(void *opaque)
 {
     AppleAICState *s = APPLE_AIC(opaque);
+    int i;
 
-    QEMU_LOCK_GUARD(&s->mutex);
+    WITH_QEMU_LOCK_GUARD(&s->mutex) {
+        for (i = 0; i < s->numCPU; i++) {
+            s->cpus[i].pendingIPI |= s->cpus[i].deferredIPI;
+            s->cpus[i].deferredIPI = 0;
+        }
 
-    apple_aic_update(s);
+        apple_aic_update(s);
+    }
+    apple_aic_flush_irqs(s);
+}
 
-    timer_mod_ns(s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + kAICWT);
+static void apple_aic_arm_deferred(AppleAICState *s)
+{
+    if (s->powered && !timer_pending(s->timer)) {
+        timer_mod_ns(s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + kAICWT);
+    }
 }
 
-static void apple_aic_reset(DeviceState *dev)
+static bool apple_aic_has_deferred(AppleAICState *s)
+{
+    int i;
+
+    for (i = 0; i < s->numCPU; i++) {
+        if (s->cpus[i].deferredIPI) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void apple_aic_arm_outstanding(AppleAICState *s)
+{
+    if (apple_aic_has_deferred(s)) {
+        apple_aic_arm_deferred(s);
+    }
+}
+
+/*
+ * Outstanding deferred IPIs wait while the PMGR domain is off, and get a
+ * fresh wait window once it is back on.
+ */
+static void apple_aic_set_power(void *opaque, int n, int level)
+{
+    AppleAICState *s = APPLE_AIC(opaque);
+
+    WITH_QEMU_LOCK_GUARD(&s->mutex) {
+        s->powered = level;
+        if (level) {
+            apple_aic_arm_outstanding(s);
+        } else {
+            timer_del(s->timer);
+        }
+    }
+}
+
+/*
+ * Reset the register state, call with mutex locked
+ */
+static void apple_aic_reset_state(AppleAICState *s)
 {
     int i;
-    AppleAICState *s = APPLE_AIC(dev);
 
     /* mask all IRQs */
     memset(s->eir_mask, 0xFF, sizeof(uint32_t) * s->numEIR);
@@ -207,24 +307,33 @@ static void apple_aic_reset(DeviceState *dev)
         s->cpus[i].ipi_mask = AIC_IPI_NORMAL | AIC_IPI_SELF;
         s->cpus[i].pendingIPI = 0;
         s->cpus[i].deferredIPI = 0;
+        apple_aic_set_line(s, &s->cpus[i], false);
     }
 }
 
-static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
-                            unsigned size)
+static void apple_aic_reset(DeviceState *dev)
 {
-    AppleAICCPU *o = (AppleAICCPU *)opaque;
-    AppleAICState *s = APPLE_AIC(o->aic);
-    uint32_t val = (uint32_t)data;
+    AppleAICState *s = APPLE_AIC(dev);
 
-    QEMU_LOCK_GUARD(&s->mutex);
+    WITH_QEMU_LOCK_GUARD(&s->mutex) {
+        s->powered = true;
+        apple_aic_reset_state(s);
+    }
+    apple_aic_flush_irqs(s);
+}
 
+/*
+ * Register write on behalf of cpu @o, call with mutex locked
+ */
+static void apple_aic_write_locked(AppleAICState *s, AppleAICCPU *o,
+                                   hwaddr addr, uint32_t val)
+{
     switch (addr) {
     case REG_AIC_RST:
-        apple_aic_reset(DEVICE(s));
+        apple_aic_reset_state(s);
         break;
     case REG_AIC_GLB_CFG:
-        s->global_cfg = data;
+        s->global_cfg = val;
         break;
     case REG_AIC_IPI_SET: {
         int i;
@@ -233,7 +342,7 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
             if (val & (1 << i)) {
                 set_bit32(o->cpu_id, &s->cpus[i].pendingIPI);
                 if (~s->cpus[i].ipi_mask & AIC_IPI_NORMAL) {
-                    qemu_irq_raise(s->cpus[i].irq);
+                    apple_aic_set_line(s, &s->cpus[i], true);
                 }
             }
         }
@@ -241,7 +350,7 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
         if (val & AIC_IPI_SELF) {
             o->pendingIPI |= AIC_IPI_SELF;
             if (~o->ipi_mask & AIC_IPI_SELF) {
-                qemu_irq_raise(o->irq);
+                apple_aic_set_line(s, o, true);
             }
         }
         break;
@@ -265,6 +374,7 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
         break;
     case REG_AIC_IPI_MASK_CLR:
         o->ipi_mask &= ~(val & (AIC_IPI_NORMAL | AIC_IPI_SELF));
+        apple_aic_update(s);
         break;
     case REG_AIC_IPI_DEFER_SET: {
         int i;
@@ -278,6 +388,7 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
         if (val & AIC_IPI_SELF) {
             o->deferredIPI |= AIC_IPI_SELF;
         }
+        apple_aic_arm_outstanding(s);
         break;
     }
     case REG_AIC_IPI_DEFER_CLR: {
@@ -292,6 +403,9 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
         if (val & AIC_IPI_SELF) {
             o->deferredIPI &= ~AIC_IPI_SELF;
         }
+        if (!apple_aic_has_deferred(s)) {
+            timer_del(s->timer);
+        }
         break;
     }
     case REG_AIC_EIR_DEST(0)... REG_AIC_EIR_DEST(AIC_INT_COUNT): {
@@ -300,6 +414,7 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
             break;
         }
         s->eir_dest[vector] = val;
+        apple_aic_update(s);
         break;
     }
     case REG_AIC_EIR_SW_SET(0)... REG_AIC_EIR_SW_SET(kAIC_NUM_EIRS): {
@@ -308,6 +423,7 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
             break;
         }
         s->eir_state[eir] |= val;
+        apple_aic_update(s);
         break;
     }
     case REG_AIC_EIR_SW_CLR(0)... REG_AIC_EIR_SW_CLR(kAIC_NUM_EIRS): {
@@ -334,6 +450,7 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
         }
 
         s->eir_mask[eir] &= ~val;
+        apple_aic_update(s);
         break;
     }
     case REG_AIC_WHOAMI_Pn(0)... REG_AIC_WHOAMI_Pn(AIC_CPU_COUNT) - 4: {
@@ -342,9 +459,7 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
             break;
         }
         addr = addr - 0x5000 + 0x2000 - 0x80 * cpu;
-        qemu_mutex_unlock(&s->mutex);
-        apple_aic_write(&s->cpus[cpu], addr, data, size);
-        qemu_mutex_lock(&s->mutex);
+        apple_aic_write_locked(s, &s->cpus[cpu], addr, val);
         break;
     }
     default:
@@ -356,13 +471,57 @@ static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
     }
 }
 
-static uint64_t apple_aic_read(void *opaque, hwaddr addr, unsigned size)
+static void apple_aic_write(void *opaque, hwaddr addr, uint64_t data,
+                            unsigned size)
 {
     AppleAICCPU *o = (AppleAICCPU *)opaque;
     AppleAICState *s = APPLE_AIC(o->aic);
 
-    QEMU_LOCK_GUARD(&s->mutex);
+    WITH_QEMU_LOCK_GUARD(&s->mutex) {
+        apple_aic_write_locked(s, o, addr, (uint32_t)data);
+    }
+    apple_aic_flush_irqs(s);
+}
+
+/*
+ * Acknowledge the highest priority pending interrupt for a cpu, call with
+ * mutex locked
+ */
+static uint32_t apple_aic_ack(AppleAICState *s, AppleAICCPU *o)
+{
+    int i;
+
+    if (o->pendingIPI & AIC_IPI_SELF & ~o->ipi_mask) {
+        o->ipi_mask |= AIC_IPI_SELF;
+        return kAIC_INT_IPI | kAIC_INT_IPI_SELF;
+    }
+
+    if (~o->ipi_mask & AIC_IPI_NORMAL) {
+        if (o->pendingIPI & ((1 << s->numCPU) - 1)) {
+            o->ipi_mask |= AIC_IPI_NORMAL;
+            return kAIC_INT_IPI | kAIC_INT_IPI_NORM;
+        }
+    }
+
+    i = -1;
+    while ((i = find_next_bit32(s->eir_state, s->numIRQ, i + 1)) <
+           s->numIRQ) {
+        if (test_bit32(i, s->eir_mask) == 0) {
+            if (s->eir_dest[i] & (1 << o->cpu_id)) {
+                set_bit32(i, s->eir_mask);
+                return kAIC_INT_EXT | AIC_INT_EXTID(i);
+            }
+        }
+    }
+    return kAIC_INT_SPURIOUS;
+}
 
+/*
+ * Register read on behalf of cpu @o, call with mutex locked
+ */
+static uint64_t apple_aic_read_locked(AppleAICState *s, AppleAICCPU *o,
+                                      hwaddr addr)
+{
     switch (addr) {
     case REG_AIC_REV:
         return 2;
@@ -373,32 +532,15 @@ static uint64_t apple_aic_read(void *opaque, hwaddr addr, unsigned size)
     case REG_AIC_WHOAMI:
         return o->cpu_id;
     case REG_AIC_IACK: {
-        int i;
+        uint32_t vec;
 
-        qemu_irq_lower(o->irq);
-        if (o->pendingIPI & AIC_IPI_SELF & ~o->ipi_mask) {
-            o->ipi_mask |= AIC_IPI_SELF;
-            return kAIC_INT_IPI | kAIC_INT_IPI_SELF;
+        apple_aic_set_line(s, o, false);
+        vec = apple_aic_ack(s, o);
+        if (vec != kAIC_INT_SPURIOUS) {
+            /* Re-raise the line if more work is still pending. */
+            apple_aic_update(s);
         }
-
-        if (~o->ipi_mask & AIC_IPI_NORMAL) {
-            if (o->pendingIPI & ((1 << s->numCPU) - 1)) {
-                o->ipi_mask |= AIC_IPI_NORMAL;
-                return kAIC_INT_IPI | kAIC_INT_IPI_NORM;
-            }
-        }
-
-        i = -1;
-        while ((i = find_next_bit32(s->eir_state, s->numIRQ, i + 1)) <
-               s->numIRQ) {
-            if (test_bit32(i, s->eir_mask) == 0) {
-                if (s->eir_dest[i] & (1 << o->cpu_id)) {
-                    set_bit32(i, s->eir_mask);
-                    return kAIC_INT_EXT | AIC_INT_EXTID(i);
-                }
-            }
-        }
-        return kAIC_INT_SPURIOUS;
+        return vec;
     }
     case REG_AIC_EIR_DEST(0)... REG_AIC_EIR_DEST(AIC_INT_COUNT): {
         uint32_t vector = (addr - REG_AIC_EIR_DEST(0)) / 4;
@@ -437,17 +579,13 @@ static uint64_t apple_aic_read(void *opaque, hwaddr addr, unsigned size)
     }
     case REG_AIC_WHOAMI_Pn(0)... REG_AIC_WHOAMI_Pn(AIC_CPU_COUNT) - 4: {
         uint32_t cpu = ((addr - 0x5000) / 0x80);
-        uint64_t val;
 
         if (unlikely(cpu >= s->numCPU)) {
             break;
         }
 
         addr = addr - 0x5000 + 0x2000 - 0x80 * cpu;
-        qemu_mutex_unlock(&s->mutex);
-        val = apple_aic_read(&s->cpus[cpu], addr, size);
-        qemu_mutex_lock(&s->mutex);
-        return val;
+        return apple_aic_read_locked(s, &s->cpus[cpu], addr);
     }
     default:
         if (addr == s->time_base + 0x20) {
@@ -465,6 +603,19 @@ static uint64_t apple_aic_read(void *opaque, hwaddr addr, unsigned size)
     return -1;
 }
 
+static uint64_t apple_aic_read(void *opaque, hwaddr addr, unsigned size)
+{
+    AppleAICCPU *o = (AppleAICCPU *)opaque;
+    AppleAICState *s = APPLE_AIC(o->aic);
+    uint64_t val;
+
+    qemu_mutex_lock(&s->mutex);
+    val = apple_aic_read_locked(s, o, addr);
+    qemu_mutex_unlock(&s->mutex);
+    apple_aic_flush_irqs(s);
+    return val;
+}
+
 static const MemoryRegionOps apple_aic_ops = {
     .read = apple_aic_read,
     .write = apple_aic_write,
@@ -483,6 +634,7 @@ static void apple_aic_realize(DeviceState *dev, struct Error **errp)
     int i;
 
     qemu_mutex_init(&s->mutex);
+    s->powered = true;
 
     s->cpus = g_new0(AppleAICCPU, s->numCPU);
 
@@ -493,11 +645,13 @@ static void apple_aic_realize(DeviceState *dev, struct Error **errp)
         cpu->cpu_id = i;
         memory_region_init_io(&cpu->iomem, OBJECT(dev), &apple_aic_ops, cpu,
                               TYPE_APPLE_AIC, s->base_size);
+        memory_region_enable_lockless_io(&cpu->iomem);
         sysbus_init_mmio(sbd, &cpu->iomem);
         sysbus_init_irq(sbd, &cpu->irq);
     }
 
     qdev_init_gpio_in(dev, apple_aic_set_irq, s->numIRQ);
+    qdev_init_gpio_in_named(dev, apple_aic_set_power, APPLE_PMGR_POWER, 1);
 
     g_assert_cmpuint(s->numCPU, !=, 0);
 
@@ -506,7 +660,6 @@ static void apple_aic_realize(DeviceState *dev, struct Error **errp)
     s->eir_state = g_new0(uint32_t, s->numEIR);
 
     s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, apple_aic_tick, dev);
-    timer_mod_ns(s->timer, kAICWT);
     msi_nonbroken = true;
 }
 
@@ -573,10 +726,49 @@ static const VMStateDescription vmstate_apple_aic_cpu = {
         }
 };
 
+static int apple_aic_post_load(void *opaque, int version_id)
+{
+    AppleAICState *s = APPLE_AIC(opaque);
+    int i;
+
+    WITH_QEMU_LOCK_GUARD(&s->mutex) {
+        apple_aic_arm_outstanding(s);
+        apple_aic_update(s);
+
+        /* Force every line to the level computed from the loaded state. */
+        for (i = 0; i < s->numCPU; i++) {
+            s->cpus[i].irq_applied = !s->cpus[i].irq_level;
+        }
+        qatomic_set(&s->irq_dirty, true);
+    }
+    apple_aic_flush_irqs(s);
+    return 0;
+}
+
+static bool apple_aic_power_needed(void *opaque)
+{
+    AppleAICState *s = APPLE_AIC(opaque);
+
+    return !s->powered;
+}
+
+static const VMStateDescription vmstate_apple_aic_power = {
+    .name = "apple_aic/power",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = apple_aic_power_needed,
+    .fields =
+        (const VMStateField[]){
+            VMSTATE_BOOL(powered, AppleAICState),
+            VMSTATE_END_OF_LIST(),
+        }
+};
+
 static const VMStateDescription vmstate_apple_aic = {
     .name = "apple_aic",
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = apple_aic_post_load,
     .fields =
         (const VMStateField[]){
             VMSTATE_UINT32(numEIR, AppleAICState),
@@ -593,6 +785,11 @@ static const VMStateDescription vmstate_apple_aic = {
                                                  vmstate_apple_aic_cpu,
                                                  AppleAICCPU),
             VMSTATE_END_OF_LIST(),
+        },
+    .subsections =
+        (const VMStateDescription *const[]){
+            &vmstate_apple_aic_power,
+            NULL,
         }
 };
 
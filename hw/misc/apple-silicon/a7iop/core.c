@@ -25,6 +25,11 @@ AppleA7IOPMessage *apple_a7iop_recv_iop(AppleA7IOP *s)
     return apple_a7iop_mailbox_recv_iop(s->ap_mailbox);
 }
 
+void apple_a7iop_recv_iop_all(AppleA7IOP *s, AppleA7IOPMessageQueue *queue)
+{
+    apple_a7iop_mailbox_recv_iop_all(s->ap_mailbox, queue);
+}
+
 void apple_a7iop_cpu_start(AppleA7IOP *s, bool wake)
 {
     if (s->ops == NULL) {
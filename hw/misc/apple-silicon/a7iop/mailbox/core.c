@@ -1,5 +1,6 @@
 #include "qemu/osdep.h"
 #include "block/aio.h"
+#include "hw/core/cpu.h"
 #include "hw/irq.h"
 #include "hw/misc/apple-silicon/a7iop/base.h"
 #include "hw/misc/apple-silicon/a7iop/mailbox/core.h"
@@ -10,9 +11,12 @@
 #include "hw/sysbus.h"
 #include "migration/vmstate.h"
 #include "qemu/bitops.h"
+#include "qemu/error-report.h"
 #include "qemu/lockable.h"
 #include "qemu/log.h"
+#include "qemu/main-loop.h"
 #include "qemu/queue.h"
+#include "qemu/timer.h"
 
 #define MAX_MESSAGE_COUNT 15
 
@@ -35,6 +39,11 @@
 #define CTRL_COUNT_MASK (MAX_MESSAGE_COUNT << CTRL_COUNT_SHIFT)
 #define CTRL_COUNT(v) (((v) << CTRL_COUNT_SHIFT) & CTRL_COUNT_MASK)
 
+// Empty reads closer together than the window count as one polling loop.
+#define POLL_HALT_THRESHOLD 64
+#define POLL_WINDOW_NS (20 * SCALE_US)
+#define POLL_HALT_TIMEOUT_NS (1 * SCALE_MS)
+
 #define IOP_EMPTY BIT(0)
 #define IOP_NONEMPTY BIT(4)
 #define AP_EMPTY BIT(8)
@@ -182,21 +191,132 @@ bool apple_a7iop_mailbox_is_empty(AppleA7IOPMailbox *s)
     return QTAILQ_EMPTY(&s->inbox);
 }
 
+static void apple_a7iop_mailbox_poll_end(AppleA7IOPMailbox *s, bool timeout)
+{
+    int64_t halted;
+
+    qatomic_set(&s->poll_halted, false);
+    timer_del(s->poll_timer);
+
+    halted = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) - s->poll_halt_start;
+    s->polls_avoided += halted / MAX(s->poll_interval, 1);
+    if (timeout) {
+        s->poll_timeouts++;
+    }
+    trace_apple_a7iop_mailbox_poll_wake(s->role, timeout, halted);
+}
+
+static void apple_a7iop_mailbox_poll_wake(AppleA7IOPMailbox *s, bool timeout)
+{
+    if (!qatomic_read(&s->poll_halted)) {
+        return;
+    }
+
+    BQL_LOCK_GUARD();
+    if (!s->poll_halted) {
+        return;
+    }
+    // An interrupt may have woken the poller up already.
+    if (s->poll_cpu->halted) {
+        s->poll_cpu->halted = 0;
+        qemu_cpu_kick(s->poll_cpu);
+    }
+    apple_a7iop_mailbox_poll_end(s, timeout);
+}
+
+/*
+ * Called with the BQL held whenever the poller takes an exception or
+ * returns from one, which it does when an interrupt ends its halt. The
+ * halt is over then, and the timeout must not kick it out of a later WFI.
+ */
+void apple_a7iop_mailbox_poll_cpu_resumed(AppleA7IOPMailbox *s)
+{
+    if (s->poll_halted) {
+        apple_a7iop_mailbox_poll_end(s, false);
+    }
+}
+
+static void apple_a7iop_mailbox_poll_timeout(void *opaque)
+{
+    apple_a7iop_mailbox_poll_wake(opaque, true);
+}
+
+/*
+ * Called with the BQL held for every read of a control register that
+ * reports the inbox as empty. A poller spinning on it is halted until a
+ * message or an interrupt status arrives, or the timeout expires in case
+ * it was waiting for something else.
+ */
+static void apple_a7iop_mailbox_poll(AppleA7IOPMailbox *s)
+{
+    CPUState *cpu = s->poll_cpu;
+    int64_t now;
+
+    if (cpu == NULL || current_cpu != cpu || !bql_locked()) {
+        return;
+    }
+
+    // Polling again, so whatever woke the poller up ended the halt.
+    apple_a7iop_mailbox_poll_cpu_resumed(s);
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    if (now - s->poll_last > POLL_WINDOW_NS) {
+        s->poll_count = 0;
+    } else {
+        s->poll_interval = now - s->poll_last;
+    }
+    s->poll_last = now;
+
+    if (++s->poll_count < POLL_HALT_THRESHOLD) {
+        return;
+    }
+
+    trace_apple_a7iop_mailbox_poll_halt(s->role, s->poll_count);
+    s->poll_count = 0;
+    s->poll_halts++;
+    s->poll_halt_start = now;
+    qatomic_set(&s->poll_halted, true);
+    timer_mod(s->poll_timer, now + POLL_HALT_TIMEOUT_NS);
+
+    // The read completes, the CPU stops at the end of the TB.
+    cpu->halted = 1;
+    cpu_exit(cpu);
+}
+
+void apple_a7iop_mailbox_set_poll_cpu(AppleA7IOPMailbox *s, CPUState *cpu)
+{
+    g_assert_null(s->poll_cpu);
+
+    s->poll_cpu = cpu;
+    s->poll_timer =
+        timer_new_ns(QEMU_CLOCK_VIRTUAL, apple_a7iop_mailbox_poll_timeout, s);
+    object_property_add_uint64_ptr(OBJECT(s), "poll-halts", &s->poll_halts,
+                                   OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(OBJECT(s), "poll-timeouts",
+                                   &s->poll_timeouts, OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(OBJECT(s), "polls-avoided",
+                                   &s->polls_avoided, OBJ_PROP_FLAG_READ);
+}
+
 static void apple_a7iop_mailbox_send(AppleA7IOPMailbox *s,
                                      AppleA7IOPMessage *msg)
 {
     g_assert_nonnull(msg);
 
-    QEMU_LOCK_GUARD(&s->lock);
-    trace_apple_a7iop_mailbox_send(s->role, ldq_le_p(msg->data),
-                                   ldq_le_p(msg->data + sizeof(uint64_t)));
-    QTAILQ_INSERT_TAIL(&s->inbox, msg, next);
-    s->count++;
-    apple_a7iop_mailbox_update_irq(s);
+    WITH_QEMU_LOCK_GUARD(&s->lock)
+    {
+        trace_apple_a7iop_mailbox_send(s->role, ldq_le_p(msg->data),
+                                       ldq_le_p(msg->data + sizeof(uint64_t)));
+        QTAILQ_INSERT_TAIL(&s->inbox, msg, next);
+        s->count++;
+        apple_a7iop_mailbox_update_irq(s);
 
-    if (s->bh != NULL) {
-        qemu_bh_schedule(s->bh);
+        if (s->bh != NULL) {
+            qemu_bh_schedule(s->bh);
+        }
     }
+
+    apple_a7iop_mailbox_poll_wake(s, false);
 }
 
 void apple_a7iop_mailbox_send_ap(AppleA7IOPMailbox *s, AppleA7IOPMessage *msg)
@@ -268,6 +388,30 @@ static AppleA7IOPMessage *apple_a7iop_mailbox_recv(AppleA7IOPMailbox *s)
     return msg;
 }
 
+// Moves every queued message to queue, updating the IRQ once per batch.
+static void apple_a7iop_mailbox_recv_all(AppleA7IOPMailbox *s,
+                                         AppleA7IOPMessageQueue *queue)
+{
+    AppleA7IOPMessage *msg;
+
+    QEMU_LOCK_GUARD(&s->lock);
+
+    if (s->underflow || QTAILQ_EMPTY(&s->inbox)) {
+        return;
+    }
+
+    while ((msg = QTAILQ_FIRST(&s->inbox)) != NULL) {
+        QTAILQ_REMOVE(&s->inbox, msg, next);
+        stl_le_p(msg->data + 0xC,
+                 ldl_le_p(msg->data + 0xC) | CTRL_COUNT(s->count));
+        trace_apple_a7iop_mailbox_recv(s->role, ldq_le_p(msg->data),
+                                       ldq_le_p(msg->data + sizeof(uint64_t)));
+        s->count--;
+        QTAILQ_INSERT_TAIL(queue, msg, next);
+    }
+    apple_a7iop_mailbox_update_irq(s);
+}
+
 AppleA7IOPMessage *apple_a7iop_mailbox_recv_iop(AppleA7IOPMailbox *s)
 {
     AppleA7IOPMessage *msg;
@@ -291,6 +435,26 @@ AppleA7IOPMessage *apple_a7iop_mailbox_recv_iop(AppleA7IOPMailbox *s)
     return msg;
 }
 
+void apple_a7iop_mailbox_recv_iop_all(AppleA7IOPMailbox *s,
+                                      AppleA7IOPMessageQueue *queue)
+{
+    WITH_QEMU_LOCK_GUARD(&s->lock)
+    {
+        if (!s->iop_dir_en) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: %s direction not enabled.\n",
+                          __FUNCTION__, s->role);
+            return;
+        }
+    }
+
+    apple_a7iop_mailbox_recv_all(s->iop_mailbox, queue);
+
+    WITH_QEMU_LOCK_GUARD(&s->lock)
+    {
+        apple_a7iop_mailbox_update_irq(s);
+    }
+}
+
 AppleA7IOPMessage *apple_a7iop_mailbox_recv_ap(AppleA7IOPMailbox *s)
 {
     AppleA7IOPMessage *msg;
@@ -350,10 +514,19 @@ static inline uint32_t apple_a7iop_mailbox_ctrl(AppleA7IOPMailbox *s)
 
 uint32_t apple_a7iop_mailbox_get_iop_ctrl(AppleA7IOPMailbox *s)
 {
-    QEMU_LOCK_GUARD(&s->lock);
+    uint32_t ctrl;
+
+    WITH_QEMU_LOCK_GUARD(&s->lock)
+    {
+        ctrl = CTRL_ENABLE(s->iop_dir_en) |
+               apple_a7iop_mailbox_ctrl(s->iop_mailbox);
+    }
+
+    if (ctrl & CTRL_EMPTY_MASK) {
+        apple_a7iop_mailbox_poll(s->iop_mailbox);
+    }
 
-    return CTRL_ENABLE(s->iop_dir_en) |
-           apple_a7iop_mailbox_ctrl(s->iop_mailbox);
+    return ctrl;
 }
 
 void apple_a7iop_mailbox_set_iop_ctrl(AppleA7IOPMailbox *s, uint32_t value)
@@ -381,12 +554,15 @@ void apple_a7iop_interrupt_status_push(AppleA7IOPMailbox *s, uint32_t status)
 {
     AppleA7IOPInterruptStatusMessage *msg;
 
-    QEMU_LOCK_GUARD(&s->lock);
+    WITH_QEMU_LOCK_GUARD(&s->lock)
+    {
+        msg = g_new0(struct AppleA7IOPInterruptStatusMessage, 1);
+        msg->status = status;
+        QTAILQ_INSERT_TAIL(&s->interrupt_status, msg, entry);
+        apple_a7iop_mailbox_update_irq(s);
+    }
 
-    msg = g_new0(struct AppleA7IOPInterruptStatusMessage, 1);
-    msg->status = status;
-    QTAILQ_INSERT_TAIL(&s->interrupt_status, msg, entry);
-    apple_a7iop_mailbox_update_irq(s);
+    apple_a7iop_mailbox_poll_wake(s, false);
 }
 
 uint32_t apple_a7iop_interrupt_status_pop(AppleA7IOPMailbox *s)
@@ -507,6 +683,11 @@ static void apple_a7iop_mailbox_reset(DeviceState *dev)
     s->iop_empty = 0;
     s->ap_nonempty = 0;
     s->ap_empty = 0;
+    s->poll_count = 0;
+    if (s->poll_halted) {
+        s->poll_halted = false;
+        timer_del(s->poll_timer);
+    }
     apple_a7iop_mailbox_update_irq(s);
 }
 
@@ -532,6 +713,53 @@ static const VMStateDescription vmstate_apple_a7iop_int_status_message = {
         }
 };
 
+static bool apple_a7iop_mailbox_poll_needed(void *opaque)
+{
+    AppleA7IOPMailbox *s = opaque;
+
+    return s->poll_halted;
+}
+
+static int apple_a7iop_mailbox_poll_pre_load(void *opaque)
+{
+    AppleA7IOPMailbox *s = opaque;
+
+    if (s->poll_cpu == NULL) {
+        error_report("%s mailbox: the source halted a poller, but this "
+                     "mailbox has none", s->role);
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static int apple_a7iop_mailbox_poll_post_load(void *opaque, int version_id)
+{
+    AppleA7IOPMailbox *s = opaque;
+
+    // Never leave the poller halted without a way to wake it up.
+    if (s->poll_halted && !timer_pending(s->poll_timer)) {
+        timer_mod(s->poll_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+    }
+    return 0;
+}
+
+static const VMStateDescription vmstate_apple_a7iop_mailbox_poll = {
+    .name = "Apple A7IOP Mailbox State/poll",
+    .version_id = 0,
+    .minimum_version_id = 0,
+    .needed = apple_a7iop_mailbox_poll_needed,
+    .pre_load = apple_a7iop_mailbox_poll_pre_load,
+    .post_load = apple_a7iop_mailbox_poll_post_load,
+    .fields =
+        (const VMStateField[]){
+            VMSTATE_BOOL(poll_halted, AppleA7IOPMailbox),
+            VMSTATE_INT64(poll_interval, AppleA7IOPMailbox),
+            VMSTATE_INT64(poll_halt_start, AppleA7IOPMailbox),
+            VMSTATE_TIMER_PTR(poll_timer, AppleA7IOPMailbox),
+            VMSTATE_END_OF_LIST(),
+        }
+};
+
 static const VMStateDescription vmstate_apple_a7iop_mailbox = {
     .name = "Apple A7IOP Mailbox State",
     .version_id = 0,
@@ -557,7 +785,12 @@ static const VMStateDescription vmstate_apple_a7iop_mailbox = {
             VMSTATE_BOOL(ap_nonempty, AppleA7IOPMailbox),
             VMSTATE_BOOL(ap_empty, AppleA7IOPMailbox),
             VMSTATE_END_OF_LIST(),
-        }
+        },
+    .subsections =
+        (const VMStateDescription *const[]){
+            &vmstate_apple_a7iop_mailbox_poll,
+            NULL,
+        },
 };
 
 static void apple_a7iop_mailbox_class_init(ObjectClass *klass, void *data)
@@ -72,15 +72,13 @@ static inline void apple_rtkit_register_ep(AppleRTKit *s, uint32_t ep,
                                            AppleRTKitEPHandler *handler,
                                            bool user)
 {
-    AppleRTKitEPData *data;
+    AppleRTKitEPData *data = &s->endpoints[ep];
 
     g_assert_nonnull(opaque);
-    g_assert_null(g_tree_lookup(s->endpoints, GUINT_TO_POINTER(ep)));
-    data = g_new0(AppleRTKitEPData, 1);
+    g_assert_null(data->opaque);
     data->opaque = opaque;
     data->handler = handler;
     data->user = user;
-    g_tree_insert(s->endpoints, GUINT_TO_POINTER(ep), data);
 }
 
 void apple_rtkit_register_control_ep(AppleRTKit *s, uint32_t ep, void *opaque,
@@ -99,11 +97,7 @@ void apple_rtkit_register_user_ep(AppleRTKit *s, uint32_t ep, void *opaque,
 
 static inline void apple_rtkit_unregister_ep(AppleRTKit *s, uint32_t ep)
 {
-    void *ep_data = g_tree_lookup(s->endpoints, GUINT_TO_POINTER(ep));
-    if (ep_data != NULL) {
-        g_tree_remove(s->endpoints, GUINT_TO_POINTER(ep));
-        g_free(ep_data);
-    }
+    memset(&s->endpoints[ep], 0, sizeof(s->endpoints[ep]));
 }
 
 void apple_rtkit_unregister_control_ep(AppleRTKit *s, uint32_t ep)
@@ -118,55 +112,61 @@ void apple_rtkit_unregister_user_ep(AppleRTKit *s, uint32_t ep)
     apple_rtkit_unregister_ep(s, ep + EP_USER_START);
 }
 
-static gboolean iop_rollcall(gpointer key, gpointer value, gpointer data)
+static void iop_queue_rollcall(AppleRTKit *s, uint32_t block, uint32_t mask,
+                               bool ended)
 {
-    AppleRTKitRollcallData *d = (AppleRTKitRollcallData *)data;
-    AppleRTKit *s = d->s;
     AppleRTKitManagementMessage mgmt_msg = { 0 };
     AppleA7IOPMessage *msg;
 
-    uint32_t ep = (uint64_t)key;
-    if ((uint64_t)key < 1) {
-        return false;
-    }
-
-    if (ep / EP_USER_START != d->last_block && d->mask) {
-        mgmt_msg.type = MSG_TYPE_ROLLCALL;
-        mgmt_msg.rollcall.epMask = d->mask;
-        mgmt_msg.rollcall.epBlock = d->last_block;
-        mgmt_msg.rollcall.epEnded = false;
-        msg = apple_rtkit_construct_msg(EP_MANAGEMENT, mgmt_msg.raw);
-        QTAILQ_INSERT_TAIL(&s->rollcall, msg, next);
-        d->mask = 0;
-    }
-    d->last_block = ep / EP_USER_START;
-    d->mask |= 1 << (ep & (EP_USER_START - 1));
-    return false;
+    mgmt_msg.type = MSG_TYPE_ROLLCALL;
+    mgmt_msg.rollcall.epMask = mask;
+    mgmt_msg.rollcall.epBlock = block;
+    mgmt_msg.rollcall.epEnded = ended;
+    msg = apple_rtkit_construct_msg(EP_MANAGEMENT, mgmt_msg.raw);
+    QTAILQ_INSERT_TAIL(&s->rollcall, msg, next);
 }
 
 static void iop_start_rollcall(AppleRTKit *s)
 {
     AppleA7IOP *a7iop;
-    AppleRTKitRollcallData data = { 0 };
     AppleA7IOPMessage *msg;
-    AppleRTKitManagementMessage mgmt_msg = { 0 };
+    uint32_t block;
+    uint32_t last_block = 0;
+    uint32_t last_mask = 0;
+    uint32_t mask;
+    uint32_t ep;
 
     a7iop = APPLE_A7IOP(s);
 
-    data.s = s;
     while (!QTAILQ_EMPTY(&s->rollcall)) {
         msg = QTAILQ_FIRST(&s->rollcall);
         QTAILQ_REMOVE(&s->rollcall, msg, next);
         g_free(msg);
     }
     s->ep0_status = EP0_WAIT_ROLLCALL;
-    g_tree_foreach(s->endpoints, iop_rollcall, &data);
-    mgmt_msg.type = MSG_TYPE_ROLLCALL;
-    mgmt_msg.rollcall.epMask = data.mask;
-    mgmt_msg.rollcall.epBlock = data.last_block;
-    mgmt_msg.rollcall.epEnded = true;
-    msg = apple_rtkit_construct_msg(EP_MANAGEMENT, mgmt_msg.raw);
-    QTAILQ_INSERT_TAIL(&s->rollcall, msg, next);
+
+    // One message per block of 32 endpoints, the management EP is implied.
+    for (block = 0; block < ARRAY_SIZE(s->endpoints) / EP_USER_START;
+         block++) {
+        mask = 0;
+        for (ep = 0; ep < EP_USER_START; ep++) {
+            if (s->endpoints[block * EP_USER_START + ep].opaque != NULL) {
+                mask |= 1 << ep;
+            }
+        }
+        if (block == 0) {
+            mask &= ~(1 << EP_MANAGEMENT);
+        }
+        if (mask == 0) {
+            continue;
+        }
+        if (last_mask != 0) {
+            iop_queue_rollcall(s, last_block, last_mask, false);
+        }
+        last_block = block;
+        last_mask = mask;
+    }
+    iop_queue_rollcall(s, last_block, last_mask, true);
 
     msg = QTAILQ_FIRST(&s->rollcall);
     QTAILQ_REMOVE(&s->rollcall, msg, next);
@@ -318,22 +318,31 @@ static void apple_rtkit_bh(void *opaque)
     AppleRTKitEPData *data;
     AppleA7IOPMessage *msg;
     AppleRTKitMessage *rtk_msg;
+    AppleA7IOPMessageQueue queue = QTAILQ_HEAD_INITIALIZER(queue);
 
     s = APPLE_RTKIT(opaque);
     a7iop = APPLE_A7IOP(opaque);
 
     QEMU_LOCK_GUARD(&s->lock);
-    while (!apple_a7iop_mailbox_is_empty(a7iop->iop_mailbox)) {
-        msg = apple_a7iop_recv_iop(a7iop);
-        rtk_msg = (AppleRTKitMessage *)msg->data;
-        data = g_tree_lookup(s->endpoints, GUINT_TO_POINTER(rtk_msg->endpoint));
-        if (data && data->handler) {
-            data->handler(data->opaque,
-                          data->user ? rtk_msg->endpoint - EP_USER_START :
-                                       rtk_msg->endpoint,
-                          rtk_msg->msg);
+    // Handlers may queue more messages, keep going until the inbox is dry.
+    for (;;) {
+        apple_a7iop_recv_iop_all(a7iop, &queue);
+        if (QTAILQ_EMPTY(&queue)) {
+            break;
+        }
+        while ((msg = QTAILQ_FIRST(&queue)) != NULL) {
+            QTAILQ_REMOVE(&queue, msg, next);
+            rtk_msg = (AppleRTKitMessage *)msg->data;
+            data = &s->endpoints[rtk_msg->endpoint & 0xFF];
+            if (rtk_msg->endpoint < ARRAY_SIZE(s->endpoints) &&
+                data->handler != NULL) {
+                data->handler(data->opaque,
+                              data->user ? rtk_msg->endpoint - EP_USER_START :
+                                           rtk_msg->endpoint,
+                              rtk_msg->msg);
+            }
+            g_free(msg);
         }
-        g_free(msg);
     }
 }
 
@@ -342,11 +351,6 @@ static const AppleA7IOPOps apple_rtkit_iop_ops = {
     .wakeup = apple_rtkit_iop_wakeup,
 };
 
-static gint g_uint_cmp(gconstpointer a, gconstpointer b)
-{
-    return a - b;
-}
-
 void apple_rtkit_init(AppleRTKit *s, void *opaque, const char *role,
                       uint64_t mmio_size, AppleA7IOPVersion version,
                       uint32_t protocol_version, const AppleRTKitOps *ops)
@@ -359,7 +363,6 @@ void apple_rtkit_init(AppleRTKit *s, void *opaque, const char *role,
                                          &DEVICE(s)->mem_reentrancy_guard));
 
     s->opaque = opaque ? opaque : s;
-    s->endpoints = g_tree_new(g_uint_cmp);
     s->protocol_version = protocol_version;
     s->ops = ops;
     QTAILQ_INIT(&s->rollcall);
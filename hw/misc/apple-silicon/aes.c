@@ -4,6 +4,7 @@
 #include "hw/irq.h"
 #include "hw/misc/apple-silicon/aes.h"
 #include "hw/misc/apple-silicon/aes_reg.h"
+#include "hw/misc/apple-silicon/reg-page.h"
 #include "migration/vmstate.h"
 #include "qapi/error.h"
 #include "qemu/bitops.h"
@@ -40,7 +41,8 @@ typedef struct {
 
 struct AppleAESState {
     SysBusDevice parent_obj;
-    MemoryRegion iomems[2];
+    MemoryRegion iomem;
+    AppleRegPage security;
     MemoryRegion *dma_mr;
     AddressSpace dma_as;
     qemu_irq irq;
@@ -365,38 +367,23 @@ static void *aes_thread(void *opaque)
     return NULL;
 }
 
-static void aes_security_reg_write(void *opaque, hwaddr addr, uint64_t data,
-                                   unsigned size)
-{
-}
-
-static uint64_t aes_security_reg_read(void *opaque, hwaddr addr, unsigned size)
-{
-    AppleAESState *s;
-
-    s = APPLE_AES(opaque);
-
-#if 0
-    qemu_log_mask(LOG_GUEST_ERROR, "%s: Read 0x" HWADDR_FMT_plx "\n", __func__,
-                  addr);
-#endif
+// The security block only holds fuse-like constants.
+static const AppleRegDef aes_security_regs[] = {
+    { REG_AES_V3_SECURITY_AES_DISABLE,
+      AES_V3_SECURITY_AES_DISABLE_GID1 | AES_V3_SECURITY_AES_DISABLE_UID },
+    // The board ID is filled in at creation time.
+    { REG_AES_V3_SECURITY_GPIO_STRAPS, AES_V3_SECURITY_GPIO_STRAPS_VALID },
+    { REG_AES_V3_SECURITY_SET_ONLY, 0x00 },
+    { REG_AES_V3_SECURITY_SEP,
+      AES_V3_SECURITY_SEP_FIRST_BOOT | AES_V3_SECURITY_SEP_FIRST_AWAKE_BOOT },
+};
 
-    switch (addr) {
-    case REG_AES_V3_SECURITY_AES_DISABLE:
-        return AES_V3_SECURITY_AES_DISABLE_GID1 |
-               AES_V3_SECURITY_AES_DISABLE_UID;
-    case REG_AES_V3_SECURITY_GPIO_STRAPS:
-        return AES_V3_SECURITY_GPIO_STRAPS_BOARD_ID(s->board_id) |
-               AES_V3_SECURITY_GPIO_STRAPS_VALID;
-    case REG_AES_V3_SECURITY_SET_ONLY:
-        return 0x00;
-    case REG_AES_V3_SECURITY_SEP:
-        return AES_V3_SECURITY_SEP_FIRST_BOOT |
-               AES_V3_SECURITY_SEP_FIRST_AWAKE_BOOT;
-    default:
-        return 0xFF;
-    }
-}
+static const AppleRegPageInfo aes_security_info = {
+    .fill = 0xFF,
+    .flags = APPLE_REG_RO,
+    .regs = aes_security_regs,
+    .nb_regs = ARRAY_SIZE(aes_security_regs),
+};
 
 static void aes_reg_write(void *opaque, hwaddr addr, uint64_t data,
                           unsigned size)
@@ -615,17 +602,6 @@ static const MemoryRegionOps aes_reg_ops = {
     .valid.unaligned = false,
 };
 
-static const MemoryRegionOps aes_security_reg_ops = {
-    .write = aes_security_reg_write,
-    .read = aes_security_reg_read,
-    .endianness = DEVICE_NATIVE_ENDIAN,
-    .impl.min_access_size = 4,
-    .impl.max_access_size = 4,
-    .valid.min_access_size = 4,
-    .valid.max_access_size = 4,
-    .valid.unaligned = false,
-};
-
 static void apple_aes_reset(DeviceState *dev)
 {
     AppleAESState *s = APPLE_AES(dev);
@@ -697,14 +673,18 @@ SysBusDevice *apple_aes_create(DTBNode *node, uint32_t board_id)
 
     reg = (uint64_t *)prop->data;
 
-    memory_region_init_io(&s->iomems[0], OBJECT(dev), &aes_reg_ops, s,
+    memory_region_init_io(&s->iomem, OBJECT(dev), &aes_reg_ops, s,
                           TYPE_APPLE_AES ".mmio", reg[1]);
 
-    sysbus_init_mmio(sbd, &s->iomems[0]);
+    sysbus_init_mmio(sbd, &s->iomem);
 
-    memory_region_init_io(&s->iomems[1], OBJECT(dev), &aes_security_reg_ops, s,
-                          TYPE_APPLE_AES ".security.mmio", reg[3]);
-    sysbus_init_mmio(sbd, &s->iomems[1]);
+    apple_reg_page_init(&s->security, OBJECT(dev),
+                        TYPE_APPLE_AES ".security.mmio", reg[3],
+                        &aes_security_info, s);
+    apple_reg_page_write32(&s->security, REG_AES_V3_SECURITY_GPIO_STRAPS,
+                           AES_V3_SECURITY_GPIO_STRAPS_BOARD_ID(board_id) |
+                               AES_V3_SECURITY_GPIO_STRAPS_VALID);
+    sysbus_init_mmio(sbd, &s->security.mr);
 
     s->last_level = 0;
     sysbus_init_irq(sbd, &s->irq);
@@ -0,0 +1,378 @@
+/*
+ * Apple PMGR power domains.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/irq.h"
+#include "hw/misc/apple-silicon/pmgr.h"
+#include "migration/vmstate.h"
+#include "monitor/monitor.h"
+#include "qemu/log.h"
+#include "qemu/timer.h"
+#include "trace.h"
+
+// Target state, in the low nibble of a power state register.
+#define PMGR_PS_PWRGATE (0x0)
+#define PMGR_PS_CLKGATE (0x4)
+#define PMGR_PS_ACTIVE (0xF)
+
+// Device without a power state register of its own.
+#define PMGR_DEVICE_VIRTUAL (1 << 4)
+
+typedef struct QEMU_PACKED {
+    uint32_t flags;
+    uint16_t parent[2];
+    uint8_t unk1[2];
+    uint8_t addr_offset;
+    uint8_t ps_reg;
+    uint8_t unk2[14];
+    uint16_t id;
+    uint8_t unk3[4];
+    char name[16];
+} ApplePMGRDevice;
+
+QEMU_BUILD_BUG_ON(sizeof(ApplePMGRDevice) != 48);
+
+typedef struct QEMU_PACKED {
+    uint32_t reg;
+    uint32_t offset;
+    uint32_t mask;
+} ApplePMGRPSReg;
+
+typedef struct {
+    qemu_irq power;
+    // Number of the consumer's domains that are off.
+    uint32_t nb_off;
+} ApplePMGRConsumer;
+
+typedef struct {
+    char name[17];
+    uint16_t id;
+    uint32_t offset;
+    GPtrArray *consumers;
+    bool on;
+    int64_t since;
+    uint64_t on_ns;
+    uint64_t off_ns;
+    uint64_t gated;
+} ApplePMGRDomain;
+
+struct ApplePMGRState {
+    SysBusDevice parent_obj;
+
+    uint32_t nb_domains;
+    ApplePMGRDomain *domains;
+    GHashTable *by_offset;
+    GHashTable *by_id;
+    GPtrArray *consumers;
+};
+
+static void apple_pmgr_account(ApplePMGRDomain *d, int64_t now)
+{
+    if (d->on) {
+        d->on_ns += now - d->since;
+    } else {
+        d->off_ns += now - d->since;
+    }
+    d->since = now;
+}
+
+static void apple_pmgr_domain_set(ApplePMGRDomain *d, bool on)
+{
+    ApplePMGRConsumer *c;
+    guint i;
+
+    if (d->on == on) {
+        return;
+    }
+
+    trace_apple_pmgr_domain(d->name, d->offset, on);
+    apple_pmgr_account(d, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL));
+    d->on = on;
+    if (!on) {
+        d->gated++;
+    }
+
+    for (i = 0; i < d->consumers->len; i++) {
+        c = g_ptr_array_index(d->consumers, i);
+        if (on) {
+            if (--c->nb_off == 0) {
+                qemu_irq_raise(c->power);
+            }
+        } else if (c->nb_off++ == 0) {
+            qemu_irq_lower(c->power);
+        }
+    }
+}
+
+void apple_pmgr_ps_write(ApplePMGRState *s, hwaddr offset, uint32_t value)
+{
+    ApplePMGRDomain *d;
+
+    d = g_hash_table_lookup(s->by_offset, GUINT_TO_POINTER(offset));
+    if (d != NULL) {
+        // Clock gated domains are as good as off for the devices in them.
+        apple_pmgr_domain_set(d, (value & 0xF) > PMGR_PS_CLKGATE);
+    }
+}
+
+void apple_pmgr_connect(ApplePMGRState *s, DTBNode *node, qemu_irq power)
+{
+    ApplePMGRConsumer *c;
+    ApplePMGRDomain *d;
+    DTBProp *prop;
+    uint32_t *ids;
+    int i;
+
+    prop = dtb_find_prop(node, "clock-gates");
+    if (prop == NULL) {
+        return;
+    }
+    ids = (uint32_t *)prop->data;
+
+    c = g_new0(ApplePMGRConsumer, 1);
+    c->power = power;
+    for (i = 0; i < prop->length / sizeof(uint32_t); i++) {
+        d = g_hash_table_lookup(s->by_id, GUINT_TO_POINTER(ids[i]));
+        if (d != NULL) {
+            g_ptr_array_add(d->consumers, c);
+        }
+    }
+    g_ptr_array_add(s->consumers, c);
+}
+
+static void apple_pmgr_parse(ApplePMGRState *s, DTBNode *node)
+{
+    ApplePMGRDevice *devs;
+    ApplePMGRPSReg *ps_regs;
+    ApplePMGRDomain *d;
+    DTBProp *prop;
+    DTBProp *ps_prop;
+    uint64_t size;
+    uint32_t nb_devs;
+    uint32_t nb_ps_regs;
+    uint32_t offset;
+    uint32_t i;
+
+    prop = dtb_find_prop(node, "reg");
+    g_assert_nonnull(prop);
+    size = ((uint64_t *)prop->data)[1];
+
+    prop = dtb_find_prop(node, "devices");
+    ps_prop = dtb_find_prop(node, "ps-regs");
+    if (prop == NULL || ps_prop == NULL ||
+        prop->length % sizeof(ApplePMGRDevice) != 0 ||
+        ps_prop->length % sizeof(ApplePMGRPSReg) != 0) {
+        qemu_log_mask(LOG_UNIMP,
+                      "%s: unknown PMGR device table layout, power domains "
+                      "are always on\n",
+                      __func__);
+        return;
+    }
+    devs = (ApplePMGRDevice *)prop->data;
+    nb_devs = prop->length / sizeof(ApplePMGRDevice);
+    ps_regs = (ApplePMGRPSReg *)ps_prop->data;
+    nb_ps_regs = ps_prop->length / sizeof(ApplePMGRPSReg);
+
+    s->domains = g_new0(ApplePMGRDomain, nb_devs);
+    for (i = 0; i < nb_devs; i++) {
+        if ((devs[i].flags & PMGR_DEVICE_VIRTUAL) ||
+            devs[i].ps_reg >= nb_ps_regs) {
+            continue;
+        }
+        // The machine only forwards the first block.
+        if (ps_regs[devs[i].ps_reg].reg != 0) {
+            continue;
+        }
+        offset = ps_regs[devs[i].ps_reg].offset + (devs[i].addr_offset << 3);
+        if (offset + sizeof(uint32_t) > size) {
+            continue;
+        }
+
+        d = g_hash_table_lookup(s->by_offset, GUINT_TO_POINTER(offset));
+        if (d == NULL) {
+            d = &s->domains[s->nb_domains++];
+            memcpy(d->name, devs[i].name, sizeof(devs[i].name));
+            d->id = devs[i].id;
+            d->offset = offset;
+            d->consumers = g_ptr_array_new();
+            g_hash_table_insert(s->by_offset, GUINT_TO_POINTER(offset), d);
+        }
+        g_hash_table_insert(s->by_id, GUINT_TO_POINTER(devs[i].id), d);
+    }
+}
+
+SysBusDevice *apple_pmgr_create(DTBNode *node)
+{
+    DeviceState *dev;
+    ApplePMGRState *s;
+
+    dev = qdev_new(TYPE_APPLE_PMGR);
+    s = APPLE_PMGR(dev);
+
+    apple_pmgr_parse(s, node);
+
+    return SYS_BUS_DEVICE(dev);
+}
+
+// Everything is on out of reset, as left by the bootloader.
+static void apple_pmgr_reset_hold(Object *obj, ResetType type)
+{
+    ApplePMGRState *s = APPLE_PMGR(obj);
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    ApplePMGRDomain *d;
+    uint32_t i;
+
+    for (i = 0; i < s->nb_domains; i++) {
+        d = &s->domains[i];
+        d->on = true;
+        d->since = now;
+        d->on_ns = 0;
+        d->off_ns = 0;
+        d->gated = 0;
+    }
+    for (i = 0; i < s->consumers->len; i++) {
+        ((ApplePMGRConsumer *)g_ptr_array_index(s->consumers, i))->nb_off = 0;
+    }
+}
+
+static int apple_pmgr_post_load(void *opaque, int version_id)
+{
+    ApplePMGRState *s = APPLE_PMGR(opaque);
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    ApplePMGRDomain *d;
+    ApplePMGRConsumer *c;
+    uint32_t i;
+    guint j;
+
+    // The consumers restore their own power state.
+    for (i = 0; i < s->consumers->len; i++) {
+        ((ApplePMGRConsumer *)g_ptr_array_index(s->consumers, i))->nb_off = 0;
+    }
+    for (i = 0; i < s->nb_domains; i++) {
+        d = &s->domains[i];
+        d->since = now;
+        for (j = 0; !d->on && j < d->consumers->len; j++) {
+            c = g_ptr_array_index(d->consumers, j);
+            c->nb_off++;
+        }
+    }
+    return 0;
+}
+
+static const VMStateDescription vmstate_apple_pmgr_domain = {
+    .name = "ApplePMGRDomain",
+    .version_id = 0,
+    .minimum_version_id = 0,
+    .fields =
+        (const VMStateField[]){
+            VMSTATE_BOOL(on, ApplePMGRDomain),
+            VMSTATE_UINT64(on_ns, ApplePMGRDomain),
+            VMSTATE_UINT64(off_ns, ApplePMGRDomain),
+            VMSTATE_UINT64(gated, ApplePMGRDomain),
+            VMSTATE_END_OF_LIST(),
+        },
+};
+
+static const VMStateDescription vmstate_apple_pmgr = {
+    .name = "ApplePMGRState",
+    .version_id = 0,
+    .minimum_version_id = 0,
+    .post_load = apple_pmgr_post_load,
+    .fields =
+        (const VMStateField[]){
+            VMSTATE_UINT32_EQUAL(nb_domains, ApplePMGRState, NULL),
+            VMSTATE_STRUCT_VARRAY_POINTER_UINT32(domains, ApplePMGRState,
+                                                 nb_domains,
+                                                 vmstate_apple_pmgr_domain,
+                                                 ApplePMGRDomain),
+            VMSTATE_END_OF_LIST(),
+        },
+};
+
+static void apple_pmgr_print(Monitor *mon, ApplePMGRState *s)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    ApplePMGRDomain *d;
+    uint32_t i;
+
+    monitor_printf(mon, "%-16s %5s %8s %5s %12s %12s %8s\n", "domain", "id",
+                   "offset", "state", "on (ms)", "off (ms)", "gated");
+    for (i = 0; i < s->nb_domains; i++) {
+        d = &s->domains[i];
+        apple_pmgr_account(d, now);
+        monitor_printf(mon,
+                       "%-16s %5u %8" PRIx32 " %5s %12" PRIu64 " %12" PRIu64
+                       " %8" PRIu64 "\n",
+                       d->name, d->id, d->offset, d->on ? "on" : "off",
+                       d->on_ns / SCALE_MS, d->off_ns / SCALE_MS, d->gated);
+    }
+}
+
+static int apple_pmgr_print_one(Object *obj, void *opaque)
+{
+    ApplePMGRState *s;
+
+    s = (ApplePMGRState *)object_dynamic_cast(obj, TYPE_APPLE_PMGR);
+    if (s != NULL) {
+        apple_pmgr_print(opaque, s);
+    }
+    return 0;
+}
+
+static void hmp_info_pmgr(Monitor *mon, const QDict *qdict)
+{
+    object_child_foreach_recursive(object_get_root(), apple_pmgr_print_one,
+                                   mon);
+}
+
+static void apple_pmgr_init(Object *obj)
+{
+    ApplePMGRState *s = APPLE_PMGR(obj);
+
+    s->by_offset = g_hash_table_new(g_direct_hash, g_direct_equal);
+    s->by_id = g_hash_table_new(g_direct_hash, g_direct_equal);
+    s->consumers = g_ptr_array_new();
+}
+
+static void apple_pmgr_class_init(ObjectClass *klass, void *data)
+{
+    ResettableClass *rc = RESETTABLE_CLASS(klass);
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    rc->phases.hold = apple_pmgr_reset_hold;
+
+    dc->desc = "Apple PMGR power domains";
+    dc->user_creatable = false;
+    dc->vmsd = &vmstate_apple_pmgr;
+    set_bit(DEVICE_CATEGORY_MISC, dc->categories);
+}
+
+static const TypeInfo apple_pmgr_info = {
+    .name = TYPE_APPLE_PMGR,
+    .parent = TYPE_SYS_BUS_DEVICE,
+    .instance_size = sizeof(ApplePMGRState),
+    .instance_init = apple_pmgr_init,
+    .class_init = apple_pmgr_class_init,
+};
+
+static void apple_pmgr_register_types(void)
+{
+    type_register_static(&apple_pmgr_info);
+    monitor_register_hmp("pmgr", true, hmp_info_pmgr);
+}
+
+type_init(apple_pmgr_register_types);
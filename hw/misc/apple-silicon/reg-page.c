@@ -0,0 +1,153 @@
+/*
+ * Apple RAM-backed register pages.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "hw/misc/apple-silicon/reg-page.h"
+#include "hw/qdev-core.h"
+#include "migration/vmstate.h"
+#include "qapi/error.h"
+#include "qemu/bitmap.h"
+#include "qemu/bswap.h"
+
+/*
+ * Only reached for writes to pages that have read-only or notifying
+ * registers, and for reads while the ROM device is not in ROMD mode.
+ */
+static uint64_t apple_reg_page_read(void *opaque, hwaddr addr, unsigned size)
+{
+    AppleRegPage *page = opaque;
+
+    return ldn_le_p(page->regs + addr, size);
+}
+
+static void apple_reg_page_write(void *opaque, hwaddr addr, uint64_t data,
+                                 unsigned size)
+{
+    AppleRegPage *page = opaque;
+    unsigned long reg = addr / 4;
+    uint64_t old = ldn_le_p(page->regs + addr, size);
+
+    if (!test_bit(reg, page->ro)) {
+        stn_le_p(page->regs + addr, size, data);
+        memory_region_set_dirty(&page->mr, addr, size);
+    }
+    if (test_bit(reg, page->notify)) {
+        page->info->notify(page->opaque, addr, old, data, size);
+    }
+}
+
+static const MemoryRegionOps apple_reg_page_ops = {
+    .read = apple_reg_page_read,
+    .write = apple_reg_page_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .impl = {
+        .min_access_size = 1,
+        .max_access_size = 4,
+    },
+    .valid = {
+        .min_access_size = 1,
+        .max_access_size = 8,
+    },
+};
+
+void apple_reg_page_init(AppleRegPage *page, Object *owner, const char *name,
+                         uint64_t size, const AppleRegPageInfo *info,
+                         void *opaque)
+{
+    size_t nb_regs = size / 4;
+    uint32_t flags = info->flags;
+    size_t i;
+
+    g_assert(size && !(size & 3));
+
+    page->info = info;
+    page->opaque = opaque;
+    page->size = size;
+    page->ro = bitmap_new(nb_regs);
+    page->notify = bitmap_new(nb_regs);
+
+    if (info->flags & APPLE_REG_RO) {
+        bitmap_fill(page->ro, nb_regs);
+    }
+    if (info->flags & APPLE_REG_NOTIFY) {
+        bitmap_fill(page->notify, nb_regs);
+    }
+    for (i = 0; i < info->nb_regs; i++) {
+        const AppleRegDef *def = &info->regs[i];
+        unsigned long reg = def->addr / 4;
+
+        g_assert(def->addr < size && !(def->addr & 3));
+        if (def->flags & APPLE_REG_RO) {
+            set_bit(reg, page->ro);
+        } else {
+            clear_bit(reg, page->ro);
+        }
+        if (def->flags & APPLE_REG_NOTIFY) {
+            set_bit(reg, page->notify);
+        } else {
+            clear_bit(reg, page->notify);
+        }
+        flags |= def->flags;
+    }
+    g_assert(!(flags & APPLE_REG_NOTIFY) || info->notify);
+
+    // Pages without any write side effects do not need to trap at all.
+    if (flags) {
+        memory_region_init_rom_device_nomigrate(&page->mr, owner,
+                                                &apple_reg_page_ops, page,
+                                                name, size, &error_fatal);
+    } else {
+        memory_region_init_ram_nomigrate(&page->mr, owner, name, size,
+                                         &error_fatal);
+    }
+    // Pages may also belong to the machine, which is not a device.
+    vmstate_register_ram(&page->mr, (DeviceState *)object_dynamic_cast(
+                                        owner, TYPE_DEVICE));
+    page->regs = memory_region_get_ram_ptr(&page->mr);
+
+    apple_reg_page_reset(page);
+}
+
+void apple_reg_page_reset(AppleRegPage *page)
+{
+    const AppleRegPageInfo *info = page->info;
+    hwaddr addr;
+    size_t i;
+
+    for (addr = 0; addr < page->size; addr += 4) {
+        stl_le_p(page->regs + addr, info->fill);
+    }
+    for (i = 0; i < info->nb_regs; i++) {
+        stl_le_p(page->regs + info->regs[i].addr, info->regs[i].value);
+    }
+    memory_region_set_dirty(&page->mr, 0, page->size);
+}
+
+uint32_t apple_reg_page_read32(AppleRegPage *page, hwaddr addr)
+{
+    g_assert(addr + 4 <= page->size);
+
+    return ldl_le_p(page->regs + addr);
+}
+
+void apple_reg_page_write32(AppleRegPage *page, hwaddr addr, uint32_t val)
+{
+    g_assert(addr + 4 <= page->size);
+
+    stl_le_p(page->regs + addr, val);
+    memory_region_set_dirty(&page->mr, addr, 4);
+}
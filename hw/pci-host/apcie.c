@@ -22,6 +22,7 @@
 #include "qemu/osdep.h"
 #include "hw/arm/apple-silicon/dart.h"
 #include "hw/irq.h"
+#include "hw/misc/apple-silicon/reg-page.h"
 #include "hw/misc/unimp.h"
 #include "hw/pci-host/apcie.h"
 #include "hw/pci/msi.h"
@@ -586,56 +587,10 @@ static const MemoryRegionOps apple_pcie_host_root_phy_ops = {
 };
 
 
-static uint64_t apple_pcie_host_root_phy_ip_read(void *opaque, hwaddr addr,
-                                                 unsigned size)
-{
-    ApplePCIEHost *host = APPLE_PCIE_HOST(opaque);
-    uint32_t val = 0;
-
-#ifdef ENABLE_CPU_DUMP_STATE
-    // #if 1
-    cpu_dump_state(CPU(first_cpu), stderr, CPU_DUMP_CODE);
-#endif
-
-    switch (addr) {
-    default:
-    jump_default:
-        DPRINTF("%s: root_phy_ip: READ DEFAULT @ 0x" HWADDR_FMT_plx
-                " value: 0x%x\n",
-                __func__, addr, val);
-        break;
-    }
-
-    DPRINTF("%s: READ @ 0x" HWADDR_FMT_plx " value: 0x%x\n", __func__, addr,
-            val);
-    return val;
-}
-
-static void apple_pcie_host_root_phy_ip_write(void *opaque, hwaddr addr,
-                                              uint64_t data, unsigned size)
-{
-    ApplePCIEHost *host = APPLE_PCIE_HOST(opaque);
-
-    DPRINTF("%s: WRITE @ 0x" HWADDR_FMT_plx " value: 0x" HWADDR_FMT_plx "\n",
-            __func__, addr, data);
-    switch (addr) {
-    default:
-    jump_default:
-        DPRINTF("%s: root_phy_ip: WRITE DEFAULT @ 0x" HWADDR_FMT_plx
-                " value: 0x" HWADDR_FMT_plx "\n",
-                __func__, addr, data);
-        break;
-    }
-}
-
-static const MemoryRegionOps apple_pcie_host_root_phy_ip_ops = {
-    .read = apple_pcie_host_root_phy_ip_read,
-    .write = apple_pcie_host_root_phy_ip_write,
-    .endianness = DEVICE_LITTLE_ENDIAN,
-    .valid = {
-        .min_access_size = 4,
-        .max_access_size = 4,
-    },
+// The PHY IP windows read as zero and ignore writes.
+static const AppleRegPageInfo apple_pcie_phy_ip_info = {
+    .fill = 0,
+    .flags = APPLE_REG_RO,
 };
 
 static uint64_t apple_pcie_host_root_axi2af_read(void *opaque, hwaddr addr,
@@ -1293,71 +1248,6 @@ static const MemoryRegionOps apple_pcie_port_phy_glue_ops = {
     },
 };
 
-static uint64_t apple_pcie_port_phy_ip_read(void *opaque, hwaddr addr,
-                                            unsigned size)
-{
-    ApplePCIEPort *port = APPLE_PCIE_PORT(opaque);
-    uint32_t val = 0;
-
-// #ifdef ENABLE_CPU_DUMP_STATE
-#if 0
-    cpu_dump_state(CPU(first_cpu), stderr, CPU_DUMP_CODE);
-#endif
-
-    switch (addr) {
-    case 0x400:
-        // break;
-        goto jump_default;
-    case 0xa3c:
-        // break;
-        goto jump_default;
-    default:
-    jump_default:
-        DPRINTF("%s: Port %u: READ DEFAULT @ 0x" HWADDR_FMT_plx " value: 0x%x"
-                "\n",
-                __func__, port->bus_nr, addr, val);
-        break;
-    }
-
-    DPRINTF("%s: Port %u: READ @ 0x" HWADDR_FMT_plx " value: 0x%x\n", __func__,
-            port->bus_nr, addr, val);
-    return val;
-}
-
-static void apple_pcie_port_phy_ip_write(void *opaque, hwaddr addr,
-                                         uint64_t data, unsigned size)
-{
-    ApplePCIEPort *port = APPLE_PCIE_PORT(opaque);
-
-    DPRINTF("%s: Port %u: WRITE @ 0x" HWADDR_FMT_plx " value: 0x" HWADDR_FMT_plx
-            "\n",
-            __func__, port->bus_nr, addr, data);
-    switch (addr) {
-    case 0x400:
-        // break;
-        goto jump_default;
-    case 0xa3c:
-        // break;
-        goto jump_default;
-    default:
-    jump_default:
-        DPRINTF("%s: Port %u: WRITE DEFAULT @ 0x" HWADDR_FMT_plx
-                " value: 0x" HWADDR_FMT_plx "\n",
-                __func__, port->bus_nr, addr, data);
-        break;
-    }
-}
-
-static const MemoryRegionOps apple_pcie_port_phy_ip_ops = {
-    .read = apple_pcie_port_phy_ip_read,
-    .write = apple_pcie_port_phy_ip_write,
-    .endianness = DEVICE_LITTLE_ENDIAN,
-    .valid = {
-        .min_access_size = 4,
-        .max_access_size = 4,
-    },
-};
-
 static const char *apple_pcie_host_root_bus_path(PCIHostState *host_bridge,
                                                  PCIBus *rootbus)
 {
@@ -1636,10 +1526,9 @@ SysBusDevice *apple_pcie_create(DTBNode *node)
         sysbus_init_mmio(sbd, &host->root_phy);
         sysbus_mmio_map(sbd, 2, reg[2 * 2]);
 
-        memory_region_init_io(&host->root_phy_ip, OBJECT(host),
-                              &apple_pcie_host_root_phy_ip_ops, host,
-                              "root_phy_ip", reg[3 * 2 + 1]);
-        sysbus_init_mmio(sbd, &host->root_phy_ip);
+        apple_reg_page_init(&host->root_phy_ip, OBJECT(host), "root_phy_ip",
+                            reg[3 * 2 + 1], &apple_pcie_phy_ip_info, host);
+        sysbus_init_mmio(sbd, &host->root_phy_ip.mr);
         sysbus_mmio_map(sbd, 3, reg[3 * 2]);
 
         memory_region_init_io(&host->root_axi2af, OBJECT(host),
@@ -1686,11 +1575,11 @@ SysBusDevice *apple_pcie_create(DTBNode *node)
                             reg[(port_index + (i * port_entries) + 2) * 2 + 0]);
 
             snprintf(temp_name, sizeof(temp_name), "port%u_phy_ip", i);
-            memory_region_init_io(
-                &port->port_phy_ip, OBJECT(port), &apple_pcie_port_phy_ip_ops,
-                port, temp_name,
-                reg[(port_index + (i * port_entries) + 3) * 2 + 1]);
-            sysbus_init_mmio(sbd, &port->port_phy_ip);
+            apple_reg_page_init(
+                &port->port_phy_ip, OBJECT(port), temp_name,
+                reg[(port_index + (i * port_entries) + 3) * 2 + 1],
+                &apple_pcie_phy_ip_info, port);
+            sysbus_init_mmio(sbd, &port->port_phy_ip.mr);
             sysbus_mmio_map(sbd, root_mappings + 3 + (i * port_mappings),
                             reg[(port_index + (i * port_entries) + 3) * 2 + 0]);
         } else {
@@ -68,33 +68,8 @@ static void apple_otg_reset(DeviceState *dev)
     AppleOTGState *s = APPLE_OTG(dev);
 }
 
-static void phy_reg_write(void *opaque, hwaddr addr, uint64_t data,
-                          unsigned size)
-{
-    qemu_log_mask(LOG_UNIMP,
-                  "OTG: phy reg WRITE @ 0x" HWADDR_FMT_plx
-                  " value: 0x" HWADDR_FMT_plx "\n",
-                  addr, data);
-
-    AppleOTGState *s = APPLE_OTG(opaque);
-    memcpy(s->phy_reg + addr, &data, size);
-}
-
-static uint64_t phy_reg_read(void *opaque, hwaddr addr, unsigned size)
-{
-    qemu_log_mask(LOG_UNIMP, "OTG: phy reg READ @ 0x" HWADDR_FMT_plx "\n",
-                  addr);
-    AppleOTGState *s = APPLE_OTG(opaque);
-    uint64_t val = 0;
-
-    memcpy(&val, s->phy_reg + addr, size);
-    return val;
-}
-
-static const MemoryRegionOps phy_reg_ops = {
-    .write = phy_reg_write,
-    .read = phy_reg_read,
-};
+// The PHY is pure read-back storage.
+static const AppleRegPageInfo phy_reg_info = { 0 };
 
 static void usbctl_reg_write(void *opaque, hwaddr addr, uint64_t data,
                              unsigned size)
@@ -183,11 +158,11 @@ DeviceState *apple_otg_create(DTBNode *node)
     sbd = SYS_BUS_DEVICE(dev);
     s = APPLE_OTG(dev);
 
-    memory_region_init_io(&s->phy, OBJECT(dev), &phy_reg_ops, s,
-                          TYPE_APPLE_OTG ".phy", sizeof(s->phy_reg));
-    sysbus_init_mmio(sbd, &s->phy);
-    *(uint32_t *)(s->phy_reg + REG_AUSB_USB20PHY_OTGSIG) |=
-        (1 << 8); // cable connected
+    apple_reg_page_init(&s->phy, OBJECT(dev), TYPE_APPLE_OTG ".phy",
+                        APPLE_OTG_PHY_REG_SIZE, &phy_reg_info, s);
+    sysbus_init_mmio(sbd, &s->phy.mr);
+    apple_reg_page_write32(&s->phy, REG_AUSB_USB20PHY_OTGSIG,
+                           1 << 8); // cable connected
     memory_region_init_io(&s->usbctl, OBJECT(dev), &usbctl_reg_ops, s,
                           TYPE_APPLE_OTG ".usbctl", sizeof(s->usbctl_reg));
     sysbus_init_mmio(sbd, &s->usbctl);
@@ -222,12 +197,11 @@ static int apple_otg_post_load(void *opaque, int version_id)
 
 static const VMStateDescription vmstate_apple_otg = {
     .name = "apple_otg",
-    .version_id = 0,
-    .minimum_version_id = 0,
+    .version_id = 1,
+    .minimum_version_id = 1,
     .post_load = apple_otg_post_load,
     .fields =
         (const VMStateField[]){
-            VMSTATE_UINT8_ARRAY(phy_reg, AppleOTGState, 0x20),
             VMSTATE_UINT8_ARRAY(usbctl_reg, AppleOTGState, 0x1000),
             VMSTATE_UINT8_ARRAY(widget_reg, AppleOTGState, 0x100),
             VMSTATE_UINT64(high_addr, AppleOTGState),
@@ -1193,6 +1193,96 @@ static void dwc2_update_out_ep(DWC2State *s, int ep)
     qemu_bh_schedule(s->device_async_bh);
 }
 
+#define DWC2_DESC_BATCH 16
+
+/*
+ * Device-mode DMA descriptors are read DWC2_DESC_BATCH at a time, and the
+ * consumed ones are written back with a single DMA write per batch.
+ */
+typedef struct DWC2DescBatch {
+    struct dwc2_dma_desc desc[DWC2_DESC_BATCH];
+    uint32_t base;
+    int count;
+    int next;
+} DWC2DescBatch;
+
+static void dwc2_desc_flush(DWC2State *s, DWC2DescBatch *b)
+{
+    if (b->next > 0) {
+        dma_memory_write(&s->dma_as, b->base | SOC_DMA_BASE, b->desc,
+                         b->next * sizeof(b->desc[0]), MEMTXATTRS_UNSPECIFIED);
+    }
+    b->count = 0;
+    b->next = 0;
+}
+
+static struct dwc2_dma_desc *dwc2_desc_next(DWC2State *s, DWC2DescBatch *b,
+                                            uint32_t addr)
+{
+    if (b->next == b->count) {
+        dwc2_desc_flush(s, b);
+        b->base = addr;
+        b->count = DWC2_DESC_BATCH;
+        if (dma_memory_read(&s->dma_as, addr | SOC_DMA_BASE, b->desc,
+                            sizeof(b->desc),
+                            MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+            // The chain may end right before unmapped memory.
+            b->count = 1;
+            if (dma_memory_read(&s->dma_as, addr | SOC_DMA_BASE, b->desc,
+                                sizeof(b->desc[0]),
+                                MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+                b->count = 0;
+                return NULL;
+            }
+        }
+    }
+    return &b->desc[b->next++];
+}
+
+/* Give back a descriptor that was not consumed, it is not written back. */
+static void dwc2_desc_unget(DWC2DescBatch *b)
+{
+    b->next--;
+}
+
+/*
+ * Move data between the packet and the descriptor buffers by mapping each
+ * buffer in turn, so that no bounce buffer is needed.  Returns the number
+ * of bytes transferred.
+ */
+static dma_addr_t dwc2_packet_copy_sglist(USBPacket *p, QEMUSGList *sgl)
+{
+    DMADirection dir = p->pid == USB_TOKEN_IN ? DMA_DIRECTION_TO_DEVICE :
+                                                DMA_DIRECTION_FROM_DEVICE;
+    dma_addr_t done = 0;
+    int i;
+
+    for (i = 0; i < sgl->nsg; i++) {
+        dma_addr_t base = sgl->sg[i].base;
+        dma_addr_t len = sgl->sg[i].len;
+
+        while (len > 0) {
+            dma_addr_t xlen = len;
+            void *mem = dma_memory_map(sgl->as, base, &xlen, dir,
+                                       MEMTXATTRS_UNSPECIFIED);
+
+            if (mem == NULL) {
+                qemu_log_mask(LOG_GUEST_ERROR,
+                              "%s: failed to map 0x%" PRIx64 "\n", __func__,
+                              (uint64_t)base);
+                return done;
+            }
+            usb_packet_copy(p, mem, xlen);
+            dma_memory_unmap(sgl->as, mem, xlen, dir, xlen);
+            base += xlen;
+            len -= xlen;
+            done += xlen;
+        }
+    }
+
+    return done;
+}
+
 static void dwc2_device_process_packet(DWC2State *s, USBPacket *p)
 {
     int ep = p->ep->nr;
@@ -1243,40 +1333,36 @@ static void dwc2_device_process_packet(DWC2State *s, USBPacket *p)
             }
 
             if (s->dcfg & DCFG_DESCDMA_EN) {
-                struct dwc2_dma_desc desc;
-                dma_addr_t residual;
+                struct dwc2_dma_desc *desc;
+                DWC2DescBatch batch = { 0 };
                 QEMUSGList sglist;
                 bool ioc = false;
                 qemu_sglist_init(&sglist, DEVICE(s), MAX_DMA_DESC_NUM_GENERIC,
                                  &s->dma_as);
-                while (dma_memory_read(
-                           &s->dma_as, s->diepdma(ep) | SOC_DMA_BASE, &desc,
-                           sizeof(desc), MEMTXATTRS_UNSPECIFIED) == MEMTX_OK) {
+                while ((desc = dwc2_desc_next(s, &batch, s->diepdma(ep)))) {
                     uint32_t amtDone2 = 0;
-                    if (DEV_DMA_BUFF_STS_GET(desc.status)) {
+                    if (DEV_DMA_BUFF_STS_GET(desc->status)) {
+                        dwc2_desc_unget(&batch);
                         break;
                     }
-                    dma_addr_t nbytes = desc.status & DEV_DMA_NBYTES_MASK;
+                    dma_addr_t nbytes = desc->status & DEV_DMA_NBYTES_MASK;
                     if (sglist.size + nbytes >= pktsize) {
                         amtDone2 += pktsize - sglist.size;
                         nbytes -= pktsize - sglist.size;
-                        desc.status |= DEV_DMA_L;
+                        desc->status |= DEV_DMA_L;
                     } else {
                         amtDone2 += nbytes;
                         nbytes = 0;
                     }
-                    desc.status &= ~DEV_DMA_NBYTES_MASK;
-                    desc.status |= nbytes & DEV_DMA_NBYTES_MASK;
-                    qemu_sglist_add(&sglist, desc.buf, amtDone2);
-                    ioc |= (desc.status & DEV_DMA_IOC) != 0;
-                    desc.status &= ~DEV_DMA_BUFF_STS_MASK;
-                    desc.status |= DEV_DMA_BUFF_STS_DMADONE
-                                   << DEV_DMA_BUFF_STS_SHIFT;
-                    dma_memory_write(&s->dma_as, s->diepdma(ep) | SOC_DMA_BASE,
-                                     &desc, sizeof(desc),
-                                     MEMTXATTRS_UNSPECIFIED);
-                    s->diepdma(ep) += sizeof(desc);
-                    if (desc.status & DEV_DMA_L) {
+                    desc->status &= ~DEV_DMA_NBYTES_MASK;
+                    desc->status |= nbytes & DEV_DMA_NBYTES_MASK;
+                    qemu_sglist_add(&sglist, desc->buf, amtDone2);
+                    ioc |= (desc->status & DEV_DMA_IOC) != 0;
+                    desc->status &= ~DEV_DMA_BUFF_STS_MASK;
+                    desc->status |= DEV_DMA_BUFF_STS_DMADONE
+                                    << DEV_DMA_BUFF_STS_SHIFT;
+                    s->diepdma(ep) += sizeof(*desc);
+                    if (desc->status & DEV_DMA_L) {
                         break;
                     }
                 }
@@ -1284,14 +1370,8 @@ static void dwc2_device_process_packet(DWC2State *s, USBPacket *p)
                 qemu_log_mask(LOG_UNIMP, "%s: starting IN transfer on EP %d (%zu/%d)...\n",
                                 __func__, ep, sglist.size, pktsize);
 #endif
-                buffer = g_malloc0(sglist.size);
-                dma_buf_write(buffer, sglist.size, &residual, &sglist,
-                              MEMTXATTRS_UNSPECIFIED);
-                amtDone = sglist.size - residual;
-                usb_packet_copy(p, buffer, amtDone);
-#if 0
-                qemu_hexdump(stderr, __func__, buffer, sglist.size);
-#endif
+                amtDone = dwc2_packet_copy_sglist(p, &sglist);
+                dwc2_desc_flush(s, &batch);
                 s->diepctl(ep) &= ~DXEPCTL_EPENA;
                 s->diepint(ep) |= DXEPINT_XFERCOMPL;
                 qemu_sglist_destroy(&sglist);
@@ -1382,6 +1462,7 @@ static void dwc2_device_process_packet(DWC2State *s, USBPacket *p)
         if (s->doepctl(ep) & DXEPCTL_EPENA) {
             int sz, pktcnt, supcnt, mps;
             uint32_t amtDone = 0;
+            size_t start = p->actual_length;
             g_autofree void *buffer = NULL;
 
             if (ep == 0) {
@@ -1413,48 +1494,44 @@ static void dwc2_device_process_packet(DWC2State *s, USBPacket *p)
             }
 
             if (s->dcfg & DCFG_DESCDMA_EN) {
-                struct dwc2_dma_desc desc;
+                struct dwc2_dma_desc *desc;
+                DWC2DescBatch batch = { 0 };
                 QEMUSGList sglist;
                 bool ioc = false;
-                dma_addr_t residual;
                 qemu_sglist_init(&sglist, DEVICE(s), MAX_DMA_DESC_NUM_GENERIC,
                                  &s->dma_as);
-                while (dma_memory_read(
-                           &s->dma_as, s->doepdma(ep) | SOC_DMA_BASE, &desc,
-                           sizeof(desc), MEMTXATTRS_UNSPECIFIED) == MEMTX_OK) {
+                while ((desc = dwc2_desc_next(s, &batch, s->doepdma(ep)))) {
                     amtDone = 0;
-                    if (DEV_DMA_BUFF_STS_GET(desc.status)) {
+                    if (DEV_DMA_BUFF_STS_GET(desc->status)) {
+                        dwc2_desc_unget(&batch);
                         break;
                     }
-                    dma_addr_t nbytes = desc.status & DEV_DMA_NBYTES_MASK;
+                    dma_addr_t nbytes = desc->status & DEV_DMA_NBYTES_MASK;
                     if (sglist.size + nbytes >= pktsize) {
                         amtDone += pktsize - sglist.size;
                         nbytes -= pktsize - sglist.size;
                         if ((sglist.size + amtDone) % mps ||
                             (sglist.size + amtDone) == 0) {
-                            desc.status |= DEV_DMA_SHORT;
+                            desc->status |= DEV_DMA_SHORT;
                         }
                         if (p->pid == USB_TOKEN_SETUP) {
-                            desc.status |= DEV_DMA_SR;
+                            desc->status |= DEV_DMA_SR;
                         }
-                        desc.status |= DEV_DMA_L;
+                        desc->status |= DEV_DMA_L;
                     } else {
                         amtDone += nbytes;
                         nbytes = 0;
                     }
-                    qemu_sglist_add(&sglist, desc.buf, amtDone);
-                    desc.status &= ~DEV_DMA_NBYTES_MASK;
-                    desc.status |= nbytes & DEV_DMA_NBYTES_MASK;
-                    desc.status &= ~DEV_DMA_BUFF_STS_MASK;
-                    desc.status |= DEV_DMA_BUFF_STS_DMADONE
-                                   << DEV_DMA_BUFF_STS_SHIFT;
-                    dma_memory_write(&s->dma_as, s->doepdma(ep) | SOC_DMA_BASE,
-                                     &desc, sizeof(desc),
-                                     MEMTXATTRS_UNSPECIFIED);
-                    ioc |= (desc.status & DEV_DMA_IOC) != 0;
-
-                    s->doepdma(ep) += sizeof(desc);
-                    if (desc.status & DEV_DMA_L) {
+                    qemu_sglist_add(&sglist, desc->buf, amtDone);
+                    desc->status &= ~DEV_DMA_NBYTES_MASK;
+                    desc->status |= nbytes & DEV_DMA_NBYTES_MASK;
+                    desc->status &= ~DEV_DMA_BUFF_STS_MASK;
+                    desc->status |= DEV_DMA_BUFF_STS_DMADONE
+                                    << DEV_DMA_BUFF_STS_SHIFT;
+                    ioc |= (desc->status & DEV_DMA_IOC) != 0;
+
+                    s->doepdma(ep) += sizeof(*desc);
+                    if (desc->status & DEV_DMA_L) {
                         break;
                     }
                 }
@@ -1462,14 +1539,8 @@ static void dwc2_device_process_packet(DWC2State *s, USBPacket *p)
                 qemu_log_mask(LOG_UNIMP, "%s: starting OUT transfer on EP %d (%zu/%d)...\n",
                                 __func__, ep, sglist.size, pktsize);
 #endif
-                buffer = g_malloc0(sglist.size);
-                usb_packet_copy(p, buffer, sglist.size);
-                dma_buf_read(buffer, sglist.size, &residual, &sglist,
-                             MEMTXATTRS_UNSPECIFIED);
-                amtDone = sglist.size - residual;
-#if 0
-                qemu_hexdump(stderr, __func__, buffer, sglist.size);
-#endif
+                amtDone = dwc2_packet_copy_sglist(p, &sglist);
+                dwc2_desc_flush(s, &batch);
                 qemu_sglist_destroy(&sglist);
             } else {
                 amtDone = sz;
@@ -1531,7 +1602,8 @@ static void dwc2_device_process_packet(DWC2State *s, USBPacket *p)
             if (p->pid == USB_TOKEN_SETUP && amtDone >= 8) {
                 struct usb_control_packet setup;
 
-                memcpy(&setup, buffer, sizeof(setup));
+                iov_to_buf(p->iov.iov, p->iov.niov, start, &setup,
+                           sizeof(setup));
 
 #if 0
                 qemu_log_mask(LOG_UNIMP, "%s: SETUP {%02x,%02x,%04x,%04x,%04x}\n",
@@ -132,6 +132,12 @@ static void wdt_update(void *opaque)
             expiry = MIN(expiry, d);
         }
     }
+    if (!(s->reg.chip_control & (WDOG_CTL_EN_RESET | WDOG_CTL_EN_IRQ)) &&
+        !(s->reg.sys_control & WDOG_CTL_EN_RESET)) {
+        /* Nothing armed, don't wake the host up for nothing. */
+        timer_del(s->timer);
+        return;
+    }
     expiry *= s->cnt_period_ns;
     timer_mod_ns(s->timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + expiry);
 }
@@ -776,6 +776,7 @@ struct MemoryRegion {
     bool rom_device;
     bool flush_coalesced_mmio;
     bool unmergeable;
+    bool lockless_io;
     uint8_t dirty_log_mask;
     bool is_iommu;
     RAMBlock *ram_block;
@@ -808,6 +809,9 @@ struct MemoryRegion {
 
     /* For devices designed to perform re-entrant IO into their own IO MRs */
     bool disable_reentrancy_guard;
+
+    /* Access statistics, allocated on first access while profiling */
+    struct MemoryRegionProfile *profile;
 };
 
 struct IOMMUMemoryRegion {
@@ -2253,6 +2257,20 @@ void memory_region_set_flush_coalesced(MemoryRegion *mr);
  */
 void memory_region_clear_flush_coalesced(MemoryRegion *mr);
 
+/**
+ * memory_region_enable_lockless_io: Dispatch accesses without the BQL.
+ *
+ * Accesses to the region are normally dispatched with the Big QEMU Lock
+ * held.  Regions whose callbacks do their own locking can opt out, so that
+ * vCPUs accessing them do not serialize on the BQL.  The callbacks then run
+ * concurrently with each other and with the rest of QEMU; any work that
+ * needs the BQL (e.g. raising a CPU interrupt line) must take it explicitly
+ * with bql_lock() or BQL_LOCK_GUARD().
+ *
+ * @mr: the memory region to be updated.
+ */
+void memory_region_enable_lockless_io(MemoryRegion *mr);
+
 /**
  * memory_region_add_eventfd: Request an eventfd to be triggered when a word
  *                            is written to a location.
@@ -2579,6 +2597,39 @@ void memory_global_dirty_log_stop(unsigned int flags);
 
 void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled);
 
+/**
+ * mtree_profile_enable: start or stop MMIO access profiling
+ *
+ * While enabled, every access dispatched to an I/O region is counted and
+ * timed (host nanoseconds) per region and offset bucket.  Statistics that
+ * were already collected are kept when profiling is stopped.
+ *
+ * @enable: whether to profile accesses from now on
+ */
+void mtree_profile_enable(bool enable);
+
+/**
+ * mtree_profile_is_enabled: check whether MMIO access profiling is running
+ */
+bool mtree_profile_is_enabled(void);
+
+/**
+ * mtree_profile_reset: discard all collected MMIO access statistics
+ */
+void mtree_profile_reset(void);
+
+/**
+ * mtree_profile_format: format the collected MMIO access statistics
+ *
+ * Returns a table of the busiest offset buckets sorted by total host time,
+ * or, if @folded is set, one line per bucket and direction in the "folded
+ * stacks" format understood by flamegraph.pl, weighted by host nanoseconds.
+ *
+ * @folded: emit folded stacks instead of a table
+ * @max: maximum number of table rows, 0 for no limit; ignored if @folded
+ */
+GString *mtree_profile_format(bool folded, unsigned max);
+
 bool memory_region_access_valid(MemoryRegion *mr, hwaddr addr,
                                 unsigned size, bool is_write,
                                 MemTxAttrs attrs);
@@ -65,6 +65,16 @@ typedef struct AppleA13State {
     uint64_t mpidr;
     uint64_t ipi_sr;
     qemu_irq fast_ipi;
+    qemu_irq pmi;
+    QEMUTimer *pmu_timer;
+    /* Event source readings at the last PMC0/PMC1 sync */
+    uint64_t pmc_ref[2];
+    /* Virtual time spent executing, which PMC0 counts cycles of */
+    int64_t pmu_run_ns;
+    int64_t pmu_exec_start;
+    bool pmu_executing;
+    /* Instructions already folded into pmu_run_ns, with icount */
+    int64_t pmu_insns;
     A13_CPREG_VAR_DEF(ARM64_REG_EHID3);
     A13_CPREG_VAR_DEF(ARM64_REG_EHID4);
     A13_CPREG_VAR_DEF(ARM64_REG_EHID10);
@@ -112,6 +122,8 @@ typedef struct AppleA13Cluster {
     uint32_t cluster_type;
     MemoryRegion mr;
     AppleA13State *cpus[A13_MAX_CPU];
+    /* Protects deferredIPI and noWakeIPI */
+    QemuMutex ipi_lock;
     uint32_t deferredIPI[A13_MAX_CPU][A13_MAX_CPU];
     uint32_t noWakeIPI[A13_MAX_CPU][A13_MAX_CPU];
     uint64_t tick;
@@ -43,18 +43,50 @@ hwaddr vtop_mmu(hwaddr va, CPUState *cs);
 hwaddr vtop_bases(hwaddr va, hwaddr phys_base, hwaddr virt_base);
 hwaddr ptov_bases(hwaddr pa, hwaddr phys_base, hwaddr virt_base);
 
+/// Allocates a RAM region from a host memory backend configured like the
+/// machine's DRAM backend, and maps it at `addr` in `top`.
 void allocate_ram(MemoryRegion *top, const char *name, hwaddr addr, hwaddr size,
                   int priority);
+/// Maps an existing RAM region, e.g. the machine's DRAM, and records it in
+/// the memory layout shown by `info apple-memmap`.
+void apple_mem_map_ram(MemoryRegion *top, const char *name, hwaddr addr,
+                       MemoryRegion *mr, int priority);
 
 typedef struct CarveoutAllocator CarveoutAllocator;
 
 /// Creates a new carveout allocator
 CarveoutAllocator *carveout_alloc_new(DTBNode *carveout_mmap, hwaddr dram_base,
                                       hwaddr dram_size, hwaddr alignment);
+/// The carveout's contents are set up again on every boot, so its host
+/// pages are discarded when the next boot allocates the carveouts again
+/// and stay unpopulated until the guest touches them.
+#define CARVEOUT_DISCARDABLE (1 << 0)
+
 /// Returns the address of the allocated region.
-hwaddr carveout_alloc_mem(CarveoutAllocator *ca, hwaddr size);
+hwaddr carveout_alloc_mem(CarveoutAllocator *ca, const char *name,
+                          hwaddr size, uint32_t flags);
 /// Returns the kernel region size.
 /// The pointer `ca` will no longer be valid after this point.
 hwaddr carveout_alloc_finalise(CarveoutAllocator *ca);
+/// Discards the discardable carveouts of the last allocation again, as a
+/// new allocation would.
+void carveout_discard_all(void);
+
+/// Pristine copy of the guest memory set up for a boot, so that a reboot
+/// can put back the pages the guest modified instead of loading
+/// everything again.
+typedef struct AppleBootImage AppleBootImage;
+
+/// Creates an empty image. `key` describes the inputs the boot was set up
+/// from, the image is only restored while they stay the same.
+AppleBootImage *apple_boot_image_new(GBytes *key);
+/// Records the current contents of the RAM at [addr, addr + size), or
+/// zeroes if `zero` is set.
+void apple_boot_image_add(AppleBootImage *image, hwaddr addr, hwaddr size,
+                          bool zero);
+/// Puts back the pages that differ from the image. Returns false without
+/// touching memory if `key` differs.
+bool apple_boot_image_restore(AppleBootImage *image, GBytes *key);
+void apple_boot_image_free(AppleBootImage *image);
 
 #endif /* HW_ARM_APPLE_SILICON_MEM_H */
@@ -27,6 +27,7 @@
 #include "hw/arm/apple-silicon/boot.h"
 #include "hw/boards.h"
 #include "hw/cpu/cluster.h"
+#include "hw/misc/apple-silicon/pmgr.h"
 #include "hw/sysbus.h"
 #include "system/kvm.h"
 
@@ -76,6 +77,7 @@ typedef struct {
     hwaddr panic_base;
     hwaddr panic_size;
     char pmgr_reg[0x100000];
+    ApplePMGRState *pmgr;
     bool kaslr_off;
     bool force_dfu;
     uint32_t board_id;
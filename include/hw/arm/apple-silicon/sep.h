@@ -22,10 +22,12 @@
 #define HW_ARM_APPLE_SILICON_SEP_H
 
 #include "qemu/osdep.h"
+#include "crypto/cipher.h"
 #include "hw/arm/apple-silicon/dtb.h"
 #include "hw/i2c/i2c.h"
 #include "hw/misc/apple-silicon/a7iop/core.h"
 #include "hw/sysbus.h"
+#include "qemu/units.h"
 #include "qom/object.h"
 #include "cpu-qom.h"
 #include "nettle/drbg-ctr.h"
@@ -41,6 +43,10 @@ OBJECT_DECLARE_TYPE(AppleSEPState, AppleSEPClass, APPLE_SEP)
 typedef struct AppleSSCState AppleSSCState;
 DECLARE_INSTANCE_CHECKER(AppleSSCState, APPLE_SSC, TYPE_APPLE_SSC)
 
+// Raised when the SEP demotes the current fuses, until the next SoC reset.
+#define APPLE_SEP_FUSE_CHANGER "sep-fuse-changer"
+#define APPLE_SEP_FUSE_CHANGER_COUNT (2)
+
 #define DEBUG_TRACE_SIZE (0x10000)
 
 // Some SEPFW versions can be a tad larger than 8 MiB
@@ -48,7 +54,32 @@ DECLARE_INSTANCE_CHECKER(AppleSSCState, APPLE_SSC, TYPE_APPLE_SSC)
 #define SEP_DMA_MAPPING_SIZE (SEPFW_MAPPING_SIZE * 2)
 #define SEP_SHMBUF_BASE (SEPFW_MAPPING_SIZE + 0xC000)
 
+#define SEP_CIPHER_CACHE_SIZE (8)
+
+// Expanded cipher contexts, looked up by algorithm, mode and key bytes.
 typedef struct {
+    QCryptoCipher *cipher;
+    QCryptoCipherAlgo alg;
+    QCryptoCipherMode mode;
+    size_t key_len;
+    uint8_t key[32];
+    uint64_t last_use;
+} AppleSEPCipherCacheEntry;
+
+typedef struct {
+    AppleSEPCipherCacheEntry entries[SEP_CIPHER_CACHE_SIZE];
+    uint64_t clock;
+} AppleSEPCipherCache;
+
+#define SEP_TRNG_POOL_SIZE (4 * KiB)
+
+typedef struct {
+    AppleSEPState *sep;
+    AppleSEPCipherCache ciphers;
+    // Host random bytes, consumed from the top down and topped up by pool_bh.
+    uint8_t pool[SEP_TRNG_POOL_SIZE];
+    size_t pool_avail;
+    QEMUBH *pool_bh;
     uint8_t key[32];
     uint8_t fifo[16];
     uint32_t offset_0x70;
@@ -60,6 +91,8 @@ typedef struct {
 } AppleTRNGState;
 
 typedef struct {
+    AppleSEPState *sep;
+    AppleSEPCipherCache ciphers;
     uint32_t chip_id;
     uint32_t status; // 0x4
     uint32_t command; // 0x8
@@ -105,6 +138,7 @@ typedef struct {
 } AppleAESSState;
 
 typedef struct {
+    AppleSEPState *sep;
     uint32_t command; // 0x0
     uint32_t status0; // 0x4
     uint32_t status_in0; // 0x8
@@ -167,10 +201,28 @@ typedef struct {
 #define SSC_RESPONSE_FLAG_CURVE_INVALID 0x20
 #define SSC_RESPONSE_FLAG_OK 0x80
 
+#define SSC_STORE_SIZE                                  \
+    (KBKDF_KEY_KEY_FILE_OFFSET * CMD_METADATA_DATA_PAYLOAD_LENGTH * \
+         SSC_REQUEST_MAX_COPIES +                       \
+     KBKDF_KEY_MAX_SLOTS * CMD_METADATA_PAYLOAD_LENGTH)
+
+// Derived per-slot values that only depend on the fixed private key.
+typedef struct {
+    char priv[SECP384_PUBLIC_XY_SIZE + 1];
+    uint8_t pub_xy[SECP384_PUBLIC_XY_SIZE];
+    bool shared_valid;
+    uint8_t peer_xy[SECP384_PUBLIC_XY_SIZE];
+    uint8_t shared_x[SECP384_PUBLIC_SIZE];
+} AppleSSCKeyCache;
+
 struct AppleSSCState {
     /*< private >*/
     I2CSlave i2c;
     BlockBackend *blk;
+    // Copy of the whole backing store, reads never touch the drive.
+    uint8_t *store;
+    AppleSSCKeyCache main_key_cache;
+    AppleSSCKeyCache key_cache[KBKDF_KEY_MAX_SLOTS];
 
     /*< public >*/
     uint32_t req_cur;
@@ -222,6 +274,9 @@ struct AppleSEPState {
     /*< public >*/
     vaddr base;
     ARMCPU *cpu;
+    unsigned long *host_cpus;
+    unsigned long host_cpus_nbits;
+    bool mailbox_poll_halt;
     bool modern;
     MemoryRegion *ool_mr;
     AddressSpace *ool_as;
@@ -273,6 +328,7 @@ struct AppleSEPState {
     gchar *sepfw_data;
     bool pmgr_fuse_changer_bit0_was_set;
     bool pmgr_fuse_changer_bit1_was_set;
+    qemu_irq fuse_changer[APPLE_SEP_FUSE_CHANGER_COUNT];
     uint8_t key_fcfg_offset_0x14_index;
     uint16_t key_fcfg_offset_0x14_values[5];
 };
@@ -25,7 +25,10 @@
 #include "exec/hwaddr.h"
 #include "hw/arm/apple-silicon/a13.h"
 #include "hw/arm/apple-silicon/boot.h"
+#include "hw/arm/apple-silicon/mem.h"
 #include "hw/boards.h"
+#include "hw/misc/apple-silicon/pmgr.h"
+#include "hw/misc/apple-silicon/reg-page.h"
 #include "hw/sysbus.h"
 #include "hw/usb/tcp-usb.h"
 #include "system/kvm.h"
@@ -48,6 +51,12 @@ typedef enum {
     kBootModeExitRecovery,
 } BootMode;
 
+typedef struct {
+    AppleRegPage page;
+    AppleRegPageInfo info;
+    hwaddr base;
+} T8030PMGRRegion;
+
 typedef struct {
     MachineState parent;
 
@@ -55,17 +64,22 @@ typedef struct {
     hwaddr soc_size;
     unsigned long dram_size;
     AppleA13State *cpus[A13_MAX_CPU];
+    unsigned int cpu_count;
+    uint32_t e_cores;
+    uint32_t p_cores;
     AppleA13Cluster clusters[A13_MAX_CLUSTER];
     SysBusDevice *aic;
     MachoHeader64 *kernel;
     DTBNode *device_tree;
     uint8_t *trustcache;
     AppleBootInfo boot_info;
+    AppleBootImage *boot_image;
     AppleVideoArgs video_args;
     char *trustcache_filename;
     char *ticket_filename;
     char *sep_rom_filename;
     char *sep_fw_filename;
+    char *uart_log_filename;
     BootMode boot_mode;
     uint32_t rtkit_protocol_ver;
     uint32_t sio_protocol;
@@ -75,9 +89,14 @@ typedef struct {
     hwaddr panic_base;
     hwaddr panic_size;
     uint8_t pmgr_reg[0x100000];
-    MemoryRegion amcc;
-    uint8_t amcc_reg[0x100000];
+    ApplePMGRState *pmgr;
+    T8030PMGRRegion *pmgr_regions;
+    int pmgr_nb_regions;
+    ARMCPU *sep_cpu;
+    AppleRegPage amcc;
     bool kaslr_off;
+    bool warm_reboot;
+    bool amx;
     bool force_dfu;
     uint32_t board_id;
     uint32_t chip_revision;
@@ -6,6 +6,16 @@
 #include "qom/object.h"
 #include "target/arm/cpu-qom.h"
 
+#define APPLE_UART_LOG_MAX_CHANNELS (16)
+
+/* Timestamped binary log shared by any number of UARTs. */
+typedef struct AppleUartLog AppleUartLog;
+
 DeviceState *apple_uart_create(hwaddr addr, int fifo_size, int channel,
                                Chardev *chr, qemu_irq irq);
+/* Also send everything the UART transmits to @log, tagged with @channel. */
+void apple_uart_set_log(DeviceState *dev, AppleUartLog *log, uint8_t channel);
+
+AppleUartLog *apple_uart_log_open(const char *path, Error **errp);
+void apple_uart_log_putc(AppleUartLog *log, uint8_t channel, uint8_t ch);
 #endif /* APPLE_UART_H */
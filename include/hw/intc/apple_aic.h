@@ -18,12 +18,18 @@ typedef struct {
     uint32_t pendingIPI;
     uint32_t deferredIPI;
     uint32_t ipi_mask;
+    /* Line level computed under the AIC mutex, and the one last applied */
+    bool irq_level;
+    bool irq_applied;
 } AppleAICCPU;
 
 struct AppleAICState {
     SysBusDevice parent_obj;
     QEMUTimer *timer;
     QemuMutex mutex;
+    bool irq_dirty;
+    /* Cleared while the PMGR domain is off */
+    bool powered;
     uint32_t phandle;
     uint32_t base_size;
     uint32_t numEIR;
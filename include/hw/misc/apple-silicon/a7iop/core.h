@@ -37,6 +37,7 @@ void apple_a7iop_send_ap(AppleA7IOP *s, AppleA7IOPMessage *msg);
 AppleA7IOPMessage *apple_a7iop_recv_ap(AppleA7IOP *s);
 void apple_a7iop_send_iop(AppleA7IOP *s, AppleA7IOPMessage *msg);
 AppleA7IOPMessage *apple_a7iop_recv_iop(AppleA7IOP *s);
+void apple_a7iop_recv_iop_all(AppleA7IOP *s, AppleA7IOPMessageQueue *queue);
 void apple_a7iop_cpu_start(AppleA7IOP *s, bool wake);
 uint32_t apple_a7iop_get_cpu_status(AppleA7IOP *s);
 void apple_a7iop_set_cpu_status(AppleA7IOP *s, uint32_t value);
@@ -15,6 +15,8 @@ typedef struct AppleA7IOPMessage {
     QTAILQ_ENTRY(AppleA7IOPMessage) next;
 } AppleA7IOPMessage;
 
+typedef QTAILQ_HEAD(, AppleA7IOPMessage) AppleA7IOPMessageQueue;
+
 extern const VMStateDescription vmstate_apple_a7iop_message;
 
 #define VMSTATE_APPLE_A7IOP_MESSAGE(_field, _state)                  \
@@ -66,7 +68,7 @@ struct AppleA7IOPMailbox {
     QemuMutex lock;
     MemoryRegion mmio;
     QEMUBH *bh;
-    QTAILQ_HEAD(, AppleA7IOPMessage) inbox;
+    AppleA7IOPMessageQueue inbox;
     QTAILQ_HEAD(, AppleA7IOPInterruptStatusMessage) interrupt_status;
     uint32_t count;
     AppleA7IOPMailbox *iop_mailbox;
@@ -86,6 +88,17 @@ struct AppleA7IOPMailbox {
     bool iop_empty;
     bool ap_nonempty;
     bool ap_empty;
+    // Empty inbox polling by poll_cpu, protected by the BQL.
+    CPUState *poll_cpu;
+    QEMUTimer *poll_timer;
+    bool poll_halted;
+    uint32_t poll_count;
+    int64_t poll_last;
+    int64_t poll_interval;
+    int64_t poll_halt_start;
+    uint64_t poll_halts;
+    uint64_t poll_timeouts;
+    uint64_t polls_avoided;
 };
 
 void apple_a7iop_mailbox_update_irq_status(AppleA7IOPMailbox *s);
@@ -97,6 +110,10 @@ AppleA7IOPMessage *apple_a7iop_inbox_peek(AppleA7IOPMailbox *s);
 void apple_a7iop_interrupt_status_push(AppleA7IOPMailbox *s, uint32_t status);
 AppleA7IOPMessage *apple_a7iop_mailbox_recv_iop(AppleA7IOPMailbox *s);
 AppleA7IOPMessage *apple_a7iop_mailbox_recv_ap(AppleA7IOPMailbox *s);
+void apple_a7iop_mailbox_recv_iop_all(AppleA7IOPMailbox *s,
+                                      AppleA7IOPMessageQueue *queue);
+void apple_a7iop_mailbox_set_poll_cpu(AppleA7IOPMailbox *s, CPUState *cpu);
+void apple_a7iop_mailbox_poll_cpu_resumed(AppleA7IOPMailbox *s);
 AppleA7IOPMailbox *apple_a7iop_mailbox_new(const char *role,
                                            AppleA7IOPVersion version,
                                            AppleA7IOPMailbox *iop_mailbox,
@@ -67,12 +67,6 @@ typedef struct {
     bool user;
 } AppleRTKitEPData;
 
-typedef struct {
-    AppleRTKit *s;
-    uint32_t mask;
-    uint32_t last_block;
-} AppleRTKitRollcallData;
-
 typedef struct {
     void (*start)(void *opaque);
     void (*wakeup)(void *opaque);
@@ -97,8 +91,9 @@ struct AppleRTKit {
     void *opaque;
     uint8_t ep0_status;
     uint32_t protocol_version;
-    GTree *endpoints;
-    QTAILQ_HEAD(, AppleA7IOPMessage) rollcall;
+    // Indexed by the raw endpoint number, unused entries have no opaque.
+    AppleRTKitEPData endpoints[256];
+    AppleA7IOPMessageQueue rollcall;
 };
 
 void apple_rtkit_send_control_msg(AppleRTKit *s, uint32_t ep, uint64_t data);
@@ -0,0 +1,70 @@
+/*
+ * Apple PMGR power domains.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HW_MISC_APPLE_SILICON_PMGR_H
+#define HW_MISC_APPLE_SILICON_PMGR_H
+
+#include "qemu/osdep.h"
+#include "hw/arm/apple-silicon/dtb.h"
+#include "hw/sysbus.h"
+#include "qemu/timer.h"
+#include "qom/object.h"
+
+/*
+ * Tracks the power state of the PMGR domains listed in the device tree.
+ * The machine keeps handling the PMGR registers and reports power state
+ * writes, which turn the consumers of a domain on or off.
+ */
+
+#define TYPE_APPLE_PMGR "apple-pmgr"
+OBJECT_DECLARE_SIMPLE_TYPE(ApplePMGRState, APPLE_PMGR)
+
+/*
+ * Named input of devices that can be powered down. It is high while all
+ * the domains of the device are on, which is also the reset state.
+ */
+#define APPLE_PMGR_POWER "pmgr-power"
+
+SysBusDevice *apple_pmgr_create(DTBNode *node);
+/* Drive @power from the domains listed in the clock-gates of @node. */
+void apple_pmgr_connect(ApplePMGRState *s, DTBNode *node, qemu_irq power);
+/*
+ * Guest write of @value to @offset of the first PMGR block. Offsets that
+ * are not power state registers are ignored.
+ */
+void apple_pmgr_ps_write(ApplePMGRState *s, hwaddr offset, uint32_t value);
+
+/* Stop @timer, returning the time it had left or -1 if it was not armed. */
+static inline int64_t apple_pmgr_timer_pause(QEMUTimer *timer)
+{
+    int64_t expire = timer_expire_time_ns(timer);
+
+    if (expire < 0) {
+        return -1;
+    }
+    timer_del(timer);
+    return MAX(expire - qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL), 0);
+}
+
+static inline void apple_pmgr_timer_resume(QEMUTimer *timer, int64_t remaining)
+{
+    if (remaining >= 0) {
+        timer_mod(timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + remaining);
+    }
+}
+
+#endif /* HW_MISC_APPLE_SILICON_PMGR_H */
@@ -0,0 +1,78 @@
+/*
+ * Apple RAM-backed register pages.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HW_MISC_APPLE_SILICON_REG_PAGE_H
+#define HW_MISC_APPLE_SILICON_REG_PAGE_H
+
+#include "qemu/osdep.h"
+#include "exec/memory.h"
+
+/*
+ * A register page is a block of 32-bit registers that the guest reads
+ * straight from RAM, for blocks that are pure read-back storage or hold
+ * constants.  Guest reads never leave the TLB fast path.  Guest writes are
+ * stored directly as well, unless some register of the page is read-only
+ * or has a write notifier, in which case writes to the page trap.
+ */
+
+/* Guest writes to the register are discarded. */
+#define APPLE_REG_RO (1 << 0)
+/* Guest writes to the register call the page's notifier. */
+#define APPLE_REG_NOTIFY (1 << 1)
+
+typedef struct AppleRegDef {
+    hwaddr addr;
+    uint32_t value;
+    uint32_t flags;
+} AppleRegDef;
+
+/*
+ * Called after a guest write to an APPLE_REG_NOTIFY register has been
+ * stored (or discarded, if the register is also APPLE_REG_RO).
+ */
+typedef void (*AppleRegPageNotify)(void *opaque, hwaddr addr, uint64_t old,
+                                   uint64_t val, unsigned size);
+
+typedef struct AppleRegPageInfo {
+    /* Reset value and flags of the registers not listed in @regs */
+    uint32_t fill;
+    uint32_t flags;
+    const AppleRegDef *regs;
+    size_t nb_regs;
+    AppleRegPageNotify notify;
+} AppleRegPageInfo;
+
+typedef struct AppleRegPage {
+    MemoryRegion mr;
+    const AppleRegPageInfo *info;
+    void *opaque;
+    uint8_t *regs;
+    uint64_t size;
+    unsigned long *ro;
+    unsigned long *notify;
+} AppleRegPage;
+
+void apple_reg_page_init(AppleRegPage *page, Object *owner, const char *name,
+                         uint64_t size, const AppleRegPageInfo *info,
+                         void *opaque);
+/* Restore the reset values declared in the page's info. */
+void apple_reg_page_reset(AppleRegPage *page);
+uint32_t apple_reg_page_read32(AppleRegPage *page, hwaddr addr);
+/* Device-side update, not subject to APPLE_REG_RO or notification. */
+void apple_reg_page_write32(AppleRegPage *page, hwaddr addr, uint32_t val);
+
+#endif /* HW_MISC_APPLE_SILICON_REG_PAGE_H */
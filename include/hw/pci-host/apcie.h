@@ -23,6 +23,7 @@
 #define APCIE_H
 
 #include "hw/arm/apple-silicon/dtb.h"
+#include "hw/misc/apple-silicon/reg-page.h"
 #include "hw/pci/pci_bridge.h"
 #include "hw/pci/pcie_host.h"
 #include "hw/pci/pcie_port.h"
@@ -89,7 +90,7 @@ struct ApplePCIEHost {
     MemoryRegion root_cfg;
     MemoryRegion root_common;
     MemoryRegion root_phy;
-    MemoryRegion root_phy_ip;
+    AppleRegPage root_phy_ip;
     MemoryRegion root_axi2af;
     uint32_t root_phy_enabled;
     uint32_t root_refclk_buffer_enabled;
@@ -117,7 +118,7 @@ struct ApplePCIEPort {
 
     MemoryRegion port_cfg;
     MemoryRegion port_phy_glue;
-    MemoryRegion port_phy_ip;
+    AppleRegPage port_phy_ip;
     MemoryRegion port_config_ltssm_debug;
 
     uint32_t port_ltssm_enable; // 0x80
@@ -2,18 +2,19 @@
 #define APPLE_OTG_H
 
 #include "hw/arm/apple-silicon/dtb.h"
+#include "hw/misc/apple-silicon/reg-page.h"
 #include "hw/sysbus.h"
 #include "hw/usb/hcd-dwc2.h"
 #include "hw/usb/hcd-tcp.h"
 #include "qom/object.h"
 
 #define TYPE_APPLE_OTG "apple.otg"
+#define APPLE_OTG_PHY_REG_SIZE (0x20)
 OBJECT_DECLARE_SIMPLE_TYPE(AppleOTGState, APPLE_OTG)
 
 struct AppleOTGState {
     SysBusDevice parent_obj;
-    MemoryRegion phy;
-    uint8_t phy_reg[0x20];
+    AppleRegPage phy;
     MemoryRegion usbctl;
     uint8_t usbctl_reg[0x1000];
     MemoryRegion widget;
@@ -61,5 +61,6 @@ void hmp_gva2gpa(Monitor *mon, const QDict *qdict);
 void hmp_gpa2hva(Monitor *mon, const QDict *qdict);
 void hmp_gpa2hpa(Monitor *mon, const QDict *qdict);
 void hmp_info_dart(Monitor *mon, const QDict *qdict);
+void hmp_info_apple_memmap(Monitor *mon, const QDict *qdict);
 
 #endif /* MONITOR_HMP_TARGET_H */
@@ -0,0 +1,34 @@
+/*
+ * WKdm page compression, as done by the Apple WKdmC/WKdmD instructions.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef QEMU_WKDM_H
+#define QEMU_WKDM_H
+
+#include "qemu/units.h"
+
+/* The instructions work on 16 KiB pages, whatever the target page size. */
+#define WKDM_PAGE_SIZE (16 * KiB)
+
+/*
+ * Compress the WKDM_PAGE_SIZE bytes at @src_buf into at most @byte_budget
+ * bytes at @dest_buf.  Returns the compressed size in bytes, 0 if the page
+ * holds a single value, or -1 if it does not fit.
+ */
+int WKdm_compress(const void *src_buf, void *dest_buf, int byte_budget);
+
+/*
+ * Decompress from at most @size bytes at @src_buf into the WKDM_PAGE_SIZE
+ * bytes at @dest_buf.
+ */
+bool WKdm_decompress(const void *src_buf, void *dest_buf, unsigned int size);
+
+/*
+ * Switch to the next slower host vector implementation, for testing.
+ * Returns false once the generic one is in use.
+ */
+bool test_WKdm_next_accel(void);
+
+#endif /* QEMU_WKDM_H */
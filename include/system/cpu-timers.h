@@ -46,6 +46,9 @@ void icount_update(CPUState *cpu);
 /* get raw icount value */
 int64_t icount_get_raw(void);
 
+/* get the number of instructions executed by @cpu */
+int64_t icount_get_cpu(CPUState *cpu);
+
 /* return the virtual CPU time in ns, based on the instruction counter. */
 int64_t icount_get(void);
 /*
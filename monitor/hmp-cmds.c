@@ -419,6 +419,40 @@ void hmp_info_mtree(Monitor *mon, const QDict *qdict)
     mtree_info(flatview, dispatch_tree, owner, disabled);
 }
 
+void hmp_mtree_profile(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_try_str(qdict, "op");
+
+    if (op == NULL) {
+        bool on = mtree_profile_is_enabled();
+
+        monitor_printf(mon, "mtree-profile is %s\n", on ? "on" : "off");
+        return;
+    }
+    if (!strcmp(op, "on")) {
+        mtree_profile_enable(true);
+    } else if (!strcmp(op, "off")) {
+        mtree_profile_enable(false);
+    } else if (!strcmp(op, "reset")) {
+        mtree_profile_reset();
+    } else {
+        Error *err = NULL;
+
+        error_setg(&err, "invalid parameter '%s',"
+                   " expecting 'on', 'off', or 'reset'", op);
+        hmp_handle_error(mon, err);
+    }
+}
+
+void hmp_info_mtree_profile(Monitor *mon, const QDict *qdict)
+{
+    bool folded = qdict_get_try_bool(qdict, "folded", false);
+    int64_t max = qdict_get_try_int(qdict, "max", 20);
+    g_autoptr(GString) buf = mtree_profile_format(folded, MAX(max, 0));
+
+    monitor_puts(mon, buf->str);
+}
+
 #if defined(CONFIG_FDT)
 void hmp_dumpdtb(Monitor *mon, const QDict *qdict)
 {
@@ -5327,6 +5327,15 @@ SRST
     Enable synchronization profiling.
 ERST
 
+DEF("enable-mtree-profile", 0, QEMU_OPTION_enable_mtree_profile,
+    "-enable-mtree-profile\n"
+    "                enable MMIO access profiling\n",
+    QEMU_ARCH_ALL)
+SRST
+``-enable-mtree-profile``
+    Enable MMIO access profiling from startup, see ``info mtree-profile``.
+ERST
+
 #if defined(CONFIG_TCG) && defined(CONFIG_LINUX)
 DEF("perfmap", 0, QEMU_OPTION_perfmap,
     "-perfmap        generate a /tmp/perf-${pid}.map file for perf\n",
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+
+#  Split the binary UART log written by the Apple machines (uart-log=FILE)
+#  back into one text file per UART channel.
+#
+#  Syntax:
+#  apple-uart-log-split.py [-h] [-o OUTDIR] [-t] [-c CHANNEL] <log>
+#
+#  Example of usage:
+#  apple-uart-log-split.py -t -o logs/ uart.log
+#
+#  Each channel is written to OUTDIR/uart<N>.txt. With -t every record is
+#  prefixed with its host timestamp. With -c only the given channel is
+#  printed to stdout instead, which also works on a log that is still being
+#  written. Records that follow a gap caused by a full log buffer are marked
+#  with "[dropped]".
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import datetime
+import os
+import struct
+import sys
+
+MAGIC = b'AUARTLG1'
+# le64 timestamp (ns), u8 channel, u8 flags, le16 length
+RECORD = struct.Struct('<QBBH')
+FLAG_DROPPED = 1 << 0
+
+
+def read_records(f):
+    if f.read(len(MAGIC)) != MAGIC:
+        sys.exit('not an Apple UART log')
+    while True:
+        hdr = f.read(RECORD.size)
+        if len(hdr) < RECORD.size:
+            return
+        ts, channel, flags, length = RECORD.unpack(hdr)
+        data = f.read(length)
+        if len(data) < length:
+            # Truncated by a crash or still being written.
+            return
+        yield ts, channel, flags, data
+
+
+def format_record(ts, flags, data, timestamps):
+    prefix = b''
+    if flags & FLAG_DROPPED:
+        prefix += b'[dropped]\n'
+    if timestamps:
+        when = datetime.datetime.fromtimestamp(ts / 1e9)
+        prefix += '[{}] '.format(when.isoformat()).encode()
+    return prefix + data
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Split an Apple UART log into one file per channel')
+    parser.add_argument('log', help='log file written by QEMU')
+    parser.add_argument('-o', '--outdir', default='.',
+                        help='output directory (default: .)')
+    parser.add_argument('-t', '--timestamps', action='store_true',
+                        help='prefix each record with its timestamp')
+    parser.add_argument('-c', '--channel', type=int,
+                        help='only print this channel to stdout')
+    args = parser.parse_args()
+
+    outputs = {}
+    try:
+        with open(args.log, 'rb') as f:
+            for ts, channel, flags, data in read_records(f):
+                if args.channel is not None:
+                    if channel == args.channel:
+                        sys.stdout.buffer.write(
+                            format_record(ts, flags, data, args.timestamps))
+                    continue
+                if channel not in outputs:
+                    path = os.path.join(args.outdir,
+                                        'uart{}.txt'.format(channel))
+                    outputs[channel] = open(path, 'wb')
+                outputs[channel].write(
+                    format_record(ts, flags, data, args.timestamps))
+    except FileNotFoundError:
+        sys.exit('{} does not exist'.format(args.log))
+    finally:
+        for out in outputs.values():
+            out.close()
+
+    for channel in sorted(outputs):
+        print('uart{}: {}'.format(channel, outputs[channel].name))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+
+#  Report the host CPU usage of a running QEMU process, e.g. an idle guest
+#  that has finished booting.
+#
+#  Syntax:
+#  idle_cpu.py [-h] [-i INTERVAL] [-n SAMPLES] <pid>
+#
+#  Example of usage:
+#  idle_cpu.py -i 10 -n 6 $(pgrep -f qemu-system-aarch64)
+#
+#  Each sample prints the percentage of one host CPU consumed by the
+#  process (user + system time) over the interval, followed by the
+#  average over all samples. Per-thread usage is printed with -t, which
+#  makes vCPU threads that keep waking up easy to spot.
+#
+#  This program is free software: you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation, either version 2 of the License, or
+#  (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program. If not, see <https://www.gnu.org/licenses/>.
+
+import argparse
+import os
+import sys
+import time
+
+
+def read_ticks(stat_path):
+    with open(stat_path, 'r') as f:
+        stat = f.read()
+    # The command name may contain spaces, skip past its closing paren.
+    fields = stat[stat.rindex(')') + 2:].split()
+    # utime and stime are fields 14 and 15, i.e. 11 and 12 after the name.
+    return int(fields[11]) + int(fields[12])
+
+
+def read_thread_ticks(pid):
+    ticks = {}
+    task_dir = '/proc/{}/task'.format(pid)
+    for tid in os.listdir(task_dir):
+        try:
+            with open('{}/{}/comm'.format(task_dir, tid), 'r') as f:
+                name = f.read().strip()
+            ticks[(tid, name)] = read_ticks('{}/{}/stat'.format(task_dir, tid))
+        except FileNotFoundError:
+            continue
+    return ticks
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Measure host CPU usage of an idle QEMU guest')
+    parser.add_argument('pid', type=int, help='QEMU process id')
+    parser.add_argument('-i', '--interval', type=float, default=5.0,
+                        help='seconds per sample (default: 5)')
+    parser.add_argument('-n', '--samples', type=int, default=3,
+                        help='number of samples (default: 3)')
+    parser.add_argument('-t', '--threads', action='store_true',
+                        help='also print per-thread usage')
+    args = parser.parse_args()
+
+    hz = os.sysconf(os.sysconf_names['SC_CLK_TCK'])
+    stat_path = '/proc/{}/stat'.format(args.pid)
+    results = []
+
+    try:
+        for n in range(args.samples):
+            before = read_ticks(stat_path)
+            threads_before = read_thread_ticks(args.pid) if args.threads else {}
+            start = time.monotonic()
+            time.sleep(args.interval)
+            elapsed = time.monotonic() - start
+            after = read_ticks(stat_path)
+
+            usage = 100.0 * (after - before) / hz / elapsed
+            results.append(usage)
+            print('sample {}: {:.2f}% host CPU'.format(n, usage))
+
+            if args.threads:
+                threads_after = read_thread_ticks(args.pid)
+                for key, ticks in sorted(threads_after.items()):
+                    delta = ticks - threads_before.get(key, ticks)
+                    if delta:
+                        print('  {:>8} {:<24} {:.2f}%'.format(
+                            key[0], key[1], 100.0 * delta / hz / elapsed))
+    except FileNotFoundError:
+        sys.exit('process {} is not running'.format(args.pid))
+
+    print('average: {:.2f}% host CPU'.format(sum(results) / len(results)))
+
+
+if __name__ == '__main__':
+    main()
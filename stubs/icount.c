@@ -18,6 +18,11 @@ int64_t icount_get_raw(void)
     abort();
     return 0;
 }
+int64_t icount_get_cpu(CPUState *cpu)
+{
+    abort();
+    return 0;
+}
 void icount_start_warp_timer(void)
 {
     abort();
@@ -21,7 +21,10 @@
 #include "qemu/bitops.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/lockable.h"
 #include "qemu/qemu-print.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
 #include "qom/object.h"
 #include "trace.h"
 
@@ -1446,6 +1449,224 @@ bool memory_region_access_valid(MemoryRegion *mr,
     return true;
 }
 
+/*
+ * MMIO access profiling.  Each profiled region gets a fixed array of
+ * offset buckets, sized when the region is first accessed, so recording
+ * an access only takes a few atomic adds and never a lock.
+ */
+#define MTREE_PROFILE_MAX_BUCKETS 1024
+#define MTREE_PROFILE_MIN_SHIFT 2
+
+typedef struct MemoryRegionProfileBucket {
+    Stat64 count[2];
+    Stat64 ns[2];
+} MemoryRegionProfileBucket;
+
+typedef struct MemoryRegionProfile {
+    MemoryRegion *mr;
+    unsigned shift;
+    unsigned nb_buckets;
+    QTAILQ_ENTRY(MemoryRegionProfile) next;
+    MemoryRegionProfileBucket buckets[];
+} MemoryRegionProfile;
+
+static bool mtree_profile_enabled;
+static QemuMutex mtree_profile_lock;
+static QTAILQ_HEAD(, MemoryRegionProfile) mtree_profiles =
+    QTAILQ_HEAD_INITIALIZER(mtree_profiles);
+
+static void __attribute__((__constructor__)) mtree_profile_init(void)
+{
+    qemu_mutex_init(&mtree_profile_lock);
+}
+
+void mtree_profile_enable(bool enable)
+{
+    qatomic_set(&mtree_profile_enabled, enable);
+}
+
+bool mtree_profile_is_enabled(void)
+{
+    return qatomic_read(&mtree_profile_enabled);
+}
+
+static MemoryRegionProfile *memory_region_profile_get(MemoryRegion *mr)
+{
+    MemoryRegionProfile *prof = qatomic_load_acquire(&mr->profile);
+    uint64_t last;
+    unsigned shift;
+
+    if (likely(prof)) {
+        return prof;
+    }
+
+    last = int128_gethi(mr->size) ? UINT64_MAX :
+           int128_get64(mr->size) ? int128_get64(mr->size) - 1 : 0;
+    shift = MTREE_PROFILE_MIN_SHIFT;
+    while ((last >> shift) >= MTREE_PROFILE_MAX_BUCKETS) {
+        shift++;
+    }
+
+    QEMU_LOCK_GUARD(&mtree_profile_lock);
+    prof = mr->profile;
+    if (!prof) {
+        unsigned nb_buckets = (last >> shift) + 1;
+
+        prof = g_malloc0(sizeof(*prof) +
+                         nb_buckets * sizeof(MemoryRegionProfileBucket));
+        prof->mr = mr;
+        prof->shift = shift;
+        prof->nb_buckets = nb_buckets;
+        QTAILQ_INSERT_TAIL(&mtree_profiles, prof, next);
+        qatomic_store_release(&mr->profile, prof);
+    }
+    return prof;
+}
+
+static void memory_region_profile_account(MemoryRegion *mr, hwaddr addr,
+                                          bool is_write, int64_t start)
+{
+    MemoryRegionProfile *prof = memory_region_profile_get(mr);
+    MemoryRegionProfileBucket *b;
+
+    b = &prof->buckets[MIN(addr >> prof->shift, prof->nb_buckets - 1)];
+    stat64_add(&b->count[is_write], 1);
+    stat64_add(&b->ns[is_write], get_clock() - start);
+}
+
+static void memory_region_profile_free(MemoryRegion *mr)
+{
+    if (mr->profile) {
+        QEMU_LOCK_GUARD(&mtree_profile_lock);
+        QTAILQ_REMOVE(&mtree_profiles, mr->profile, next);
+        g_free(mr->profile);
+        mr->profile = NULL;
+    }
+}
+
+void mtree_profile_reset(void)
+{
+    MemoryRegionProfile *prof;
+    unsigned i;
+
+    QEMU_LOCK_GUARD(&mtree_profile_lock);
+    QTAILQ_FOREACH(prof, &mtree_profiles, next) {
+        for (i = 0; i < prof->nb_buckets; i++) {
+            MemoryRegionProfileBucket *b = &prof->buckets[i];
+
+            stat64_set(&b->count[0], 0);
+            stat64_set(&b->count[1], 0);
+            stat64_set(&b->ns[0], 0);
+            stat64_set(&b->ns[1], 0);
+        }
+    }
+}
+
+typedef struct MtreeProfileEntry {
+    const MemoryRegion *mr;
+    hwaddr offset;
+    hwaddr size;
+    uint64_t count[2];
+    uint64_t ns[2];
+} MtreeProfileEntry;
+
+static gint mtree_profile_entry_cmp(gconstpointer a, gconstpointer b)
+{
+    const MtreeProfileEntry *ea = a;
+    const MtreeProfileEntry *eb = b;
+    uint64_t ta = ea->ns[0] + ea->ns[1];
+    uint64_t tb = eb->ns[0] + eb->ns[1];
+
+    return ta > tb ? -1 : ta < tb;
+}
+
+/* Region names may contain the separators used by the folded format. */
+static void mtree_profile_append_frame(GString *buf, const char *name)
+{
+    for (; *name; name++) {
+        g_string_append_c(buf, *name == ';' || *name == ' ' ? '_' : *name);
+    }
+    g_string_append_c(buf, ';');
+}
+
+static void mtree_profile_append_stack(GString *buf, const MemoryRegion *mr)
+{
+    if (mr->container) {
+        mtree_profile_append_stack(buf, mr->container);
+    }
+    mtree_profile_append_frame(buf, memory_region_name(mr) ?: "anonymous");
+}
+
+GString *mtree_profile_format(bool folded, unsigned max)
+{
+    g_autoptr(GArray) entries = g_array_new(false, false,
+                                            sizeof(MtreeProfileEntry));
+    GString *buf = g_string_new("");
+    MemoryRegionProfile *prof;
+    unsigned i;
+
+    WITH_QEMU_LOCK_GUARD(&mtree_profile_lock) {
+        QTAILQ_FOREACH(prof, &mtree_profiles, next) {
+            for (i = 0; i < prof->nb_buckets; i++) {
+                MemoryRegionProfileBucket *b = &prof->buckets[i];
+                MtreeProfileEntry e = {
+                    .mr = prof->mr,
+                    .offset = (hwaddr)i << prof->shift,
+                    .size = 1ULL << prof->shift,
+                    .count = { stat64_get(&b->count[0]),
+                               stat64_get(&b->count[1]) },
+                    .ns = { stat64_get(&b->ns[0]), stat64_get(&b->ns[1]) },
+                };
+
+                if (e.count[0] || e.count[1]) {
+                    g_array_append_val(entries, e);
+                }
+            }
+        }
+    }
+
+    g_array_sort(entries, mtree_profile_entry_cmp);
+
+    if (folded) {
+        for (i = 0; i < entries->len; i++) {
+            MtreeProfileEntry *e = &g_array_index(entries,
+                                                  MtreeProfileEntry, i);
+            int dir;
+
+            for (dir = 0; dir < 2; dir++) {
+                if (!e->count[dir]) {
+                    continue;
+                }
+                mtree_profile_append_stack(buf, e->mr);
+                g_string_append_printf(buf, "0x%" HWADDR_PRIx ";%s %" PRIu64
+                                       "\n", e->offset,
+                                       dir ? "write" : "read", e->ns[dir]);
+            }
+        }
+        return buf;
+    }
+
+    g_string_append_printf(buf, "%-32s %-10s %-6s %12s %12s %14s %10s\n",
+                           "Region", "Offset", "Bucket", "Reads", "Writes",
+                           "Time (ns)", "Avg (ns)");
+    for (i = 0; i < entries->len && (!max || i < max); i++) {
+        MtreeProfileEntry *e = &g_array_index(entries, MtreeProfileEntry, i);
+        uint64_t count = e->count[0] + e->count[1];
+        uint64_t ns = e->ns[0] + e->ns[1];
+
+        g_string_append_printf(buf, "%-32s 0x%08" HWADDR_PRIx " 0x%-4"
+                               HWADDR_PRIx " %12" PRIu64 " %12" PRIu64
+                               " %14" PRIu64 " %10" PRIu64 "\n",
+                               memory_region_name(e->mr) ?: "anonymous",
+                               e->offset, e->size, e->count[0], e->count[1],
+                               ns, ns / count);
+    }
+    if (!entries->len) {
+        g_string_append(buf, "No MMIO accesses recorded\n");
+    }
+    return buf;
+}
+
 static MemTxResult memory_region_dispatch_read1(MemoryRegion *mr,
                                                 hwaddr addr,
                                                 uint64_t *pval,
@@ -1488,7 +1709,14 @@ MemTxResult memory_region_dispatch_read(MemoryRegion *mr,
         return MEMTX_DECODE_ERROR;
     }
 
-    r = memory_region_dispatch_read1(mr, addr, pval, size, attrs);
+    if (unlikely(qatomic_read(&mtree_profile_enabled))) {
+        int64_t start = get_clock();
+
+        r = memory_region_dispatch_read1(mr, addr, pval, size, attrs);
+        memory_region_profile_account(mr, addr, false, start);
+    } else {
+        r = memory_region_dispatch_read1(mr, addr, pval, size, attrs);
+    }
     adjust_endianness(mr, pval, op);
     return r;
 }
@@ -1519,26 +1747,12 @@ static bool memory_region_dispatch_write_eventfds(MemoryRegion *mr,
     return false;
 }
 
-MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
-                                         hwaddr addr,
-                                         uint64_t data,
-                                         MemOp op,
-                                         MemTxAttrs attrs)
+static MemTxResult memory_region_dispatch_write1(MemoryRegion *mr,
+                                                 hwaddr addr,
+                                                 uint64_t data,
+                                                 unsigned size,
+                                                 MemTxAttrs attrs)
 {
-    unsigned size = memop_size(op);
-
-    if (mr->alias) {
-        return memory_region_dispatch_write(mr->alias,
-                                            mr->alias_offset + addr,
-                                            data, op, attrs);
-    }
-    if (!memory_region_access_valid(mr, addr, size, true, attrs)) {
-        unassigned_mem_write(mr, addr, data, size);
-        return MEMTX_DECODE_ERROR;
-    }
-
-    adjust_endianness(mr, &data, op);
-
     /*
      * FIXME: it's not clear why under KVM the write would be processed
      * directly, instead of going through eventfd.  This probably should
@@ -1565,6 +1779,37 @@ MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
     }
 }
 
+MemTxResult memory_region_dispatch_write(MemoryRegion *mr,
+                                         hwaddr addr,
+                                         uint64_t data,
+                                         MemOp op,
+                                         MemTxAttrs attrs)
+{
+    unsigned size = memop_size(op);
+    MemTxResult r;
+
+    if (mr->alias) {
+        return memory_region_dispatch_write(mr->alias,
+                                            mr->alias_offset + addr,
+                                            data, op, attrs);
+    }
+    if (!memory_region_access_valid(mr, addr, size, true, attrs)) {
+        unassigned_mem_write(mr, addr, data, size);
+        return MEMTX_DECODE_ERROR;
+    }
+
+    adjust_endianness(mr, &data, op);
+
+    if (unlikely(qatomic_read(&mtree_profile_enabled))) {
+        int64_t start = get_clock();
+
+        r = memory_region_dispatch_write1(mr, addr, data, size, attrs);
+        memory_region_profile_account(mr, addr, true, start);
+        return r;
+    }
+    return memory_region_dispatch_write1(mr, addr, data, size, attrs);
+}
+
 void memory_region_init_io(MemoryRegion *mr,
                            Object *owner,
                            const MemoryRegionOps *ops,
@@ -1823,6 +2068,7 @@ static void memory_region_finalize(Object *obj)
     memory_region_clear_coalescing(mr);
     g_free((char *)mr->name);
     g_free(mr->ioeventfds);
+    memory_region_profile_free(mr);
 }
 
 Object *memory_region_owner(MemoryRegion *mr)
@@ -2567,6 +2813,18 @@ void memory_region_clear_flush_coalesced(MemoryRegion *mr)
     }
 }
 
+void memory_region_enable_lockless_io(MemoryRegion *mr)
+{
+    /* Coalesced MMIO flushes must be done with the BQL held */
+    assert(!mr->flush_coalesced_mmio);
+    mr->lockless_io = true;
+    /*
+     * The re-entrancy guard lives in the owning device and is not atomic;
+     * concurrent accesses from several vCPUs would trip it spuriously.
+     */
+    mr->disable_reentrancy_guard = true;
+}
+
 void memory_region_add_eventfd(MemoryRegion *mr,
                                hwaddr addr,
                                unsigned size,
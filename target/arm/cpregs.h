@@ -134,6 +134,12 @@ enum {
      * identically to the normal one, other than FGT trapping handling.)
      */
     ARM_CP_ADD_TLBI_NXS          = 1 << 21,
+    /*
+     * Flag: for ARM_CP_IO registers, the read and write hooks do their
+     * own locking and are called without the BQL held. Accesses are still
+     * marked with translator_io_start() and end the TB.
+     */
+    ARM_CP_IO_NO_BQL             = 1 << 22,
 };
 
 /*
@@ -334,6 +334,7 @@ static void arm_cpu_reset_hold(Object *obj, ResetType type)
         if (cpu_isar_feature(aa64_pauth, cpu)) {
             env->keys.m.lo = cpu->m_key_lo;
             env->keys.m.hi = cpu->m_key_hi;
+            pauth_cache_flush(cpu);
         }
 #endif
 #endif
@@ -193,6 +193,23 @@ typedef struct ARMPredicateReg {
 typedef struct ARMPACKey {
     uint64_t lo, hi;
 } ARMPACKey;
+
+/*
+ * Direct-mapped cache of computed PACs, indexed by a hash of the
+ * (key id, pointer, modifier) tuple. Entries are only valid when their
+ * generation matches ARMCPU::pac_cache_gen, which is bumped whenever
+ * any of the PAC keys may have changed.
+ */
+#define ARM_PAC_CACHE_BITS 10
+#define ARM_PAC_CACHE_SIZE (1 << ARM_PAC_CACHE_BITS)
+
+typedef struct ARMPACCacheEntry {
+    uint64_t data;
+    uint64_t modifier;
+    uint64_t pac;
+    uint32_t key_id;
+    uint32_t gen;
+} ARMPACCacheEntry;
 #endif
 
 /* See the commentary above the TBFLAG field definitions.  */
@@ -787,6 +804,18 @@ typedef struct CPUArchState {
 
     uint64_t scxtnum_el[4];
 
+    /*
+     * Apple AMX coprocessor state. X and Y are each eight 64-byte registers
+     * addressed as one 512-byte circular buffer, Z is 64 rows of 64 bytes.
+     * Bytes are kept in guest (little-endian) order.
+     */
+    struct {
+        uint8_t x[8 * 64];
+        uint8_t y[8 * 64];
+        uint8_t z[64][64];
+        uint32_t enabled;
+    } amx;
+
     /*
      * SME ZA storage -- 256 x 256 byte array, with bytes in host word order,
      * as we do with vfp.zregs[].  This corresponds to the architectural ZA
@@ -1204,6 +1233,18 @@ struct ArchCPU {
     /* Apple PAC boot diversifier */
     uint64_t m_key_lo;
     uint64_t m_key_hi;
+
+    /* GENTER/GEXIT transitions handled without an exception round trip */
+    uint64_t gxf_fast_transitions;
+
+#ifdef TARGET_AARCH64
+    /* PAC result cache, see pauth_computepac() */
+    bool prop_pauth_cache;
+    uint32_t pac_cache_gen;
+    uint64_t pac_cache_hits;
+    uint64_t pac_cache_misses;
+    ARMPACCacheEntry pac_cache[ARM_PAC_CACHE_SIZE];
+#endif
 };
 
 typedef struct ARMCPUInfo {
@@ -2557,6 +2598,7 @@ enum arm_features {
      */
     ARM_FEATURE_BACKCOMPAT_CNTFRQ, /* 62.5MHz timer default */
     ARM_FEATURE_GXF, /* has Apple's GXF support */
+    ARM_FEATURE_AMX, /* has Apple's AMX coprocessor */
 };
 
 static inline int arm_feature(CPUARMState *env, int feature)
@@ -3171,6 +3213,7 @@ FIELD(TBFLAG_A64, NV2_MEM_E20, 35, 1)
 FIELD(TBFLAG_A64, NV2_MEM_BE, 36, 1)
 FIELD(TBFLAG_A64, AH, 37, 1)   /* FPCR.AH */
 FIELD(TBFLAG_A64, NEP, 38, 1)   /* FPCR.NEP */
+FIELD(TBFLAG_A64, GUARDED, 39, 1) /* Apple GXF guarded execution */
 
 /*
  * Helpers for using the above. Note that only the A64 accessors use
@@ -570,6 +570,10 @@ static const Property arm_cpu_pauth_qarma3_property =
     DEFINE_PROP_BOOL("pauth-qarma3", ARMCPU, prop_pauth_qarma3, false);
 static Property arm_cpu_pauth_qarma5_property =
     DEFINE_PROP_BOOL("pauth-qarma5", ARMCPU, prop_pauth_qarma5, false);
+#ifndef CONFIG_USER_ONLY
+static const Property arm_cpu_pauth_cache_property =
+    DEFINE_PROP_BOOL("pauth-cache", ARMCPU, prop_pauth_cache, true);
+#endif
 
 void aarch64_add_pauth_properties(Object *obj)
 {
@@ -591,6 +595,21 @@ void aarch64_add_pauth_properties(Object *obj)
         qdev_property_add_static(DEVICE(obj), &arm_cpu_pauth_impdef_property);
         qdev_property_add_static(DEVICE(obj), &arm_cpu_pauth_qarma3_property);
         qdev_property_add_static(DEVICE(obj), &arm_cpu_pauth_qarma5_property);
+#ifndef CONFIG_USER_ONLY
+        /*
+         * linux-user rewrites the keys directly from prctl(), bypassing
+         * the cpreg hooks that invalidate the cache, so only offer it
+         * for system emulation.
+         */
+        qdev_property_add_static(DEVICE(obj), &arm_cpu_pauth_cache_property);
+        object_property_add_uint64_ptr(obj, "pauth-cache-hits",
+                                       &cpu->pac_cache_hits,
+                                       OBJ_PROP_FLAG_READ);
+        object_property_add_uint64_ptr(obj, "pauth-cache-misses",
+                                       &cpu->pac_cache_misses,
+                                       OBJ_PROP_FLAG_READ);
+        pauth_cache_flush(cpu);
+#endif
     }
 }
 
@@ -780,6 +799,7 @@ static void aarch64_apple_gxf_initfn(Object *obj) {
 
     if (tcg_enabled()) {
         set_feature(&ARM_CPU(obj)->env, ARM_FEATURE_GXF);
+        set_feature(&ARM_CPU(obj)->env, ARM_FEATURE_AMX);
     }
 }
 
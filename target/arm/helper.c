@@ -7055,6 +7055,7 @@ static void pauth_write_lo(CPUARMState *env, const ARMCPRegInfo *ri,
         value ^= env->keys.m.lo;
     }
     CPREG_FIELD64(env, ri) = value;
+    pauth_cache_flush(env_archcpu(env));
 }
 
 static void pauth_write_hi(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -7065,6 +7066,15 @@ static void pauth_write_hi(CPUARMState *env, const ARMCPRegInfo *ri,
         value ^= env->keys.m.hi;
     }
     CPREG_FIELD64(env, ri) = value;
+    pauth_cache_flush(env_archcpu(env));
+}
+
+static void pauth_kernkey_write(CPUARMState *env, const ARMCPRegInfo *ri,
+                                uint64_t value)
+{
+    assert(ri->fieldoffset);
+    CPREG_FIELD64(env, ri) = value;
+    pauth_cache_flush(env_archcpu(env));
 }
 
 static void apctl_write(CPUARMState *env, const ARMCPRegInfo *ri,
@@ -7074,6 +7084,7 @@ static void apctl_write(CPUARMState *env, const ARMCPRegInfo *ri,
     value &= ~APCTL_MKEYVld;
     value |= CPREG_FIELD64(env, ri) & APCTL_MKEYVld;
     CPREG_FIELD64(env, ri) = value;
+    pauth_cache_flush(env_archcpu(env));
 }
 
 static const ARMCPRegInfo pauth_reginfo[] = {
@@ -7140,10 +7151,12 @@ static const ARMCPRegInfo pauth_reginfo[] = {
     { .name = "KERNELKEYLO_EL1", .state = ARM_CP_STATE_AA64,
       .opc0 = 3, .opc1 = 4, .crn = 15, .crm = 1, .opc2 = 0,
       .access = PL1_RW, .accessfn = access_pauth,
+      .writefn = pauth_kernkey_write, .raw_writefn = raw_write,
       .fieldoffset = offsetof(CPUARMState, keys.kernel.lo) },
     { .name = "KERNELKEYHI_EL1", .state = ARM_CP_STATE_AA64,
       .opc0 = 3, .opc1 = 4, .crn = 15, .crm = 1, .opc2 = 1,
       .access = PL1_RW, .accessfn = access_pauth,
+      .writefn = pauth_kernkey_write, .raw_writefn = raw_write,
       .fieldoffset = offsetof(CPUARMState, keys.kernel.hi) },
     { .name = "APCTL_EL1", .state = ARM_CP_STATE_AA64,
       .opc0 = 3, .opc1 = 4, .crn = 15, .crm = 0, .opc2 = 4,
@@ -10697,6 +10710,55 @@ static bool syndrome_is_sync_extabt(uint32_t syndrome)
     }
 }
 
+uint32_t aarch64_exception_pstate(CPUARMState *env, unsigned int new_el,
+                                  uint32_t old_mode)
+{
+    ARMCPU *cpu = env_archcpu(env);
+    uint32_t new_mode = aarch64_pstate_mode(new_el, true);
+
+    if (cpu_isar_feature(aa64_pan, cpu)) {
+        /* The value of PSTATE.PAN is normally preserved, except when ... */
+        new_mode |= old_mode & PSTATE_PAN;
+        switch (new_el) {
+        case 2:
+            /* ... the target is EL2 with HCR_EL2.{E2H,TGE} == '11' ...  */
+            if ((arm_hcr_el2_eff(env) & (HCR_E2H | HCR_TGE))
+                != (HCR_E2H | HCR_TGE)) {
+                break;
+            }
+            /* fall through */
+        case 1:
+            /* ... the target is EL1 ... */
+            /* ... and SCTLR_ELx.SPAN == 0, then set to 1.  */
+            if ((env->cp15.sctlr_el[new_el] & SCTLR_SPAN) == 0) {
+                new_mode |= PSTATE_PAN;
+            }
+            break;
+        }
+    }
+    if (cpu_isar_feature(aa64_mte, cpu)) {
+        new_mode |= PSTATE_TCO;
+    }
+
+    if (cpu_isar_feature(aa64_ssbs, cpu)) {
+        if (env->cp15.sctlr_el[new_el] & SCTLR_DSSBS_64) {
+            new_mode |= PSTATE_SSBS;
+        } else {
+            new_mode &= ~PSTATE_SSBS;
+        }
+    }
+
+    if (cpu_isar_feature(aa64_nmi, cpu)) {
+        if (!(env->cp15.sctlr_el[new_el] & SCTLR_SPINTMASK)) {
+            new_mode |= PSTATE_ALLINT;
+        } else {
+            new_mode &= ~PSTATE_ALLINT;
+        }
+    }
+
+    return new_mode;
+}
+
 /* Handle exception entry to a target EL which is using AArch64 */
 static void arm_cpu_do_interrupt_aarch64(CPUState *cs)
 {
@@ -10705,7 +10767,7 @@ static void arm_cpu_do_interrupt_aarch64(CPUState *cs)
     unsigned int new_el = env->exception.target_el;
     target_ulong addr = env->cp15.vbar_el[new_el];
     bool genter = false;
-    unsigned int new_mode = aarch64_pstate_mode(new_el, true);
+    unsigned int new_mode;
     unsigned int old_mode;
     unsigned int cur_el = arm_current_el(env);
     int rt;
@@ -10915,45 +10977,7 @@ static void arm_cpu_do_interrupt_aarch64(CPUState *cs)
                     env->elr_el[new_el]);
     }
 
-    if (cpu_isar_feature(aa64_pan, cpu)) {
-        /* The value of PSTATE.PAN is normally preserved, except when ... */
-        new_mode |= old_mode & PSTATE_PAN;
-        switch (new_el) {
-        case 2:
-            /* ... the target is EL2 with HCR_EL2.{E2H,TGE} == '11' ...  */
-            if ((arm_hcr_el2_eff(env) & (HCR_E2H | HCR_TGE))
-                != (HCR_E2H | HCR_TGE)) {
-                break;
-            }
-            /* fall through */
-        case 1:
-            /* ... the target is EL1 ... */
-            /* ... and SCTLR_ELx.SPAN == 0, then set to 1.  */
-            if ((env->cp15.sctlr_el[new_el] & SCTLR_SPAN) == 0) {
-                new_mode |= PSTATE_PAN;
-            }
-            break;
-        }
-    }
-    if (cpu_isar_feature(aa64_mte, cpu)) {
-        new_mode |= PSTATE_TCO;
-    }
-
-    if (cpu_isar_feature(aa64_ssbs, cpu)) {
-        if (env->cp15.sctlr_el[new_el] & SCTLR_DSSBS_64) {
-            new_mode |= PSTATE_SSBS;
-        } else {
-            new_mode &= ~PSTATE_SSBS;
-        }
-    }
-
-    if (cpu_isar_feature(aa64_nmi, cpu)) {
-        if (!(env->cp15.sctlr_el[new_el] & SCTLR_SPINTMASK)) {
-            new_mode |= PSTATE_ALLINT;
-        } else {
-            new_mode &= ~PSTATE_ALLINT;
-        }
-    }
+    new_mode = aarch64_exception_pstate(env, new_el, old_mode);
 
     pstate_write(env, PSTATE_DAIF | new_mode);
     env->gxf.gxf_status_el[new_el] |= genter;
@@ -586,6 +586,13 @@ static inline void update_spsel(CPUARMState *env, uint32_t imm)
     aarch64_restore_sp(env, cur_el);
 }
 
+/*
+ * Return the PSTATE, other than DAIF, that an exception entry to AArch64
+ * @new_el sets up when taken from PSTATE @old_mode.
+ */
+uint32_t aarch64_exception_pstate(CPUARMState *env, unsigned int new_el,
+                                  uint32_t old_mode);
+
 /*
  * arm_pamax
  * @cpu: ARMCPU
@@ -1888,6 +1895,24 @@ static inline uint64_t pauth_ptr_mask(ARMVAParameters param)
     return MAKE_64BIT_MASK(bot_pac_bit, top_pac_bit - bot_pac_bit);
 }
 
+#ifdef TARGET_AARCH64
+/**
+ * pauth_cache_flush:
+ * @cpu: CPU whose PAC cache should be invalidated
+ *
+ * Invalidate all memoized PAC computations. Must be called whenever
+ * any of the PAC keys or APCTL_EL1 may have changed.
+ */
+static inline void pauth_cache_flush(ARMCPU *cpu)
+{
+    if (unlikely(++cpu->pac_cache_gen == 0)) {
+        /* Generation 0 marks empty entries, so wipe them on wrap-around. */
+        memset(cpu->pac_cache, 0, sizeof(cpu->pac_cache));
+        cpu->pac_cache_gen = 1;
+    }
+}
+#endif
+
 /* Add the cpreg definitions for debug related system registers */
 void define_debug_regs(ARMCPU *cpu);
 
@@ -1026,6 +1026,9 @@ static int cpu_post_load(void *opaque, int version_id)
 
     if (tcg_enabled()) {
         arm_rebuild_hflags(env);
+#ifdef TARGET_AARCH64
+        pauth_cache_flush(cpu);
+#endif
     }
 
     return 0;
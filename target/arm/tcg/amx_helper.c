@@ -0,0 +1,412 @@
+/*
+ * Apple AMX coprocessor helpers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include <math.h>
+#include "cpu.h"
+#include "internals.h"
+#include "exec/helper-proto.h"
+#include "exec/cpu_ldst.h"
+#include "qemu/bswap.h"
+#include "qemu/log.h"
+#include "host/cpuinfo.h"
+
+/*
+ * AMX instructions are encoded as 0x00201000 | (op << 5) | operand, where
+ * operand names a general purpose register holding the real operand, or
+ * for set/clr is an immediate.
+ */
+enum {
+    AMX_OP_LDX = 0,
+    AMX_OP_LDY = 1,
+    AMX_OP_STX = 2,
+    AMX_OP_STY = 3,
+    AMX_OP_LDZ = 4,
+    AMX_OP_STZ = 5,
+    AMX_OP_LDZI = 6,
+    AMX_OP_STZI = 7,
+    AMX_OP_EXTRX = 8,
+    AMX_OP_EXTRY = 9,
+    AMX_OP_FMA64 = 10,
+    AMX_OP_FMS64 = 11,
+    AMX_OP_FMA32 = 12,
+    AMX_OP_FMS32 = 13,
+    AMX_OP_SETCLR = 17,
+};
+
+#define AMX_REG_SIZE 64
+#define AMX_XY_SIZE (8 * AMX_REG_SIZE)
+#define AMX_Z_ROWS 64
+
+/* Load/store operand fields */
+#define AMX_LDST_ADDR(op) ((uint64_t)sextract64(op, 0, 56))
+#define AMX_LDST_REG(op) extract64(op, 56, 6)
+#define AMX_LDST_PAIR(op) extract64(op, 62, 1)
+
+/* Compute operand fields */
+#define AMX_Y_OFFSET(op) extract64(op, 0, 9)
+#define AMX_X_OFFSET(op) extract64(op, 10, 9)
+#define AMX_Z_ROW(op) extract64(op, 20, 6)
+#define AMX_SKIP_Z(op) extract64(op, 27, 1)
+#define AMX_SKIP_Y(op) extract64(op, 28, 1)
+#define AMX_SKIP_X(op) extract64(op, 29, 1)
+#define AMX_VECTOR(op) extract64(op, 63, 1)
+
+static void amx_load(CPUARMState *env, uint64_t addr, uint8_t *dst,
+                     uintptr_t ra)
+{
+    int i;
+
+    for (i = 0; i < AMX_REG_SIZE; i += 8) {
+        stq_le_p(dst + i, cpu_ldq_le_data_ra(env, addr + i, ra));
+    }
+}
+
+static void amx_store(CPUARMState *env, uint64_t addr, const uint8_t *src,
+                      uintptr_t ra)
+{
+    int i;
+
+    for (i = 0; i < AMX_REG_SIZE; i += 8) {
+        cpu_stq_le_data_ra(env, addr + i, ldq_le_p(src + i), ra);
+    }
+}
+
+static void amx_ldst_xy(CPUARMState *env, uint8_t *file, uint64_t operand,
+                        bool store, uintptr_t ra)
+{
+    uint64_t addr = AMX_LDST_ADDR(operand);
+    int reg = AMX_LDST_REG(operand) & 7;
+    int n = AMX_LDST_PAIR(operand) ? 2 : 1;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        uint8_t *r = file + ((reg + i) & 7) * AMX_REG_SIZE;
+
+        if (store) {
+            amx_store(env, addr + i * AMX_REG_SIZE, r, ra);
+        } else {
+            amx_load(env, addr + i * AMX_REG_SIZE, r, ra);
+        }
+    }
+}
+
+static void amx_ldst_z(CPUARMState *env, uint64_t operand, bool store,
+                       uintptr_t ra)
+{
+    uint64_t addr = AMX_LDST_ADDR(operand);
+    int row = AMX_LDST_REG(operand);
+    int n = AMX_LDST_PAIR(operand) ? 2 : 1;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        uint8_t *r = env->amx.z[(row + i) & (AMX_Z_ROWS - 1)];
+
+        if (store) {
+            amx_store(env, addr + i * AMX_REG_SIZE, r, ra);
+        } else {
+            amx_load(env, addr + i * AMX_REG_SIZE, r, ra);
+        }
+    }
+}
+
+/* Read 64 bytes from the circular X or Y register file. */
+static void amx_read_xy(const uint8_t *file, unsigned offset, uint8_t *dst)
+{
+    unsigned first = MIN(AMX_REG_SIZE, AMX_XY_SIZE - offset);
+
+    memcpy(dst, file + offset, first);
+    memcpy(dst + first, file, AMX_REG_SIZE - first);
+}
+
+static void amx_write_xy(uint8_t *file, unsigned offset, const uint8_t *src)
+{
+    unsigned first = MIN(AMX_REG_SIZE, AMX_XY_SIZE - offset);
+
+    memcpy(file + offset, src, first);
+    memcpy(file, src + first, AMX_REG_SIZE - first);
+}
+
+/*
+ * The compute kernels work on one 64-byte Z row at a time as host vectors.
+ * AMX multiply-adds are fused, so every lane goes through fma(); with host
+ * FMA available the compiler turns each row into a few vector FMAs, and
+ * x86 hosts pick such a build of the kernels at runtime.
+ */
+typedef double AMXVecF64 __attribute__((vector_size(AMX_REG_SIZE)));
+typedef float AMXVecF32 __attribute__((vector_size(AMX_REG_SIZE)));
+
+#define AMX_F64_LANES (AMX_REG_SIZE / 8)
+#define AMX_F32_LANES (AMX_REG_SIZE / 4)
+
+typedef void AMXFma64Fn(AMXVecF64 *z, const AMXVecF64 *x, const AMXVecF64 *y,
+                        bool skip_z);
+typedef void AMXFma32Fn(AMXVecF32 *z, const AMXVecF32 *x, const AMXVecF32 *y,
+                        bool skip_z);
+
+#define AMX_FMA_KERNELS(suffix, attr)                                       \
+static void attr amx_fma64_lanes_##suffix(AMXVecF64 *z, const AMXVecF64 *x, \
+                                          const AMXVecF64 *y, bool skip_z)  \
+{                                                                           \
+    int i;                                                                  \
+                                                                            \
+    if (skip_z) {                                                           \
+        *z = *x * *y;                                                       \
+        return;                                                             \
+    }                                                                       \
+    for (i = 0; i < AMX_F64_LANES; i++) {                                   \
+        (*z)[i] = fma((*x)[i], (*y)[i], (*z)[i]);                           \
+    }                                                                       \
+}                                                                           \
+                                                                            \
+static void attr amx_fma32_lanes_##suffix(AMXVecF32 *z, const AMXVecF32 *x, \
+                                          const AMXVecF32 *y, bool skip_z)  \
+{                                                                           \
+    int i;                                                                  \
+                                                                            \
+    if (skip_z) {                                                           \
+        *z = *x * *y;                                                       \
+        return;                                                             \
+    }                                                                       \
+    for (i = 0; i < AMX_F32_LANES; i++) {                                   \
+        (*z)[i] = fmaf((*x)[i], (*y)[i], (*z)[i]);                          \
+    }                                                                       \
+}
+
+AMX_FMA_KERNELS(int, )
+#ifdef CONFIG_AVX2_OPT
+AMX_FMA_KERNELS(avx2, __attribute__((target("avx2,fma"))))
+#endif
+
+static AMXFma64Fn *amx_fma64_lanes = amx_fma64_lanes_int;
+static AMXFma32Fn *amx_fma32_lanes = amx_fma32_lanes_int;
+
+static void __attribute__((constructor)) amx_init_accel(void)
+{
+#ifdef CONFIG_AVX2_OPT
+    unsigned info = cpuinfo_init();
+
+    if ((info & CPUINFO_AVX2) && (info & CPUINFO_FMA)) {
+        amx_fma64_lanes = amx_fma64_lanes_avx2;
+        amx_fma32_lanes = amx_fma32_lanes_avx2;
+    }
+#endif
+}
+
+static void amx_unpack_f64(const uint8_t *src, AMXVecF64 *dst)
+{
+    int i;
+
+    for (i = 0; i < AMX_F64_LANES; i++) {
+        uint64_t v = ldq_le_p(src + i * 8);
+        double d;
+
+        memcpy(&d, &v, sizeof(v));
+        (*dst)[i] = d;
+    }
+}
+
+static void amx_pack_f64(const AMXVecF64 *src, uint8_t *dst)
+{
+    int i;
+
+    for (i = 0; i < AMX_F64_LANES; i++) {
+        double d = (*src)[i];
+        uint64_t v;
+
+        memcpy(&v, &d, sizeof(v));
+        stq_le_p(dst + i * 8, v);
+    }
+}
+
+static void amx_unpack_f32(const uint8_t *src, AMXVecF32 *dst)
+{
+    int i;
+
+    for (i = 0; i < AMX_F32_LANES; i++) {
+        uint32_t v = ldl_le_p(src + i * 4);
+        float f;
+
+        memcpy(&f, &v, sizeof(v));
+        (*dst)[i] = f;
+    }
+}
+
+static void amx_pack_f32(const AMXVecF32 *src, uint8_t *dst)
+{
+    int i;
+
+    for (i = 0; i < AMX_F32_LANES; i++) {
+        float f = (*src)[i];
+        uint32_t v;
+
+        memcpy(&v, &f, sizeof(v));
+        stl_le_p(dst + i * 4, v);
+    }
+}
+
+static void amx_fma64(CPUARMState *env, uint64_t operand, bool negate)
+{
+    uint8_t xb[AMX_REG_SIZE], yb[AMX_REG_SIZE];
+    AMXVecF64 x, y, z, yj;
+    int zrow = AMX_Z_ROW(operand);
+    bool skip_z = AMX_SKIP_Z(operand);
+    int j;
+
+    amx_read_xy(env->amx.x, AMX_X_OFFSET(operand), xb);
+    amx_read_xy(env->amx.y, AMX_Y_OFFSET(operand), yb);
+    amx_unpack_f64(xb, &x);
+    amx_unpack_f64(yb, &y);
+
+    if (AMX_SKIP_X(operand)) {
+        x = (AMXVecF64){} + 1.0;
+    }
+    if (AMX_SKIP_Y(operand)) {
+        y = (AMXVecF64){} + 1.0;
+    }
+    if (negate) {
+        x = -x;
+    }
+
+    if (AMX_VECTOR(operand)) {
+        uint8_t *row = env->amx.z[zrow];
+
+        amx_unpack_f64(row, &z);
+        amx_fma64_lanes(&z, &x, &y, skip_z);
+        amx_pack_f64(&z, row);
+        return;
+    }
+
+    /* Outer product: Z[j * 8 + zrow][i] += X[i] * Y[j] */
+    for (j = 0; j < AMX_F64_LANES; j++) {
+        uint8_t *row = env->amx.z[j * 8 + (zrow & 7)];
+
+        yj = (AMXVecF64){} + y[j];
+        amx_unpack_f64(row, &z);
+        amx_fma64_lanes(&z, &x, &yj, skip_z);
+        amx_pack_f64(&z, row);
+    }
+}
+
+static void amx_fma32(CPUARMState *env, uint64_t operand, bool negate)
+{
+    uint8_t xb[AMX_REG_SIZE], yb[AMX_REG_SIZE];
+    AMXVecF32 x, y, z, yj;
+    int zrow = AMX_Z_ROW(operand);
+    bool skip_z = AMX_SKIP_Z(operand);
+    int j;
+
+    amx_read_xy(env->amx.x, AMX_X_OFFSET(operand), xb);
+    amx_read_xy(env->amx.y, AMX_Y_OFFSET(operand), yb);
+    amx_unpack_f32(xb, &x);
+    amx_unpack_f32(yb, &y);
+
+    if (AMX_SKIP_X(operand)) {
+        x = (AMXVecF32){} + 1.0f;
+    }
+    if (AMX_SKIP_Y(operand)) {
+        y = (AMXVecF32){} + 1.0f;
+    }
+    if (negate) {
+        x = -x;
+    }
+
+    if (AMX_VECTOR(operand)) {
+        uint8_t *row = env->amx.z[zrow];
+
+        amx_unpack_f32(row, &z);
+        amx_fma32_lanes(&z, &x, &y, skip_z);
+        amx_pack_f32(&z, row);
+        return;
+    }
+
+    /* Outer product: Z[j * 4 + zrow][i] += X[i] * Y[j] */
+    for (j = 0; j < AMX_F32_LANES; j++) {
+        uint8_t *row = env->amx.z[j * 4 + (zrow & 3)];
+
+        yj = (AMXVecF32){} + y[j];
+        amx_unpack_f32(row, &z);
+        amx_fma32_lanes(&z, &x, &yj, skip_z);
+        amx_pack_f32(&z, row);
+    }
+}
+
+void HELPER(amx)(CPUARMState *env, uint32_t op, uint64_t operand)
+{
+    uintptr_t ra = GETPC();
+
+    if (op == AMX_OP_SETCLR) {
+        switch (operand) {
+        case 0: // set
+            memset(&env->amx, 0, sizeof(env->amx));
+            env->amx.enabled = 1;
+            return;
+        case 1: // clr
+            env->amx.enabled = 0;
+            return;
+        default:
+            break;
+        }
+    }
+
+    if (!env->amx.enabled) {
+        raise_exception_ra(env, EXCP_UDEF, syn_uncategorized(),
+                           exception_target_el(env), ra);
+    }
+
+    switch (op) {
+    case AMX_OP_LDX:
+        amx_ldst_xy(env, env->amx.x, operand, false, ra);
+        break;
+    case AMX_OP_LDY:
+        amx_ldst_xy(env, env->amx.y, operand, false, ra);
+        break;
+    case AMX_OP_STX:
+        amx_ldst_xy(env, env->amx.x, operand, true, ra);
+        break;
+    case AMX_OP_STY:
+        amx_ldst_xy(env, env->amx.y, operand, true, ra);
+        break;
+    case AMX_OP_LDZ:
+        amx_ldst_z(env, operand, false, ra);
+        break;
+    case AMX_OP_STZ:
+        amx_ldst_z(env, operand, true, ra);
+        break;
+    case AMX_OP_EXTRX:
+        amx_write_xy(env->amx.x, AMX_X_OFFSET(operand),
+                     env->amx.z[AMX_Z_ROW(operand)]);
+        break;
+    case AMX_OP_EXTRY:
+        amx_write_xy(env->amx.y, AMX_Y_OFFSET(operand),
+                     env->amx.z[AMX_Z_ROW(operand)]);
+        break;
+    case AMX_OP_FMA64:
+    case AMX_OP_FMS64:
+        amx_fma64(env, operand, op == AMX_OP_FMS64);
+        break;
+    case AMX_OP_FMA32:
+    case AMX_OP_FMS32:
+        amx_fma32(env, operand, op == AMX_OP_FMS32);
+        break;
+    default:
+        qemu_log_mask(LOG_UNIMP, "AMX: unimplemented op %u operand 0x%" PRIx64
+                      "\n", op, operand);
+        raise_exception_ra(env, EXCP_UDEF, syn_uncategorized(),
+                           exception_target_el(env), ra);
+    }
+}
@@ -40,7 +40,7 @@
 #include "user/page-protection.h"
 #endif
 #include "vec_internal.h"
-#include "WKdm.h"
+#include "qemu/wkdm.h"
 
 /* C2.4.7 Multiply and divide */
 /* special cases for 0 and LLONG_MIN are mandated by the standard */
@@ -791,10 +791,49 @@ illegal_return:
                   "resuming execution at 0x%" PRIx64 "\n", cur_el, env->pc);
 }
 
+/*
+ * GENTER and GEXIT stay at the current EL, so they are handled here rather
+ * than as exceptions, which lets the translator chain straight to the
+ * guarded entry point and back.  The state changes match those of the
+ * EXCP_GENTER exception entry in arm_cpu_do_interrupt_aarch64().
+ * env->pc must already point past the GENTER.
+ */
+void HELPER(genter)(CPUARMState *env)
+{
+    int cur_el = arm_current_el(env);
+    uint32_t old_mode = pstate_read(env);
+
+    aarch64_save_sp(env, cur_el);
+
+    if (cur_el == 1) {
+        uint64_t hcr = arm_hcr_el2_eff(env);
+        if ((hcr & (HCR_NV | HCR_NV1 | HCR_NV2)) == HCR_NV ||
+            (hcr & (HCR_NV | HCR_NV2)) == (HCR_NV | HCR_NV2)) {
+            old_mode = deposit32(old_mode, 2, 2, 2);
+        }
+    }
+
+    env->gxf.elr_gl[cur_el] = env->pc;
+    env->gxf.spsr_gl[cur_el] = old_mode;
+
+    pstate_write(env, PSTATE_DAIF |
+                          aarch64_exception_pstate(env, cur_el, old_mode));
+    env->gxf.gxf_status_el[cur_el] |= 1;
+    aarch64_restore_sp(env, cur_el);
+    env->pc = env->gxf.gxf_enter_el[cur_el];
+    helper_rebuild_hflags_a64(env, cur_el);
+    env_archcpu(env)->gxf_fast_transitions++;
+    qemu_log_mask(CPU_LOG_INT, "Guarded execution entry from AArch64 EL%d to "
+                  "AArch64 GL%d PC 0x%" PRIx64 "\n", cur_el, cur_el,
+                  env->pc);
+}
+
 void HELPER(gexit)(CPUARMState *env)
 {
+    CPUState *cs = env_cpu(env);
     int cur_el = arm_current_el(env);
     uint32_t spsr = env->gxf.spsr_gl[cur_el];
+    uint32_t unmasked;
 
     aarch64_save_sp(env, cur_el);
 
@@ -803,6 +842,7 @@ void HELPER(gexit)(CPUARMState *env)
     }
 
     spsr &= aarch64_pstate_valid_mask(&env_archcpu(env)->isar);
+    unmasked = env->daif & ~spsr & PSTATE_DAIF;
     pstate_write(env, spsr);
 
     if (!arm_singlestep_active(env)) {
@@ -813,10 +853,19 @@ void HELPER(gexit)(CPUARMState *env)
     aarch64_restore_sp(env, cur_el);
     env->pc = env->gxf.elr_gl[cur_el];
     helper_rebuild_hflags_a64(env, cur_el);
+    env_archcpu(env)->gxf_fast_transitions++;
     qemu_log_mask(CPU_LOG_INT, "Guarded execution exit from AArch64 GL%d to "
                       "AArch64 EL%d PC 0x%" PRIx64 "\n",
                       cur_el, cur_el, env->pc);
-    return;
+
+    /*
+     * The translator chains to the next TB, which would not notice an
+     * interrupt that was pending while masked.  Go back to the main loop
+     * if this unmasked one.
+     */
+    if (unmasked && qatomic_read(&cs->interrupt_request)) {
+        cpu_loop_exit_noexc(cs);
+    }
 }
 
 void HELPER(dc_zva)(CPUARMState *env, uint64_t vaddr_in)
@@ -1810,71 +1859,103 @@ void HELPER(guarded_page_br)(CPUARMState *env, target_ulong pc)
     env->btype = is_guarded_page(env, pc, GETPC()) ? 3 : 1;
 }
 
-static void *get_page_read(CPUARMState *env, uint64_t vaddr_in, int mmu_idx)
-{
-    uint64_t vaddr = vaddr_in & TARGET_PAGE_MASK;
-
-    void *mem = tlb_vaddr_to_host(env, vaddr, MMU_DATA_LOAD, mmu_idx);
-#ifndef CONFIG_USER_ONLY
-    if (unlikely(!mem)) {
-        uintptr_t ra = GETPC();
-
-        /*
-         * Trap if accessing an invalid page.
-         */
-        (void) probe_read(env, vaddr_in, 1, mmu_idx, ra);
-        mem = probe_read(env, vaddr, TARGET_PAGE_SIZE, mmu_idx, ra);
+/*
+ * A WKdm page may span several target pages.  Probe the @size bytes at
+ * @vaddr, raising the guest fault for unmapped pages, and return a host
+ * pointer to them if they are contiguous in host memory.  Otherwise return
+ * NULL, with *@valid set if the bytes are RAM and can be accessed through
+ * wkdm_copy().
+ */
+static void *wkdm_get_host(CPUARMState *env, uint64_t vaddr, int size,
+                           MMUAccessType access_type, int mmu_idx,
+                           uintptr_t ra, bool *valid)
+{
+    void *host = NULL;
+    bool contiguous = true;
+    int off, len;
+
+    for (off = 0; off < size; off += len) {
+        void *mem;
+
+        len = MIN(size - off, -((vaddr + off) | TARGET_PAGE_MASK));
+        mem = probe_access(env, vaddr + off, len, access_type, mmu_idx, ra);
+        if (mem == NULL) {
+            *valid = false;
+            return NULL;
+        }
+        if (off == 0) {
+            host = mem;
+        } else if (mem != host + off) {
+            contiguous = false;
+        }
     }
-#endif
 
-    return mem;
+    *valid = true;
+    return contiguous ? host : NULL;
 }
 
-static void *get_page_write(CPUARMState *env, uint64_t vaddr_in, int mmu_idx)
+static void wkdm_copy(CPUARMState *env, uint64_t vaddr, void *buf, int size,
+                      MMUAccessType access_type, bool to_guest, int mmu_idx,
+                      uintptr_t ra)
 {
-    uint64_t vaddr = vaddr_in & TARGET_PAGE_MASK;
+    int off, len;
 
-    void *mem = tlb_vaddr_to_host(env, vaddr, MMU_DATA_STORE, mmu_idx);
-#ifndef CONFIG_USER_ONLY
-    if (unlikely(!mem)) {
-        uintptr_t ra = GETPC();
+    for (off = 0; off < size; off += len) {
+        void *mem;
 
-        /*
-         * Trap if accessing an invalid page.
-         */
-        (void) probe_write(env, vaddr_in, 1, mmu_idx, ra);
-        mem = probe_write(env, vaddr, TARGET_PAGE_SIZE, mmu_idx, ra);
+        len = MIN(size - off, -((vaddr + off) | TARGET_PAGE_MASK));
+        mem = probe_access(env, vaddr + off, len, access_type, mmu_idx, ra);
+        if (to_guest) {
+            memcpy(mem, buf + off, len);
+        } else {
+            memcpy(buf + off, mem, len);
+        }
     }
-#endif
-
-    return mem;
 }
 
 uint64_t HELPER(wkdmc)(CPUARMState *env, uint64_t vaddr_in, uint64_t vaddr_out)
 {
-    int mmu_idx;
-    char *in_mem;
-    char *out_mem;
-    int out_offset;
+    int mmu_idx = arm_env_mmu_index(env);
+    uintptr_t ra = GETPC();
+    uint32_t in_buf[WKDM_PAGE_SIZE / 4];
+    uint32_t out_buf[WKDM_PAGE_SIZE / 4];
+    void *in_mem;
+    void *out_mem;
+    bool valid;
     int csize;
+    int n;
 
-    if (TARGET_PAGE_BITS < 10 || TARGET_PAGE_BITS > 14) {
-        return -1;
-    }
-
-    mmu_idx = arm_env_mmu_index(env);
-    vaddr_in &= TARGET_PAGE_MASK;
+    vaddr_in &= ~(uint64_t)(WKDM_PAGE_SIZE - 1);
     vaddr_out &= ~0x3f;
-    in_mem = get_page_read(env, vaddr_in, mmu_idx);
-    out_mem = get_page_write(env, vaddr_out, mmu_idx);
-    out_offset = vaddr_out - (vaddr_out & TARGET_PAGE_MASK);
-    csize = TARGET_PAGE_SIZE - out_offset;
+    csize = WKDM_PAGE_SIZE - (vaddr_out & (WKDM_PAGE_SIZE - 1));
 
-    if (in_mem == NULL || out_mem == NULL) {
+    in_mem = wkdm_get_host(env, vaddr_in, WKDM_PAGE_SIZE, MMU_DATA_LOAD,
+                           mmu_idx, ra, &valid);
+    if (!valid) {
         return -1;
     }
+    out_mem = wkdm_get_host(env, vaddr_out, csize, MMU_DATA_STORE, mmu_idx,
+                            ra, &valid);
+    if (!valid) {
+        return -1;
+    }
+
+    if (in_mem == NULL) {
+        wkdm_copy(env, vaddr_in, in_buf, WKDM_PAGE_SIZE, MMU_DATA_LOAD, false,
+                  mmu_idx, ra);
+        in_mem = in_buf;
+    }
+    if (out_mem == NULL) {
+        // Bytes the compressor skips must keep their old contents.
+        wkdm_copy(env, vaddr_out, out_buf, csize, MMU_DATA_STORE, false,
+                  mmu_idx, ra);
+        n = WKdm_compress(in_mem, out_buf, csize);
+        wkdm_copy(env, vaddr_out, out_buf, csize, MMU_DATA_STORE, true,
+                  mmu_idx, ra);
+    } else {
+        n = WKdm_compress(in_mem, out_mem, csize);
+    }
 
-    int n = WKdm_compress(in_mem, out_mem + out_offset, csize);
     if (n <= 0) {
         return n;
     }
@@ -1886,30 +1967,45 @@ uint64_t HELPER(wkdmc)(CPUARMState *env, uint64_t vaddr_in, uint64_t vaddr_out)
 
 uint64_t HELPER(wkdmd)(CPUARMState *env, uint64_t vaddr_in, uint64_t vaddr_out)
 {
-    int mmu_idx;
-    uint8_t *in_mem, *out_mem;
-    int in_offset;
+    int mmu_idx = arm_env_mmu_index(env);
+    uintptr_t ra = GETPC();
+    uint32_t in_buf[WKDM_PAGE_SIZE / 4];
+    uint32_t out_buf[WKDM_PAGE_SIZE / 4];
+    void *in_mem;
+    void *out_mem;
+    bool valid;
+    bool ok;
     int csize;
 
-    if (TARGET_PAGE_BITS < 10 || TARGET_PAGE_BITS > 14) {
-        return 0x3000;
-    }
-
-    mmu_idx = arm_env_mmu_index(env);
-    vaddr_out &= TARGET_PAGE_MASK;
+    vaddr_out &= ~(uint64_t)(WKDM_PAGE_SIZE - 1);
     vaddr_in &= ~0x3f;
-    in_mem = get_page_read(env, vaddr_in, mmu_idx);
-    out_mem = get_page_write(env, vaddr_out, mmu_idx);
-    in_offset = vaddr_in - (vaddr_in & TARGET_PAGE_MASK);
-    csize = TARGET_PAGE_SIZE - in_offset;
+    csize = WKDM_PAGE_SIZE - (vaddr_in & (WKDM_PAGE_SIZE - 1));
 
-    if (in_mem == NULL || out_mem == NULL) {
+    in_mem = wkdm_get_host(env, vaddr_in, csize, MMU_DATA_LOAD, mmu_idx, ra,
+                           &valid);
+    if (!valid) {
+        return 0x3000;
+    }
+    out_mem = wkdm_get_host(env, vaddr_out, WKDM_PAGE_SIZE, MMU_DATA_STORE,
+                            mmu_idx, ra, &valid);
+    if (!valid) {
         return 0x3000;
     }
 
-    if (WKdm_decompress(in_mem + in_offset, out_mem, csize)) {
-        return 0;
+    if (in_mem == NULL) {
+        wkdm_copy(env, vaddr_in, in_buf, csize, MMU_DATA_LOAD, false, mmu_idx,
+                  ra);
+        in_mem = in_buf;
+    }
+    if (out_mem == NULL) {
+        wkdm_copy(env, vaddr_out, out_buf, WKDM_PAGE_SIZE, MMU_DATA_STORE,
+                  false, mmu_idx, ra);
+        ok = WKdm_decompress(in_mem, out_buf, csize);
+        wkdm_copy(env, vaddr_out, out_buf, WKDM_PAGE_SIZE, MMU_DATA_STORE,
+                  true, mmu_idx, ra);
+    } else {
+        ok = WKdm_decompress(in_mem, out_mem, csize);
     }
 
-    return 0x3000;
+    return ok ? 0 : 0x3000;
 }
@@ -426,6 +426,10 @@ static CPUARMTBFlags rebuild_hflags_a64(CPUARMState *env, int el, int fp_el,
         }
     }
 
+    if (arm_is_guarded(env)) {
+        DP_TBFLAG_A64(flags, GUARDED, 1);
+    }
+
     return rebuild_hflags_common(env, fp_el, mmu_idx, flags);
 }
 
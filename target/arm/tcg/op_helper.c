@@ -966,11 +966,16 @@ void HELPER(tidcp_el0)(CPUARMState *env, uint32_t syndrome)
     }
 }
 
+static inline bool cp_reg_needs_bql(const ARMCPRegInfo *ri)
+{
+    return (ri->type & (ARM_CP_IO | ARM_CP_IO_NO_BQL)) == ARM_CP_IO;
+}
+
 void HELPER(set_cp_reg)(CPUARMState *env, const void *rip, uint32_t value)
 {
     const ARMCPRegInfo *ri = rip;
 
-    if (ri->type & ARM_CP_IO) {
+    if (cp_reg_needs_bql(ri)) {
         bql_lock();
         ri->writefn(env, ri, value);
         bql_unlock();
@@ -984,7 +989,7 @@ uint32_t HELPER(get_cp_reg)(CPUARMState *env, const void *rip)
     const ARMCPRegInfo *ri = rip;
     uint32_t res;
 
-    if (ri->type & ARM_CP_IO) {
+    if (cp_reg_needs_bql(ri)) {
         bql_lock();
         res = ri->readfn(env, ri);
         bql_unlock();
@@ -999,7 +1004,7 @@ void HELPER(set_cp_reg64)(CPUARMState *env, const void *rip, uint64_t value)
 {
     const ARMCPRegInfo *ri = rip;
 
-    if (ri->type & ARM_CP_IO) {
+    if (cp_reg_needs_bql(ri)) {
         bql_lock();
         ri->writefn(env, ri, value);
         bql_unlock();
@@ -1013,7 +1018,7 @@ uint64_t HELPER(get_cp_reg64)(CPUARMState *env, const void *rip)
     const ARMCPRegInfo *ri = rip;
     uint64_t res;
 
-    if (ri->type & ARM_CP_IO) {
+    if (cp_reg_needs_bql(ri)) {
         bql_lock();
         res = ri->readfn(env, ri);
         bql_unlock();
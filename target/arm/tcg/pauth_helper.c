@@ -312,25 +312,98 @@ static uint64_t pauth_computepac_impdef(uint64_t data, uint64_t modifier,
     return qemu_xxhash64_4(data, modifier, key.lo, key.hi);
 }
 
+/* Key identifiers used to tag PAC cache entries. */
+enum {
+    PAC_KEY_IA,
+    PAC_KEY_IB,
+    PAC_KEY_DA,
+    PAC_KEY_DB,
+    PAC_KEY_GA,
+    /* Set when the key was diversified with KERNELKEY_EL1. */
+    PAC_KEY_KERNEL = 1 << 3,
+};
+
+static inline uint32_t pauth_cache_index(uint64_t data, uint64_t modifier,
+                                         uint32_t key_id)
+{
+    uint64_t h = (data >> 2) ^ (modifier * 0x9e3779b97f4a7c15ull) ^ key_id;
+
+    h ^= h >> 32;
+    h ^= h >> ARM_PAC_CACHE_BITS;
+    return h & (ARM_PAC_CACHE_SIZE - 1);
+}
+
+/* PAC algorithm of the vCPU */
+typedef enum {
+    PAC_ALG_QARMA5,
+    PAC_ALG_QARMA3,
+    PAC_ALG_IMPDEF,
+} PACAlgorithm;
+
+static uint64_t pauth_computepac_alg(uint64_t data, uint64_t modifier,
+                                     ARMPACKey key, PACAlgorithm alg)
+{
+    switch (alg) {
+    case PAC_ALG_QARMA5:
+        return pauth_computepac_architected(data, modifier, key, false);
+    case PAC_ALG_QARMA3:
+        return pauth_computepac_architected(data, modifier, key, true);
+    default:
+        return pauth_computepac_impdef(data, modifier, key);
+    }
+}
+
+static uint64_t pauth_computepac_cached(ARMCPU *cpu, uint64_t data,
+                                        uint64_t modifier, ARMPACKey key,
+                                        uint32_t key_id, PACAlgorithm alg)
+{
+    ARMPACCacheEntry *e;
+
+    if (!cpu->prop_pauth_cache) {
+        return pauth_computepac_alg(data, modifier, key, alg);
+    }
+
+    e = &cpu->pac_cache[pauth_cache_index(data, modifier, key_id)];
+    if (e->gen == cpu->pac_cache_gen && e->key_id == key_id &&
+        e->data == data && e->modifier == modifier) {
+        cpu->pac_cache_hits++;
+        return e->pac;
+    }
+
+    cpu->pac_cache_misses++;
+    e->pac = pauth_computepac_alg(data, modifier, key, alg);
+    e->data = data;
+    e->modifier = modifier;
+    e->key_id = key_id;
+    e->gen = cpu->pac_cache_gen;
+    return e->pac;
+}
+
 static uint64_t pauth_computepac(CPUARMState *env, uint64_t data,
-                                 uint64_t modifier, ARMPACKey key)
+                                 uint64_t modifier, ARMPACKey key,
+                                 uint32_t key_id)
 {
+    ARMCPU *cpu = env_archcpu(env);
+    PACAlgorithm alg;
+
     if (arm_current_el(env) && (env->cp15.apctl_el1 & APCTL_KernKeyEn)) {
         key.lo ^= env->keys.kernel.lo;
         key.hi ^= env->keys.kernel.hi;
+        key_id |= PAC_KEY_KERNEL;
     }
 
-    if (cpu_isar_feature(aa64_pauth_qarma5, env_archcpu(env))) {
-        return pauth_computepac_architected(data, modifier, key, false);
-    } else if (cpu_isar_feature(aa64_pauth_qarma3, env_archcpu(env))) {
-        return pauth_computepac_architected(data, modifier, key, true);
+    if (cpu_isar_feature(aa64_pauth_qarma5, cpu)) {
+        alg = PAC_ALG_QARMA5;
+    } else if (cpu_isar_feature(aa64_pauth_qarma3, cpu)) {
+        alg = PAC_ALG_QARMA3;
     } else {
-        return pauth_computepac_impdef(data, modifier, key);
+        alg = PAC_ALG_IMPDEF;
     }
+    return pauth_computepac_cached(cpu, data, modifier, key, key_id, alg);
 }
 
 static uint64_t pauth_addpac(CPUARMState *env, uint64_t ptr, uint64_t modifier,
-                             ARMPACKey *key, bool data)
+                             ARMPACKey *key, uint32_t key_id, bool data)
 {
     ARMCPU *cpu = env_archcpu(env);
     ARMMMUIdx mmu_idx = arm_stage1_mmu_idx(env);
@@ -351,7 +424,7 @@ static uint64_t pauth_addpac(CPUARMState *env, uint64_t ptr, uint64_t modifier,
     bot_bit = 64 - param.tsz;
     ext_ptr = deposit64(ptr, bot_bit, top_bit - bot_bit, ext);
 
-    pac = pauth_computepac(env, ext_ptr, modifier, *key);
+    pac = pauth_computepac(env, ext_ptr, modifier, *key, key_id);
 
     /*
      * Check if the ptr has good extension bits and corrupt the
@@ -422,7 +495,8 @@ static uint64_t pauth_auth(CPUARMState *env, uint64_t ptr, uint64_t modifier,
     uint64_t pac, orig_ptr, cmp_mask;
 
     orig_ptr = pauth_original_ptr(ptr, param);
-    pac = pauth_computepac(env, orig_ptr, modifier, *key);
+    pac = pauth_computepac(env, orig_ptr, modifier, *key,
+                           (data ? PAC_KEY_DA : PAC_KEY_IA) + keynumber);
     bot_bit = 64 - param.tsz;
     top_bit = 64 - 8 * param.tbi;
 
@@ -502,7 +576,7 @@ uint64_t HELPER(pacia)(CPUARMState *env, uint64_t x, uint64_t y)
         return x;
     }
     pauth_check_trap(env, el, GETPC());
-    return pauth_addpac(env, x, y, &env->keys.apia, false);
+    return pauth_addpac(env, x, y, &env->keys.apia, PAC_KEY_IA, false);
 }
 
 uint64_t HELPER(pacib)(CPUARMState *env, uint64_t x, uint64_t y)
@@ -512,7 +586,7 @@ uint64_t HELPER(pacib)(CPUARMState *env, uint64_t x, uint64_t y)
         return x;
     }
     pauth_check_trap(env, el, GETPC());
-    return pauth_addpac(env, x, y, &env->keys.apib, false);
+    return pauth_addpac(env, x, y, &env->keys.apib, PAC_KEY_IB, false);
 }
 
 uint64_t HELPER(pacda)(CPUARMState *env, uint64_t x, uint64_t y)
@@ -522,7 +596,7 @@ uint64_t HELPER(pacda)(CPUARMState *env, uint64_t x, uint64_t y)
         return x;
     }
     pauth_check_trap(env, el, GETPC());
-    return pauth_addpac(env, x, y, &env->keys.apda, true);
+    return pauth_addpac(env, x, y, &env->keys.apda, PAC_KEY_DA, true);
 }
 
 uint64_t HELPER(pacdb)(CPUARMState *env, uint64_t x, uint64_t y)
@@ -532,7 +606,7 @@ uint64_t HELPER(pacdb)(CPUARMState *env, uint64_t x, uint64_t y)
         return x;
     }
     pauth_check_trap(env, el, GETPC());
-    return pauth_addpac(env, x, y, &env->keys.apdb, true);
+    return pauth_addpac(env, x, y, &env->keys.apdb, PAC_KEY_DB, true);
 }
 
 uint64_t HELPER(pacga)(CPUARMState *env, uint64_t x, uint64_t y)
@@ -540,7 +614,7 @@ uint64_t HELPER(pacga)(CPUARMState *env, uint64_t x, uint64_t y)
     uint64_t pac;
 
     pauth_check_trap(env, arm_current_el(env), GETPC());
-    pac = pauth_computepac(env, x, y, env->keys.apga);
+    pac = pauth_computepac(env, x, y, env->keys.apga, PAC_KEY_GA);
 
     return pac & 0xffffffff00000000ull;
 }
@@ -10116,6 +10116,16 @@ static bool disas_apple_insn(DisasContext *s, uint32_t insn)
     rn = extract32(insn, 5, 5);
     rd = extract32(insn, 0, 5);
 
+    if (opcode == 4) { // AMX, usable from EL0
+        if (!s->amx_active || extract32(insn, 16, 15) != 0x20) {
+            return false;
+        }
+        // set/clr take an immediate, every other op takes Xn
+        gen_helper_amx(tcg_env, tcg_constant_i32(rn),
+                       rn == 17 ? tcg_constant_i64(rd) : cpu_reg(s, rd));
+        return true;
+    }
+
     if (s->current_el == 0) {
         return false;
     }
@@ -10138,16 +10148,25 @@ static bool disas_apple_insn(DisasContext *s, uint32_t insn)
                 if (s->guarded) {
                     return false;
                 }
-                gen_a64_update_pc(s, 0);
-                gen_ss_advance(s);
-                gen_exception_insn(s, 4, EXCP_GENTER, syn_aa64_genter(rd));
+                if (s->ss_active) {
+                    // Let the exception entry deal with software step.
+                    gen_a64_update_pc(s, 0);
+                    gen_ss_advance(s);
+                    gen_exception_insn(s, 4, EXCP_GENTER,
+                                       syn_aa64_genter(rd));
+                    return true;
+                }
+                // Chain to the entry point under the guarded TB flags.
+                gen_a64_update_pc(s, 4);
+                gen_helper_genter(tcg_env);
+                s->base.is_jmp = DISAS_JUMP;
                 return true;
             case 0: // GEXIT
                 if (!s->guarded) {
                     return false;
                 }
                 gen_helper_gexit(tcg_env);
-                s->base.is_jmp = DISAS_EXIT;
+                s->base.is_jmp = DISAS_JUMP;
                 return true;
             default:
                 break;
@@ -10187,6 +10206,7 @@ static void aarch64_tr_init_disas_context(DisasContextBase *dcbase,
     dc->condjmp = 0;
     dc->pc_save = dc->base.pc_first;
     dc->gxf_active = arm_feature(env, ARM_FEATURE_GXF);
+    dc->amx_active = arm_feature(env, ARM_FEATURE_AMX);
     dc->aarch64 = true;
     dc->thumb = false;
     dc->sctlr_b = 0;
@@ -10220,7 +10240,7 @@ static void aarch64_tr_init_disas_context(DisasContextBase *dcbase,
     dc->ata[1] = EX_TBFLAG_A64(tb_flags, ATA0);
     dc->mte_active[0] = EX_TBFLAG_A64(tb_flags, MTE_ACTIVE);
     dc->mte_active[1] = EX_TBFLAG_A64(tb_flags, MTE0_ACTIVE);
-    dc->guarded = arm_is_guarded(env);
+    dc->guarded = EX_TBFLAG_A64(tb_flags, GUARDED);
     dc->pstate_sm = EX_TBFLAG_A64(tb_flags, PSTATE_SM);
     dc->pstate_za = EX_TBFLAG_A64(tb_flags, PSTATE_ZA);
     dc->sme_trap_nonstreaming = EX_TBFLAG_A64(tb_flags, SME_TRAP_NONSTREAMING);
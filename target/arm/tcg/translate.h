@@ -123,6 +123,8 @@ typedef struct DisasContext {
     bool ata[2];
     /* True if Apple's GXF is enabled */
     bool gxf_active;
+    /* True if Apple's AMX is implemented */
+    bool amx_active;
     /* True if v8.5-MTE tag checks affect the PE; index with is_unpriv.  */
     bool mte_active[2];
     /* True with v8.5-BTI and SCTLR_ELx.BT* set.  */
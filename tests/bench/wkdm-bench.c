@@ -0,0 +1,81 @@
+/*
+ * QEMU WKdm compression speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/wkdm.h"
+
+#define WORDS (WKDM_PAGE_SIZE / 4)
+
+typedef struct {
+    const char *name;
+    /* Out of 16 words, how many are zero, the others being pointers */
+    int zeroes;
+} WKdmBenchPage;
+
+static const WKdmBenchPage pages[] = {
+    { "zero", 16 },
+    { "mostly-zero", 14 },
+    { "half-zero", 8 },
+    { "pointers", 0 },
+};
+
+static void fill_page(uint32_t *page, const WKdmBenchPage *p)
+{
+    for (int i = 0; i < WORDS; i++) {
+        page[i] = i % 16 < p->zeroes ? 0 : 0x10000000 + i * 8;
+    }
+}
+
+static void test(const void *opaque)
+{
+    g_autofree uint32_t *page = g_new(uint32_t, WORDS);
+    g_autofree uint32_t *out = g_new0(uint32_t, WORDS);
+    g_autofree uint32_t *back = g_new(uint32_t, WORDS);
+    int accel_index = 0;
+
+    do {
+        if (accel_index != 0) {
+            g_test_message("%s", "");  /* gnu_printf Werror for simple "" */
+        }
+        for (int i = 0; i < ARRAY_SIZE(pages); i++) {
+            double total = 0.0;
+            int size;
+
+            fill_page(page, &pages[i]);
+            g_test_timer_start();
+            do {
+                size = WKdm_compress(page, out, WKDM_PAGE_SIZE);
+                total += WKDM_PAGE_SIZE;
+            } while (g_test_timer_elapsed() < 0.5);
+            g_test_message("WKdm_compress #%d:   %-12s %8.0f MB/sec",
+                           accel_index, pages[i].name,
+                           total / MiB / g_test_timer_last());
+
+            if (size <= 0) {
+                continue;
+            }
+            total = 0.0;
+            g_test_timer_start();
+            do {
+                WKdm_decompress(out, back, WKDM_PAGE_SIZE);
+                total += WKDM_PAGE_SIZE;
+            } while (g_test_timer_elapsed() < 0.5);
+            g_test_message("WKdm_decompress #%d: %-12s %8.0f MB/sec",
+                           accel_index, pages[i].name,
+                           total / MiB / g_test_timer_last());
+        }
+        accel_index++;
+    } while (test_WKdm_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_data_func("/wkdm/speed", NULL, test);
+    return g_test_run();
+}
@@ -0,0 +1,207 @@
+/*
+ * Apple AMX fma32/fma64 outer and vector products.
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* AMX instructions take their operand in x0, set/clr take an immediate. */
+#define AMX_OP(op, operand)                                             \
+    do {                                                                \
+        register uint64_t x0_ asm("x0") = (operand);                    \
+        asm volatile(".word (0x00201000 + (" #op " << 5))"              \
+                     : : "r"(x0_) : "memory");                          \
+    } while (0)
+
+#define AMX_SET()   asm volatile(".word (0x00201000 + (17 << 5) + 0)")
+#define AMX_CLR()   asm volatile(".word (0x00201000 + (17 << 5) + 1)")
+
+#define LDX(p)          AMX_OP(0, (uint64_t)(p))
+#define LDY(p)          AMX_OP(1, (uint64_t)(p))
+#define LDZ(p, row)     AMX_OP(4, (uint64_t)(p) | ((uint64_t)(row) << 56))
+#define STZ(p, row)     AMX_OP(5, (uint64_t)(p) | ((uint64_t)(row) << 56))
+#define FMA64(operand)  AMX_OP(10, operand)
+#define FMS64(operand)  AMX_OP(11, operand)
+#define FMA32(operand)  AMX_OP(12, operand)
+#define FMS32(operand)  AMX_OP(13, operand)
+
+#define SKIP_Z          (1ull << 27)
+#define VECTOR          (1ull << 63)
+#define ZROW(r)         ((uint64_t)(r) << 20)
+
+static double x64[8] __attribute__((aligned(64)));
+static double y64[8] __attribute__((aligned(64)));
+static double z64[8] __attribute__((aligned(64)));
+static float x32[16] __attribute__((aligned(64)));
+static float y32[16] __attribute__((aligned(64)));
+static float z32[16] __attribute__((aligned(64)));
+
+static int errors;
+
+static void check64(const char *test, int row, int lane, double expect)
+{
+    if (memcmp(&z64[lane], &expect, sizeof(expect))) {
+        printf("%s: Z[%d][%d] = %a, expected %a\n",
+               test, row, lane, z64[lane], expect);
+        errors++;
+    }
+}
+
+static void check32(const char *test, int row, int lane, float expect)
+{
+    if (memcmp(&z32[lane], &expect, sizeof(expect))) {
+        printf("%s: Z[%d][%d] = %a, expected %a\n",
+               test, row, lane, z32[lane], expect);
+        errors++;
+    }
+}
+
+static void fill_z64(double v)
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        z64[i] = v;
+    }
+    for (i = 0; i < 64; i++) {
+        LDZ(z64, i);
+    }
+}
+
+static void fill_z32(float v)
+{
+    int i;
+
+    for (i = 0; i < 16; i++) {
+        z32[i] = v;
+    }
+    for (i = 0; i < 64; i++) {
+        LDZ(z32, i);
+    }
+}
+
+static void test_fma64(void)
+{
+    int i, j;
+
+    /*
+     * Lane 0 of row 0 is (1 + 2^-30) * (1 - 2^-30) - 1, which is -2^-60
+     * when fused and 0 when the product is rounded first.
+     */
+    for (i = 0; i < 8; i++) {
+        x64[i] = i ? i + 0.25 : 1 + 0x1p-30;
+        y64[i] = i ? -0.5 * i : 1 - 0x1p-30;
+    }
+    LDX(x64);
+    LDY(y64);
+
+    fill_z64(-1.0);
+    FMA64(ZROW(3));
+    for (j = 0; j < 8; j++) {
+        STZ(z64, j * 8 + 3);
+        for (i = 0; i < 8; i++) {
+            check64("fma64", j * 8 + 3, i, fma(x64[i], y64[j], -1.0));
+        }
+    }
+    STZ(z64, 0);
+    check64("fma64 untouched", 0, 0, -1.0);
+    STZ(z64, 3);
+    if (z64[0] != -0x1p-60) {
+        printf("fma64: Z[3][0] = %a, not fused\n", z64[0]);
+        errors++;
+    }
+
+    fill_z64(100.0);
+    FMA64(ZROW(5) | SKIP_Z);
+    for (j = 0; j < 8; j++) {
+        STZ(z64, j * 8 + 5);
+        for (i = 0; i < 8; i++) {
+            check64("fma64 skip-z", j * 8 + 5, i, x64[i] * y64[j]);
+        }
+    }
+
+    fill_z64(2.0);
+    FMS64(ZROW(0));
+    for (j = 0; j < 8; j++) {
+        STZ(z64, j * 8);
+        for (i = 0; i < 8; i++) {
+            check64("fms64", j * 8, i, fma(-x64[i], y64[j], 2.0));
+        }
+    }
+
+    fill_z64(-1.0);
+    FMA64(ZROW(9) | VECTOR);
+    STZ(z64, 9);
+    for (i = 0; i < 8; i++) {
+        check64("fma64 vector", 9, i, fma(x64[i], y64[i], -1.0));
+    }
+    STZ(z64, 17);
+    check64("fma64 vector untouched", 17, 0, -1.0);
+}
+
+static void test_fma32(void)
+{
+    int i, j;
+
+    /* As above, lane 0 of row 0 is -2^-26 only when fused. */
+    for (i = 0; i < 16; i++) {
+        x32[i] = i ? i + 0.25f : 1 + 0x1p-13f;
+        y32[i] = i ? -0.5f * i : 1 - 0x1p-13f;
+    }
+    LDX(x32);
+    LDY(y32);
+
+    fill_z32(-1.0f);
+    FMA32(ZROW(2));
+    for (j = 0; j < 16; j++) {
+        STZ(z32, j * 4 + 2);
+        for (i = 0; i < 16; i++) {
+            check32("fma32", j * 4 + 2, i, fmaf(x32[i], y32[j], -1.0f));
+        }
+    }
+    STZ(z32, 2);
+    if (z32[0] != -0x1p-26f) {
+        printf("fma32: Z[2][0] = %a, not fused\n", z32[0]);
+        errors++;
+    }
+
+    fill_z32(100.0f);
+    FMA32(ZROW(1) | SKIP_Z);
+    for (j = 0; j < 16; j++) {
+        STZ(z32, j * 4 + 1);
+        for (i = 0; i < 16; i++) {
+            check32("fma32 skip-z", j * 4 + 1, i, x32[i] * y32[j]);
+        }
+    }
+    STZ(z32, 0);
+    check32("fma32 skip-z untouched", 0, 0, 100.0f);
+
+    fill_z32(2.0f);
+    FMS32(ZROW(3));
+    for (j = 0; j < 16; j++) {
+        STZ(z32, j * 4 + 3);
+        for (i = 0; i < 16; i++) {
+            check32("fms32", j * 4 + 3, i, fmaf(-x32[i], y32[j], 2.0f));
+        }
+    }
+
+    fill_z32(100.0f);
+    FMA32(ZROW(6) | VECTOR | SKIP_Z);
+    STZ(z32, 6);
+    for (i = 0; i < 16; i++) {
+        check32("fma32 vector skip-z", 6, i, x32[i] * y32[i]);
+    }
+}
+
+int main(void)
+{
+    AMX_SET();
+    test_fma64();
+    test_fma32();
+    AMX_CLR();
+
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * Stubs for the Apple Silicon device tests
+ *
+ * The memory API, the monitor and PCI are only built into the system
+ * emulator.  The tests call MMIO handlers directly, so regions only
+ * need to remember their ops.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "exec/address-spaces.h"
+#include "exec/memory.h"
+#include "hw/pci/msi.h"
+#include "monitor/monitor.h"
+
+bool msi_nonbroken;
+
+static MemoryRegion system_memory;
+
+MemoryRegion *get_system_memory(void)
+{
+    return &system_memory;
+}
+
+void memory_region_init_io(MemoryRegion *mr, Object *owner,
+                           const MemoryRegionOps *ops, void *opaque,
+                           const char *name, uint64_t size)
+{
+    mr->owner = owner;
+    mr->ops = ops;
+    mr->opaque = opaque;
+    mr->size = int128_make64(size);
+}
+
+void memory_region_enable_lockless_io(MemoryRegion *mr)
+{
+}
+
+uint64_t memory_region_size(MemoryRegion *mr)
+{
+    return int128_get64(mr->size);
+}
+
+void memory_region_add_subregion(MemoryRegion *mr, hwaddr offset,
+                                 MemoryRegion *subregion)
+{
+    g_assert_not_reached();
+}
+
+void memory_region_add_subregion_overlap(MemoryRegion *mr, hwaddr offset,
+                                         MemoryRegion *subregion,
+                                         int priority)
+{
+    g_assert_not_reached();
+}
+
+void memory_region_del_subregion(MemoryRegion *mr, MemoryRegion *subregion)
+{
+    g_assert_not_reached();
+}
+
+int monitor_printf(Monitor *mon, const char *fmt, ...)
+{
+    return 0;
+}
+
+void monitor_register_hmp(const char *name, bool info,
+                          void (*cmd)(Monitor *mon, const QDict *qdict))
+{
+}
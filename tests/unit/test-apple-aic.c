@@ -0,0 +1,249 @@
+/*
+ * Apple AIC IPI stress test
+ *
+ * Several threads stand in for vCPUs and hammer the lockless per-CPU AIC
+ * regions with IPI set/clear, deferred IPIs, masking and acks, while the
+ * main thread runs the deferred IPI timer.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "exec/memory.h"
+#include "hw/intc/apple_aic.h"
+#include "hw/irq.h"
+#include "hw/sysbus.h"
+
+#define NUM_CPUS 6
+#define ITERATIONS 20000
+
+#define REG_AIC_IACK 0x2004
+#define REG_AIC_IPI_SET 0x2008
+#define REG_AIC_IPI_CLR 0x200C
+#define REG_AIC_IPI_MASK_SET 0x2024
+#define REG_AIC_IPI_MASK_CLR 0x2028
+#define REG_AIC_IPI_DEFER_SET 0x202C
+#define REG_AIC_IPI_DEFER_CLR 0x2030
+#define REG_AIC_IPI_SET_Pn(n) (0x5008 + (n) * 0x80)
+#define REG_AIC_IPI_CLR_Pn(n) (0x500C + (n) * 0x80)
+
+#define AIC_IPI_NORMAL (1 << 0)
+#define AIC_IPI_SELF (1u << 31)
+#define ALL_CPUS ((1 << NUM_CPUS) - 1)
+
+#define kAIC_INT_SPURIOUS 0x00000
+#define kAIC_INT_IPI_NORM 0x40001
+#define kAIC_INT_IPI_SELF 0x40002
+
+static AppleAICState *aic;
+static int cpu_line[NUM_CPUS];
+static int threads_done;
+
+static void cpu_irq_handler(void *opaque, int n, int level)
+{
+    qatomic_set(&cpu_line[n], level);
+}
+
+static uint32_t aic_read(int cpu, hwaddr addr)
+{
+    MemoryRegion *mr = &aic->cpus[cpu].iomem;
+
+    return mr->ops->read(mr->opaque, addr, 4);
+}
+
+static void aic_write(int cpu, hwaddr addr, uint32_t val)
+{
+    MemoryRegion *mr = &aic->cpus[cpu].iomem;
+
+    mr->ops->write(mr->opaque, addr, val, 4);
+}
+
+static uint32_t next_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 1;
+}
+
+static void *vcpu_thread(void *opaque)
+{
+    int cpu = (uintptr_t)opaque;
+    uint32_t seed = cpu + 1;
+    uint32_t vec;
+    int i;
+
+    aic_write(cpu, REG_AIC_IPI_MASK_CLR, AIC_IPI_NORMAL | AIC_IPI_SELF);
+
+    for (i = 0; i < ITERATIONS; i++) {
+        uint32_t r = next_rand(&seed);
+        uint32_t targets = (r >> 8) & ALL_CPUS;
+
+        if (r & 0x80) {
+            targets |= AIC_IPI_SELF;
+        }
+
+        switch (r % 7) {
+        case 0:
+            aic_write(cpu, REG_AIC_IPI_SET, targets);
+            break;
+        case 1:
+            aic_write(cpu, REG_AIC_IPI_CLR, targets);
+            break;
+        case 2:
+            aic_write(cpu, REG_AIC_IPI_DEFER_SET, targets);
+            break;
+        case 3:
+            aic_write(cpu, REG_AIC_IPI_DEFER_CLR, targets);
+            break;
+        case 4:
+            /* On behalf of another cpu, through its alias */
+            aic_write(cpu, REG_AIC_IPI_SET_Pn((r >> 16) % NUM_CPUS), targets);
+            break;
+        case 5:
+            aic_write(cpu, REG_AIC_IPI_MASK_SET, AIC_IPI_NORMAL);
+            aic_write(cpu, REG_AIC_IPI_MASK_CLR, AIC_IPI_NORMAL);
+            break;
+        default:
+            vec = aic_read(cpu, REG_AIC_IACK);
+            if (vec == kAIC_INT_IPI_NORM) {
+                aic_write(cpu, REG_AIC_IPI_MASK_CLR, AIC_IPI_NORMAL);
+            } else if (vec == kAIC_INT_IPI_SELF) {
+                aic_write(cpu, REG_AIC_IPI_CLR, AIC_IPI_SELF);
+                aic_write(cpu, REG_AIC_IPI_MASK_CLR, AIC_IPI_SELF);
+            } else {
+                g_assert_cmphex(vec, ==, kAIC_INT_SPURIOUS);
+            }
+            break;
+        }
+    }
+    qatomic_inc(&threads_done);
+    return NULL;
+}
+
+/* Run the deferred IPI timer until nothing is outstanding. */
+static void drain_deferred(void)
+{
+    while (timer_pending(aic->timer)) {
+        qemu_clock_run_timers(QEMU_CLOCK_VIRTUAL);
+        g_usleep(10);
+    }
+}
+
+/* An unmasked pending IPI must have left its cpu's line raised. */
+static void check_lines(void)
+{
+    int i;
+
+    for (i = 0; i < NUM_CPUS; i++) {
+        AppleAICCPU *o = &aic->cpus[i];
+        bool want = (o->pendingIPI & AIC_IPI_SELF & ~o->ipi_mask) ||
+                    ((~o->ipi_mask & AIC_IPI_NORMAL) &&
+                     (o->pendingIPI & ALL_CPUS));
+
+        g_assert_cmphex(o->deferredIPI, ==, 0);
+        g_assert_cmpint(o->irq_applied, ==, o->irq_level);
+        g_assert_cmpint(qatomic_read(&cpu_line[i]), ==, o->irq_level);
+        if (want) {
+            g_assert_true(o->irq_level);
+        }
+    }
+}
+
+static void test_ipi_stress(void)
+{
+    QemuThread threads[NUM_CPUS];
+    int i;
+
+    for (i = 0; i < NUM_CPUS; i++) {
+        qemu_thread_create(&threads[i], "aic-vcpu", vcpu_thread,
+                           (void *)(uintptr_t)i, QEMU_THREAD_JOINABLE);
+    }
+
+    /* The deferred IPI timer fires while the vCPUs are running. */
+    while (qatomic_read(&threads_done) < NUM_CPUS) {
+        qemu_clock_run_timers(QEMU_CLOCK_VIRTUAL);
+        g_usleep(10);
+    }
+
+    for (i = 0; i < NUM_CPUS; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+
+    drain_deferred();
+    check_lines();
+
+    /* Clear every pending IPI; each cpu must then ack nothing but spurious. */
+    for (i = 0; i < NUM_CPUS; i++) {
+        aic_write(0, REG_AIC_IPI_CLR_Pn(i), ALL_CPUS);
+        aic_write(i, REG_AIC_IPI_CLR, AIC_IPI_SELF);
+    }
+    for (i = 0; i < NUM_CPUS; i++) {
+        aic_write(i, REG_AIC_IPI_MASK_CLR, AIC_IPI_NORMAL | AIC_IPI_SELF);
+        g_assert_cmphex(aic_read(i, REG_AIC_IACK), ==, kAIC_INT_SPURIOUS);
+        g_assert_cmphex(aic->cpus[i].pendingIPI, ==, 0);
+        g_assert_cmpint(qatomic_read(&cpu_line[i]), ==, 0);
+    }
+
+    /* Retracting every deferred IPI stops the timer. */
+    for (i = 0; i < NUM_CPUS; i++) {
+        aic_write(i, REG_AIC_IPI_DEFER_SET, ALL_CPUS);
+    }
+    g_assert_true(timer_pending(aic->timer));
+    for (i = 0; i < NUM_CPUS; i++) {
+        aic_write(i, REG_AIC_IPI_DEFER_CLR, ALL_CPUS);
+    }
+    g_assert_false(timer_pending(aic->timer));
+    for (i = 0; i < NUM_CPUS; i++) {
+        g_assert_cmphex(aic->cpus[i].deferredIPI, ==, 0);
+    }
+
+    /* A deferred IPI that is not retracted is delivered by the timer. */
+    aic_write(1, REG_AIC_IPI_DEFER_SET, 1 << 2);
+    drain_deferred();
+    g_assert_cmpint(qatomic_read(&cpu_line[2]), ==, 1);
+    g_assert_cmphex(aic_read(2, REG_AIC_IACK), ==, kAIC_INT_IPI_NORM);
+    g_assert_cmpint(qatomic_read(&cpu_line[2]), ==, 0);
+}
+
+static void test_init_aic(void)
+{
+    Object *machine;
+    DeviceState *dev;
+    int i;
+
+    /* Anonymous devices need a machine and its "unattached" container. */
+    machine = object_property_add_new_container(object_get_root(), "machine");
+    object_property_add_new_container(machine, "unattached");
+
+    dev = DEVICE(object_new(TYPE_APPLE_AIC));
+    aic = APPLE_AIC(dev);
+    aic->numCPU = NUM_CPUS;
+    aic->numEIR = 1;
+    aic->numIRQ = 32;
+    aic->base_size = 0x10000;
+    sysbus_realize(SYS_BUS_DEVICE(dev), &error_abort);
+
+    for (i = 0; i < NUM_CPUS; i++) {
+        aic->cpus[i].irq = qemu_allocate_irq(cpu_irq_handler, NULL, i);
+    }
+    device_cold_reset(dev);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qemu_init_main_loop(&error_abort);
+    module_call_init(MODULE_INIT_QOM);
+    test_init_aic();
+
+    g_test_add_func("/apple-aic/ipi-stress", test_ipi_stress);
+
+    return g_test_run();
+}
@@ -0,0 +1,222 @@
+/*
+ * Apple PMGR power domain test
+ *
+ * Builds a PMGR device tree node with a few power domains, connects
+ * consumers through their clock-gates and checks the power line of each
+ * consumer as the guest writes the power state registers.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "hw/arm/apple-silicon/dtb.h"
+#include "hw/irq.h"
+#include "hw/misc/apple-silicon/pmgr.h"
+#include "hw/sysbus.h"
+
+#define PS_PWRGATE 0x0
+#define PS_CLKGATE 0x4
+#define PS_ACTIVE 0xF
+
+#define DEVICE_VIRTUAL (1 << 4)
+
+/* Layout of the "devices" and "ps-regs" properties of the pmgr node */
+typedef struct QEMU_PACKED {
+    uint32_t flags;
+    uint16_t parent[2];
+    uint8_t unk1[2];
+    uint8_t addr_offset;
+    uint8_t ps_reg;
+    uint8_t unk2[14];
+    uint16_t id;
+    uint8_t unk3[4];
+    char name[16];
+} PMGRDevice;
+
+typedef struct QEMU_PACKED {
+    uint32_t reg;
+    uint32_t offset;
+    uint32_t mask;
+} PMGRPSReg;
+
+enum {
+    DEV_UART0 = 10,
+    DEV_SPI0,
+    DEV_SIO,
+    DEV_DISP,
+    DEV_UART0_ALIAS,
+};
+
+#define UART0_PS 0x100
+#define SPI0_PS 0x108
+
+/* Consumers */
+enum {
+    CON_UART_SPI,
+    CON_ALIAS,
+    CON_UNGATED,
+    NUM_CONSUMERS,
+};
+
+static ApplePMGRState *pmgr;
+static int power[NUM_CONSUMERS];
+static int edges[NUM_CONSUMERS];
+
+static void power_handler(void *opaque, int n, int level)
+{
+    g_assert_cmpint(power[n], !=, level);
+    power[n] = level;
+    edges[n]++;
+}
+
+static void check_power(int uart_spi, int alias, int nb_edges)
+{
+    g_assert_cmpint(power[CON_UART_SPI], ==, uart_spi);
+    g_assert_cmpint(power[CON_ALIAS], ==, alias);
+    g_assert_cmpint(power[CON_UNGATED], ==, 1);
+    g_assert_cmpint(edges[CON_UART_SPI] + edges[CON_ALIAS], ==, nb_edges);
+    g_assert_cmpint(edges[CON_UNGATED], ==, 0);
+}
+
+static void reset_pmgr(void)
+{
+    int i;
+
+    device_cold_reset(DEVICE(pmgr));
+    for (i = 0; i < NUM_CONSUMERS; i++) {
+        power[i] = 1;
+        edges[i] = 0;
+    }
+}
+
+static void test_domains(void)
+{
+    reset_pmgr();
+
+    /* Already on */
+    apple_pmgr_ps_write(pmgr, SPI0_PS, PS_ACTIVE);
+    check_power(1, 1, 0);
+
+    /* Clock gating is enough to power the consumers down. */
+    apple_pmgr_ps_write(pmgr, SPI0_PS, PS_CLKGATE);
+    check_power(0, 1, 1);
+
+    /* A second domain going off only affects the alias consumer. */
+    apple_pmgr_ps_write(pmgr, UART0_PS, PS_PWRGATE);
+    check_power(0, 0, 2);
+
+    /* Not a power state register */
+    apple_pmgr_ps_write(pmgr, UART0_PS + 4, PS_ACTIVE);
+    check_power(0, 0, 2);
+
+    /* Powered only once every domain is back on. */
+    apple_pmgr_ps_write(pmgr, SPI0_PS, PS_ACTIVE);
+    check_power(0, 0, 2);
+    apple_pmgr_ps_write(pmgr, UART0_PS, PS_ACTIVE | 0xF0);
+    check_power(1, 1, 4);
+}
+
+static void test_reset(void)
+{
+    reset_pmgr();
+
+    apple_pmgr_ps_write(pmgr, UART0_PS, PS_PWRGATE);
+    apple_pmgr_ps_write(pmgr, SPI0_PS, PS_PWRGATE);
+    check_power(0, 0, 2);
+
+    /* Consumers reset to powered themselves, everything is on again. */
+    reset_pmgr();
+    apple_pmgr_ps_write(pmgr, SPI0_PS, PS_ACTIVE);
+    check_power(1, 1, 0);
+    apple_pmgr_ps_write(pmgr, UART0_PS, PS_CLKGATE);
+    check_power(0, 0, 2);
+    apple_pmgr_ps_write(pmgr, UART0_PS, PS_ACTIVE);
+    check_power(1, 1, 4);
+}
+
+static void set_device(PMGRDevice *dev, uint16_t id, const char *name,
+                       uint8_t ps_reg, uint8_t addr_offset)
+{
+    dev->id = id;
+    dev->ps_reg = ps_reg;
+    dev->addr_offset = addr_offset;
+    strncpy(dev->name, name, sizeof(dev->name));
+}
+
+static void connect_consumer(DTBNode *root, const char *name, int n,
+                             const uint32_t *gates, size_t nb_gates)
+{
+    DTBNode *node = dtb_create_node(root, name);
+
+    dtb_set_prop(node, "clock-gates", nb_gates * sizeof(uint32_t), gates);
+    apple_pmgr_connect(pmgr, node, qemu_allocate_irq(power_handler, NULL, n));
+}
+
+static void test_init_pmgr(void)
+{
+    static const uint32_t uart_spi_gates[] = { DEV_UART0, DEV_SPI0 };
+    static const uint32_t alias_gates[] = { DEV_UART0_ALIAS };
+    static const uint32_t ungated_gates[] = { DEV_SIO, DEV_DISP, 99 };
+    uint64_t reg[2] = { 0x23b700000, 0x1000 };
+    PMGRPSReg ps_regs[2] = {
+        { .reg = 0, .offset = UART0_PS },
+        { .reg = 1, .offset = 0 },
+    };
+    PMGRDevice devs[5] = { 0 };
+    SysBusDevice *sbd;
+    Object *machine;
+    DTBNode *root;
+    DTBNode *node;
+
+    /* Anonymous devices need a machine and its "unattached" container. */
+    machine = object_property_add_new_container(object_get_root(), "machine");
+    object_property_add_new_container(machine, "unattached");
+
+    set_device(&devs[0], DEV_UART0, "UART0", 0, 0);
+    set_device(&devs[1], DEV_SPI0, "SPI0", 0, 1);
+    /* Skipped: no power state register of its own */
+    set_device(&devs[2], DEV_SIO, "SIO", 0, 2);
+    devs[2].flags = DEVICE_VIRTUAL;
+    /* Skipped: not in the first PMGR block */
+    set_device(&devs[3], DEV_DISP, "DISP", 1, 0);
+    /* Shares the UART0 register */
+    set_device(&devs[4], DEV_UART0_ALIAS, "UART0_ALIAS", 0, 0);
+
+    root = dtb_create_node(NULL, NULL);
+    node = dtb_create_node(root, "pmgr");
+    dtb_set_prop(node, "reg", sizeof(reg), reg);
+    dtb_set_prop(node, "devices", sizeof(devs), devs);
+    dtb_set_prop(node, "ps-regs", sizeof(ps_regs), ps_regs);
+
+    sbd = apple_pmgr_create(node);
+    pmgr = APPLE_PMGR(sbd);
+    sysbus_realize_and_unref(sbd, &error_abort);
+
+    connect_consumer(root, "uart-spi", CON_UART_SPI, uart_spi_gates,
+                     ARRAY_SIZE(uart_spi_gates));
+    connect_consumer(root, "alias", CON_ALIAS, alias_gates,
+                     ARRAY_SIZE(alias_gates));
+    connect_consumer(root, "ungated", CON_UNGATED, ungated_gates,
+                     ARRAY_SIZE(ungated_gates));
+    /* Without clock-gates, a device is never connected. */
+    apple_pmgr_connect(pmgr, dtb_create_node(root, "always-on"), NULL);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qemu_init_main_loop(&error_abort);
+    module_call_init(MODULE_INIT_QOM);
+    test_init_pmgr();
+
+    g_test_add_func("/apple-pmgr/domains", test_domains);
+    g_test_add_func("/apple-pmgr/reset", test_reset);
+
+    return g_test_run();
+}
@@ -0,0 +1,142 @@
+/*
+ * WKdm compression test
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc32c.h"
+#include "qemu/wkdm.h"
+
+#define WORDS (WKDM_PAGE_SIZE / 4)
+
+typedef void (*page_fn)(uint32_t *page, uint32_t *seed);
+
+static uint32_t next_rand(uint32_t *seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 1;
+}
+
+static void page_zero(uint32_t *page, uint32_t *seed)
+{
+    memset(page, 0, WKDM_PAGE_SIZE);
+}
+
+static void page_same(uint32_t *page, uint32_t *seed)
+{
+    for (int i = 0; i < WORDS; i++) {
+        page[i] = 0xdeadbeef;
+    }
+}
+
+/* A few words scattered over zeroes, which use the mostly-zero format */
+static void page_sparse(uint32_t *page, uint32_t *seed)
+{
+    for (int i = 0; i < WORDS; i++) {
+        page[i] = i % 397 == 5 ? next_rand(seed) : 0;
+    }
+}
+
+/* Zeroes, partial and exact dictionary matches and misses */
+static void page_mixed(uint32_t *page, uint32_t *seed)
+{
+    for (int i = 0; i < WORDS; i++) {
+        uint32_t r = next_rand(seed);
+
+        switch (r % 4) {
+        case 0:
+            page[i] = 0;
+            break;
+        case 1:
+            page[i] = 0x10000000 | (next_rand(seed) & 0x3ff);
+            break;
+        case 2:
+            page[i] = i ? page[i - 1] : 1;
+            break;
+        default:
+            page[i] = 0xfffff000 + (r & 0xff);
+            break;
+        }
+    }
+}
+
+/* Alternating runs of pointers and zeroes */
+static void page_runs(uint32_t *page, uint32_t *seed)
+{
+    for (int i = 0; i < WORDS; i++) {
+        page[i] = (i / 64) % 2 ? 0 : 0x40000000 + i * 8;
+    }
+}
+
+static void page_random(uint32_t *page, uint32_t *seed)
+{
+    for (int i = 0; i < WORDS; i++) {
+        page[i] = next_rand(seed) ^ (next_rand(seed) << 16);
+    }
+}
+
+typedef struct {
+    const char *name;
+    page_fn fill;
+    int budget;
+    /* Expected size and CRC-32C of the output, which starts out as zeroes */
+    int size;
+    uint32_t crc;
+    /* Whether decompression gives back the page */
+    bool round_trip;
+} WKdmTestCase;
+
+static const WKdmTestCase test_cases[] = {
+    { "zero", page_zero, WKDM_PAGE_SIZE, 0, 0, false },
+    { "same", page_same, WKDM_PAGE_SIZE, 0, 0, false },
+    { "sparse", page_sparse, WKDM_PAGE_SIZE, 74, 0x30918c73, true },
+    { "mixed", page_mixed, WKDM_PAGE_SIZE, 4800, 0x56c32f81, true },
+    { "mixed-budget", page_mixed, 4096, -1, 0, false },
+    { "runs", page_runs, WKDM_PAGE_SIZE, 4860, 0xf2e03b98, true },
+    { "random", page_random, WKDM_PAGE_SIZE, -1, 0, false },
+};
+
+static void test_case(const WKdmTestCase *tc)
+{
+    g_autofree uint32_t *page = g_new(uint32_t, WORDS);
+    g_autofree uint32_t *out = g_new(uint32_t, WORDS);
+    g_autofree uint32_t *back = g_new(uint32_t, WORDS);
+    uint32_t seed = 1;
+    int size;
+
+    tc->fill(page, &seed);
+    memset(out, 0, WKDM_PAGE_SIZE);
+    size = WKdm_compress(page, out, tc->budget);
+    g_assert_cmpint(size, ==, tc->size);
+    if (size > 0) {
+        g_assert_cmphex(crc32c(0xffffffff, (uint8_t *)out, size), ==,
+                        tc->crc);
+    }
+
+    if (tc->round_trip) {
+        memset(back, 0x55, WKDM_PAGE_SIZE);
+        g_assert(WKdm_decompress(out, back, WKDM_PAGE_SIZE));
+        g_assert(memcmp(page, back, WKDM_PAGE_SIZE) == 0);
+    }
+}
+
+/* Every host vector implementation must match the golden output. */
+static void test_golden(void)
+{
+    do {
+        for (int i = 0; i < ARRAY_SIZE(test_cases); i++) {
+            test_case(&test_cases[i]);
+        }
+    } while (test_WKdm_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/wkdm/golden", test_golden);
+
+    return g_test_run();
+}
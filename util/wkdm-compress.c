@@ -1,4 +1,5 @@
-#include "WKdm_internal.h"
+#include "qemu/osdep.h"
+#include "wkdm-internal.h"
 
 /*
  * WK_pack_2bits()
@@ -78,9 +79,11 @@ static WK_word *WK_pack_3_tenbits(WK_word *source_buf, WK_word *source_end,
     return dest_next;
 }
 
-unsigned int WKdm_compress(WK_word *src_buf, WK_word *dest_buf, int byte_budget)
+int WKdm_compress(const void *src, void *dest, int byte_budget)
 {
-    unsigned num_input_words = TARGET_PAGE_SIZE / BYTES_PER_WORD;
+    const WK_word *src_buf = src;
+    WK_word *dest_buf = dest;
+    unsigned num_input_words = PAGE_SIZE_IN_WORDS;
     DictionaryElement dictionary[DICTIONARY_SIZE];
 
     /*
@@ -116,9 +119,10 @@ unsigned int WKdm_compress(WK_word *src_buf, WK_word *dest_buf, int byte_budget)
     WK_word *next_low_bits = tempLowBitsArray;
     WK_word *start_next_low_bits = next_low_bits;
 
-    WK_word *next_input_word = src_buf;
-    WK_word *end_of_input = src_buf + num_input_words;
+    const WK_word *next_input_word = src_buf;
+    const WK_word *end_of_input = src_buf + num_input_words;
     int header_size = (TAGS_AREA_OFFSET + TAGS_AREA_SIZE) * BYTES_PER_WORD;
+    int total_budget = byte_budget;
     byte_budget -= header_size;
     if (byte_budget <= 0) {
         return -1;
@@ -148,7 +152,19 @@ unsigned int WKdm_compress(WK_word *src_buf, WK_word *dest_buf, int byte_budget)
         if (input_word == dict_word) {
             RECORD_EXACT(dict_location - dictionary);
         } else if (input_word == 0) {
-            RECORD_ZERO;
+            /*
+             * The dictionary never holds zero, so every word of a zero
+             * run gets a zero tag and leaves the dictionary alone.
+             */
+            size_t run = WKdm_zero_prefix(next_input_word,
+                                          (end_of_input - next_input_word) *
+                                              BYTES_PER_WORD) /
+                         BYTES_PER_WORD;
+
+            memset(next_tag, ZERO_TAG, run);
+            next_tag += run;
+            next_input_word += run;
+            continue;
         } else {
             WK_word input_high_bits = HIGH_BITS(input_word);
             if (input_high_bits == HIGH_BITS(dict_word)) {
@@ -191,25 +207,37 @@ unsigned int WKdm_compress(WK_word *src_buf, WK_word *dest_buf, int byte_budget)
         /* same value page */
         return SV_RETURN;
     }
-    int sparse_csize = (miss + hits) * 6 + 4;
+    int sparse_csize = (miss + hits) * 6 + 8;
     int normal_csize = 2 * partial / 3 + miss * 4 + hits / 2 + header_size;
 
     if (sparse_csize < normal_csize) {
         /* Mostly Zero */
+        if (sparse_csize > total_budget) {
+            return -1;
+        }
         *(dest_buf++) = MZV_MAGIC;
-        unsigned short *output = (unsigned short *)dest_buf;
-        next_input_word = (WK_word *)src_buf;
+        char *output = (char *)dest_buf;
+        next_input_word = src_buf;
         while (next_input_word < end_of_input) {
             WK_word input_word = *next_input_word;
             if (input_word != 0) {
-                *(uint32_t *)(output += 2) = input_word;
-                *(output++) = (char *)next_input_word - (char *)src_buf;
+                stl_he_p(output, input_word);
+                stw_he_p(output + 4, (const char *)next_input_word -
+                                     (const char *)src_buf);
+                output += 6;
             }
             next_input_word++;
         }
+        stl_he_p(output, 0);
         return sparse_csize;
     }
 
+    /* The packed queue positions and low bits must fit, too. */
+    if ((((hits + 7) >> 3) + (partial + 2) / 3) * BYTES_PER_WORD >
+        byte_budget) {
+        return -1;
+    }
+
     /*
      * Record (into the header) where we stopped writing full words,
      * which is where we will pack the queue positions.  (Recall
@@ -1,4 +1,5 @@
-#include "WKdm_internal.h"
+#include "qemu/osdep.h"
+#include "wkdm-internal.h"
 
 const char hashLookupTable[] = HASH_LOOKUP_TABLE_CONTENTS;
 
@@ -7,10 +8,11 @@ const char hashLookupTable[] = HASH_LOOKUP_TABLE_CONTENTS;
  *  two bit values as bytes (with the low two bits of each byte holding
  *  the actual value.
  */
-static WK_word *WK_unpack_2bits(WK_word *input_buf, WK_word *input_end,
+static WK_word *WK_unpack_2bits(const WK_word *input_buf,
+                                const WK_word *input_end,
                                 WK_word *output_buf)
 {
-    register WK_word *input_next = input_buf;
+    register const WK_word *input_next = input_buf;
     register WK_word *output_next = output_buf;
     register WK_word packing_mask = TWO_BITS_PACKING_MASK;
 
@@ -38,10 +40,11 @@ static WK_word *WK_unpack_2bits(WK_word *input_buf, WK_word *input_end,
  * (The four-bit values occupy the low halves of the bytes in the
  * result).
  */
-static WK_word *WK_unpack_4bits(WK_word *input_buf, WK_word *input_end,
+static WK_word *WK_unpack_4bits(const WK_word *input_buf,
+                                const WK_word *input_end,
                                 WK_word *output_buf)
 {
-    register WK_word *input_next = input_buf;
+    register const WK_word *input_next = input_buf;
     register WK_word *output_next = output_buf;
     register WK_word packing_mask = FOUR_BITS_PACKING_MASK;
 
@@ -65,10 +68,11 @@ static WK_word *WK_unpack_4bits(WK_word *input_buf, WK_word *input_end,
 /* unpack_3_tenbits unpacks three 10-bit items from (the low 30 bits of)
  * a 32-bit word
  */
-static WK_word *WK_unpack_3_tenbits(WK_word *input_buf, WK_word *input_end,
+static WK_word *WK_unpack_3_tenbits(const WK_word *input_buf,
+                                    const WK_word *input_end,
                                     WK_word *output_buf)
 {
-    register WK_word *input_next = input_buf;
+    register const WK_word *input_next = input_buf;
     register WK_word *output_next = output_buf;
     register WK_word packing_mask = LOW_BITS_MASK;
 
@@ -98,8 +102,10 @@ static WK_word *WK_unpack_3_tenbits(WK_word *input_buf, WK_word *input_end,
  * fixes them
  */
 
-bool WKdm_decompress(WK_word *src_buf, WK_word *dest_buf, unsigned int size)
+bool WKdm_decompress(const void *src, void *dest, unsigned int size)
 {
+    const WK_word *src_buf = src;
+    WK_word *dest_buf = dest;
     DictionaryElement dictionary[DICTIONARY_SIZE];
     unsigned int words = size / BYTES_PER_WORD;
 
@@ -116,17 +122,31 @@ bool WKdm_decompress(WK_word *src_buf, WK_word *dest_buf, unsigned int size)
     (void)words;
 
     if (*src_buf == MZV_MAGIC) {
-        unsigned short *input = (unsigned short *)(src_buf + 1);
+        const char *input = (const char *)(src_buf + 1);
+        const char *input_end = (const char *)src_buf + size;
         assert(src_buf != dest_buf);
-        memset(dest_buf, 0, TARGET_PAGE_SIZE);
-        WK_word word = *(WK_word *)(input);
-        input += 2;
-        int index = *(input++);
-        *(WK_word *)(((char *)dest_buf) + index) = word;
-        return true;
+        memset(dest_buf, 0, PAGE_SIZE_IN_BYTES);
+        /* (word, byte offset) pairs up to a zero word */
+        while (input + BYTES_PER_WORD <= input_end) {
+            WK_word word = ldl_he_p(input);
+            unsigned int index;
+
+            if (word == 0) {
+                return true;
+            }
+            if (input + 6 > input_end) {
+                break;
+            }
+            index = lduw_he_p(input + 4);
+            if (index >= PAGE_SIZE_IN_BYTES || index % BYTES_PER_WORD) {
+                return false;
+            }
+            dest_buf[index / BYTES_PER_WORD] = word;
+            input += 6;
+        }
+        return false;
     }
 
-
     PRELOAD_DICTIONARY;
 
     if ((TAGS_AREA_START(src_buf) >= src_buf + words) ||
@@ -151,7 +171,7 @@ bool WKdm_decompress(WK_word *src_buf, WK_word *dest_buf, unsigned int size)
         char *tags_area_end = ((char *)tempTagsArray) + PAGE_SIZE_IN_WORDS;
         char *next_q_pos = (char *)tempQPosArray;
         WK_word *next_low_bits = tempLowBitsArray;
-        WK_word *next_full_word = FULL_WORD_AREA_START(src_buf);
+        const WK_word *next_full_word = FULL_WORD_AREA_START(src_buf);
 
         WK_word *next_output = dest_buf;
 
@@ -163,8 +183,13 @@ bool WKdm_decompress(WK_word *src_buf, WK_word *dest_buf, unsigned int size)
             char tag = next_tag[0];
             switch (tag) {
             case ZERO_TAG: {
-                *next_output = 0;
-                break;
+                size_t run = WKdm_zero_prefix(next_tag,
+                                              tags_area_end - next_tag);
+
+                memset(next_output, 0, run * BYTES_PER_WORD);
+                next_tag += run;
+                next_output += run;
+                continue;
             }
             case EXACT_TAG: {
                 WK_word *dict_location = dictionary + *(next_q_pos++);
@@ -34,10 +34,14 @@
  *  5. a variable-sized LOW BITS AREA (always word aligned and an
  *     integral number of words) holding ten-bit low-bit patterns
  *     (from partial matches), packed three per word.
+ *
+ * Mostly-zero pages are instead stored as a MZV_MAGIC word followed by
+ * one (word, 16-bit byte offset) pair for each non-zero word of the page,
+ * six bytes per pair, and a zero word that ends the list.
  */
 
-#include "qemu/osdep.h"
-#include "cpu.h"
+#include "qemu/bswap.h"
+#include "qemu/wkdm.h"
 
 typedef unsigned int WK_word;
 
@@ -46,7 +50,7 @@ typedef unsigned int WK_word;
  * words, or something like that
  */
 
-#define PAGE_SIZE_IN_BYTES TARGET_PAGE_SIZE
+#define PAGE_SIZE_IN_BYTES WKDM_PAGE_SIZE
 #define PAGE_SIZE_IN_KBYTES (PAGE_SIZE_IN_BYTES / 1024)
 #define PAGE_SIZE_IN_WORDS (PAGE_SIZE_IN_BYTES / 4)
 
@@ -180,6 +184,12 @@ typedef WK_word DictionaryElement;
 
 extern const char hashLookupTable[];
 
+/*
+ * Return the number of leading zero bytes in the @len bytes at @buf,
+ * using the fastest host vector implementation.
+ */
+size_t WKdm_zero_prefix(const void *buf, size_t len);
+
 /* EMIT... macros emit bytes or words into the intermediate arrays
  */
 
@@ -225,9 +235,4 @@ extern const char hashLookupTable[];
 
 #define SV_RETURN 0
 
-unsigned int WKdm_compress(WK_word *src_buf, WK_word *dest_buf,
-                           int byte_budget);
-
-bool WKdm_decompress(WK_word *src_buf, WK_word *dest_buf, unsigned int size);
-
 #endif /* WKDM_INTERNAL_H */
@@ -0,0 +1,60 @@
+/*
+ * WKdm host vector acceleration
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * The WKdm model is a serial walk through a small dictionary, but most
+ * of the compressor's input and the decompressor's tags are long runs of
+ * zeroes, which both sides skip with the fastest vector code the host has.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/bswap.h"
+#include "host/cpuinfo.h"
+#include "wkdm-internal.h"
+
+typedef size_t (*wkdm_accel_fn)(const void *, size_t);
+
+static size_t wkdm_zero_prefix_int(const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+        uint64_t t = ldq_he_p(p + i);
+
+        if (t) {
+            return i + (HOST_BIG_ENDIAN ? clz64(t) : ctz64(t)) / 8;
+        }
+    }
+    while (i < len && !p[i]) {
+        i++;
+    }
+    return i;
+}
+
+#include "host/wkdm.c.inc"
+
+static wkdm_accel_fn wkdm_zero_prefix_accel;
+static unsigned accel_index;
+
+size_t WKdm_zero_prefix(const void *buf, size_t len)
+{
+    return wkdm_zero_prefix_accel(buf, len);
+}
+
+bool test_WKdm_next_accel(void)
+{
+    if (accel_index != 0) {
+        wkdm_zero_prefix_accel = accel_table[--accel_index];
+        return true;
+    }
+    return false;
+}
+
+static void __attribute__((constructor)) init_accel(void)
+{
+    accel_index = best_accel();
+    wkdm_zero_prefix_accel = accel_table[accel_index];
+}